@@ -11,6 +11,7 @@
 #ifdef USE_ESP_IDF
 #include "esp_vfs.h"
 #include "esp_vfs_fat.h"
+#include "diskio_sdmmc.h"
 #include "sdmmc_cmd.h"
 #include "driver/sdmmc_host.h"
 #include "driver/sdmmc_types.h"
@@ -29,6 +30,8 @@ static constexpr size_t FILE_PATH_MAX = ESP_VFS_PATH_MAX + CONFIG_SPIFFS_OBJ_NAM
 static const std::string MOUNT_POINT("/sdcard");
 
 std::string build_path(const char *path) { return MOUNT_POINT + path; }
+
+const std::string &SdMmc::get_mount_point() const { return MOUNT_POINT; }
 #endif
 
 #ifdef USE_SENSOR
@@ -155,6 +158,9 @@ void SdMmc::setup() {
     return;
   }
 
+  // Pas forcément le lecteur 0 si un autre volume FAT a été monté avant
+  this->pdrv_ = ff_diskio_get_pdrv_card(this->card_);
+
   // Diagnostic de la carte
   ESP_LOGI(TAG, "SD Card Info (slot %d):", this->slot_);
   ESP_LOGI(TAG, "  Name: %s", this->card_->cid.name);
@@ -165,6 +171,30 @@ void SdMmc::setup() {
   update_sensors();
 }
 
+void SdMmc::write_file(const char *path, const uint8_t *buffer, size_t len, const char *mode) {
+  ESP_LOGV(TAG, "Writing to file: %s", path);
+  std::string absolut_path = build_path(path);
+  FILE *file = fopen(absolut_path.c_str(), mode);
+  if (file == NULL) {
+    ESP_LOGE(TAG, "Failed to open file for writing");
+    return;
+  }
+  if (fwrite(buffer, 1, len, file) != len) {
+    ESP_LOGE(TAG, "Failed to write to file");
+  }
+  fclose(file);
+  this->update_sensors();
+  this->write_callback_.call(absolut_path);
+}
+
+void SdMmc::write_file(const char *path, const uint8_t *buffer, size_t len) {
+  this->write_file(path, buffer, len, "w");
+}
+
+void SdMmc::append_file(const char *path, const uint8_t *buffer, size_t len) {
+  this->write_file(path, buffer, len, "a");
+}
+
 void SdMmc::write_file_chunked(const char *path, const uint8_t *buffer, size_t len, size_t chunk_size) {
   std::string absolut_path = build_path(path);
   FILE *file = NULL;
@@ -186,6 +216,7 @@ void SdMmc::write_file_chunked(const char *path, const uint8_t *buffer, size_t l
   }
   fclose(file);
   this->update_sensors();
+  this->write_callback_.call(absolut_path);
 }
 #else
 void SdMmc::write_file_chunked(const char *path, const uint8_t *buffer, size_t len, size_t chunk_size) {
@@ -331,6 +362,7 @@ bool SdMmc::create_directory(const char *path) {
     return false;
   }
   this->update_sensors();
+  this->write_callback_.call(absolut_path);
   return true;
 }
 
@@ -345,6 +377,7 @@ bool SdMmc::remove_directory(const char *path) {
     ESP_LOGE(TAG, "Failed to remove directory: %s", strerror(errno));
   }
   this->update_sensors();
+  this->write_callback_.call(absolut_path);
   return true;
 }
 
@@ -359,6 +392,7 @@ bool SdMmc::delete_file(const char *path) {
     ESP_LOGE(TAG, "Failed to remove file: %s", strerror(errno));
   }
   this->update_sensors();
+  this->write_callback_.call(absolut_path);
   return true;
 }
 
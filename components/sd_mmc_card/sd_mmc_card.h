@@ -76,6 +76,10 @@ class SdMmc : public Component {
   size_t file_size(const char *path);
   size_t file_size(std::string const &path);
   void read_file_stream(const char *path, size_t offset, size_t chunk_size, std::function<void(const uint8_t*, size_t)> callback);
+  // Notifié avec le chemin absolu après chaque écriture, création ou suppression
+  void add_on_write_callback(std::function<void(const std::string &)> &&callback) {
+    this->write_callback_.add(std::move(callback));
+  }
 #ifdef USE_SENSOR
   void add_file_size_sensor(sensor::Sensor *, std::string const &path);
 #endif
@@ -91,6 +95,13 @@ class SdMmc : public Component {
 
   void set_slot(uint8_t slot) { this->slot_ = slot; }
 
+#ifdef USE_ESP_IDF
+  // Point de montage VFS de la carte
+  const std::string &get_mount_point() const;
+  // Lecteur FatFs attribué par esp_vfs_fat_sdmmc_mount, 0xFF tant que la carte n'est pas montée
+  uint8_t get_fatfs_pdrv() const { return this->pdrv_; }
+#endif
+
  protected:
   ErrorCode init_error_;
   uint8_t clk_pin_;
@@ -106,10 +117,12 @@ class SdMmc : public Component {
 
 #ifdef USE_ESP_IDF
   sdmmc_card_t *card_;
+  uint8_t pdrv_{0xFF};
 #endif
 #ifdef USE_SENSOR
   std::vector<FileSizeSensor> file_size_sensors_{};
 #endif
+  CallbackManager<void(const std::string &)> write_callback_{};
   void update_sensors();
 
 #ifdef USE_ESP_IDF
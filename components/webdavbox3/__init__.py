@@ -1,6 +1,7 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
 from esphome.const import CONF_ID, CONF_USERNAME, CONF_PASSWORD, CONF_PORT
+from esphome.components import sd_mmc_card
 
 CODEOWNERS = ["@youkorr"]
 DEPENDENCIES = ["sd_mmc_card"]
@@ -9,13 +10,105 @@ MULTI_CONF = False  # Si tu prévois un seul composant, sinon mets True si c'est
 webdavbox_ns = cg.esphome_ns.namespace("webdavbox3")
 WebDAVBox3 = webdavbox_ns.class_("WebDAVBox3", cg.Component)
 
+# Classes de buffers de transfert préallouées au démarrage
+TRANSFER_BUFFER_SCHEMA = cv.Schema({
+    cv.Required("size"): cv.int_range(min=4096, max=1048576),
+    cv.Required("count"): cv.int_range(min=1, max=32),
+})
+
+DEFAULT_TRANSFER_BUFFERS = [
+    {"size": 16384, "count": 4},    # PUT, petites lectures
+    {"size": 65536, "count": 6},    # GET moyens, COPY, benchmark
+    {"size": 262144, "count": 3},   # GET de très grands fichiers
+]
+
+# Classe de priorité du partage de débit, choisie par préfixe d'URI
+PRIORITY_CLASS_SCHEMA = cv.Schema({
+    cv.Required("name"): cv.string_strict,
+    cv.Required("uri_prefix"): cv.string_strict,
+    cv.Optional("weight", default=1): cv.int_range(min=1, max=100),
+})
+
+BANDWIDTH_SCHEMA = cv.Schema({
+    # Plafonds en octets/s (0 = pas de limite)
+    cv.Optional("max_rate", default=0): cv.int_range(min=0),
+    cv.Optional("per_client_rate", default=0): cv.int_range(min=0),
+    cv.Optional("classes", default=[]): cv.ensure_list(PRIORITY_CLASS_SCHEMA),
+})
+
+# Fichiers que les explorateurs cherchent dans chaque dossier visité
+DEFAULT_PROBE_PATTERNS = [
+    "desktop.ini", "autorun.inf", "Thumbs.db", "ehthumbs.db", "folder.jpg", "folder.gif",
+    ".hidden", ".localized", ".Spotlight-V100", ".Trashes", ".TemporaryItems", ".fseventsd",
+    ".metadata_never_index", ".metadata_never_index_unless_rootfs", ".ql_disablethumbnails",
+    ".ql_disablecache", ".VolumeIcon.icns", ".com.apple.timemachine.donotpresent",
+]
+
+PROBE_FILTER_SCHEMA = cv.Schema({
+    # Motifs (* et ?, sans casse) sur le dernier segment de l'URI : absence mémorisée après un 404
+    cv.Optional("patterns", default=DEFAULT_PROBE_PATTERNS): cv.ensure_list(cv.string_strict),
+    cv.Optional("negative_cache_size", default=512): cv.int_range(min=0, max=8192),
+    # Métadonnées macOS écrites en RAM plutôt que sur la carte (perdues au redémarrage)
+    cv.Optional("ram_patterns", default=["._*", ".DS_Store"]): cv.ensure_list(cv.string_strict),
+    # 0 = magasin RAM désactivé : ces motifs sont alors traités comme les autres
+    cv.Optional("ram_store_size", default=0): cv.int_range(min=0),
+    cv.Optional("ram_max_file_size", default=32768): cv.int_range(min=512),
+})
+
+# Occupation maximale d'un dossier, vérifiée avant d'accepter le corps d'un PUT
+UPLOAD_QUOTA_SCHEMA = cv.Schema({
+    cv.Required("path"): cv.string_strict,
+    cv.Required("max_size"): cv.int_range(min=0),
+})
+
 CONFIG_SCHEMA = cv.Schema({
     cv.Required(CONF_ID): cv.declare_id(WebDAVBox3),
+    # Carte dont les écritures (automatisations, autres composants) invalident les caches
+    cv.GenerateID(sd_mmc_card.CONF_SD_MMC_CARD_ID): cv.use_id(sd_mmc_card.SdMmc),
     cv.Optional("root_path", default="/sdcard/"): cv.string,
     cv.Optional("url_prefix", default="/"): cv.string,
     cv.Optional(CONF_PORT, default=81): cv.port,
     cv.Optional(CONF_USERNAME, default=""): cv.string,
     cv.Optional(CONF_PASSWORD, default=""): cv.string,
+    # Nombre de buffers PSRAM de lecture anticipée pour les GET (1 = transfert séquentiel)
+    cv.Optional("read_ahead_buffers", default=3): cv.int_range(min=1, max=8),
+    # Buffers PSRAM d'écriture différée pour les PUT (1 = réception et écriture en alternance)
+    cv.Optional("write_behind_buffers", default=3): cv.int_range(min=1, max=8),
+    # Taille des chunks de transfert (par défaut choisie selon la taille du fichier)
+    cv.Optional("chunk_size"): cv.int_range(min=4096, max=1048576),
+    cv.Optional("transfer_buffers", default=DEFAULT_TRANSFER_BUFFERS): cv.ensure_list(TRANSFER_BUFFER_SCHEMA),
+    # Attente maximale d'un buffer libre avant de répondre 503
+    cv.Optional("buffer_timeout", default="2s"): cv.positive_time_period_milliseconds,
+    # Cache PSRAM des petits fichiers (0 = désactivé) et taille max d'une entrée
+    cv.Optional("file_cache_size", default=2097152): cv.int_range(min=0),
+    cv.Optional("file_cache_max_file_size", default=262144): cv.int_range(min=1024),
+    # Cache des listings de répertoires pour PROPFIND (0 = désactivé)
+    cv.Optional("directory_cache_size", default=262144): cv.int_range(min=0),
+    # PROPFIND Depth: infinity en flux ; au-delà, 403 propfind-finite-depth (0 = toujours refusé)
+    cv.Optional("propfind_max_depth", default=16): cv.int_range(min=0, max=64),
+    cv.Optional("propfind_max_entries", default=20000): cv.int_range(min=1),
+    # Journal des modifications pour REPORT sync-collection (enregistrements conservés, 0 = désactivé)
+    cv.Optional("sync_journal_size", default=4096): cv.int_range(min=0, max=65536),
+    # Extensions pour lesquelles une variante .gz/.br est servie si le client l'accepte
+    cv.Optional("compressible_extensions", default=["html", "htm", "js", "css", "json", "txt", "log", "svg", "xml"]):
+        cv.ensure_list(cv.string_strict),
+    # Crée les variantes .gz en tâche de fond (au démarrage puis après chaque écriture)
+    cv.Optional("precompress", default=False): cv.boolean,
+    # Workers asynchrones : transferts longs (GET/PUT/COPY) et métadonnées (PROPFIND...)
+    # sur des files séparées ; 0 worker de transfert = traitement dans la tâche httpd
+    cv.Optional("bulk_workers", default=2): cv.int_range(min=0, max=6),
+    cv.Optional("metadata_workers", default=1): cv.int_range(min=1, max=4),
+    cv.Optional("worker_queue_length", default=8): cv.int_range(min=1, max=32),
+    # Arène en RAM interne par worker pour les temporaires d'une requête (0 = tas) ;
+    # ajuster d'après le pic et la moyenne affichés par dump_config
+    cv.Optional("request_arena_size", default=4096): cv.int_range(min=0, max=65536),
+    # Partage équitable du débit des GET entre clients
+    cv.Optional("bandwidth"): BANDWIDTH_SCHEMA,
+    # Réponses sans accès à la carte pour desktop.ini, .DS_Store, ._*... ({} = valeurs par défaut)
+    cv.Optional("probe_filter"): PROBE_FILTER_SCHEMA,
+    # Place laissée libre sur la carte : un envoi qui l'entamerait est refusé (507) avant son corps
+    cv.Optional("min_free_space", default=1048576): cv.int_range(min=0),
+    cv.Optional("upload_quotas", default=[]): cv.ensure_list(UPLOAD_QUOTA_SCHEMA),
 }).extend(cv.COMPONENT_SCHEMA)
 
 async def to_code(config):
@@ -25,11 +118,48 @@ async def to_code(config):
     cg.add(var.set_root_path(config["root_path"]))
     cg.add(var.set_url_prefix(config["url_prefix"]))
     cg.add(var.set_port(config[CONF_PORT]))
+    cg.add(var.set_read_ahead_depth(config["read_ahead_buffers"]))
+    cg.add(var.set_write_behind_depth(config["write_behind_buffers"]))
+    if "chunk_size" in config:
+        cg.add(var.set_chunk_size(config["chunk_size"]))
+    for buf in config["transfer_buffers"]:
+        cg.add(var.add_transfer_buffers(buf["size"], buf["count"]))
+    cg.add(var.set_buffer_timeout(config["buffer_timeout"].total_milliseconds))
+    cg.add(var.set_file_cache(config["file_cache_size"], config["file_cache_max_file_size"]))
+    cg.add(var.set_dir_cache_size(config["directory_cache_size"]))
+    cg.add(var.set_propfind_limits(config["propfind_max_depth"], config["propfind_max_entries"]))
+    cg.add(var.set_sync_journal_size(config["sync_journal_size"]))
+    sd_card = await cg.get_variable(config[sd_mmc_card.CONF_SD_MMC_CARD_ID])
+    cg.add(var.set_sd_card(sd_card))
+    cg.add(var.set_compressible_extensions([e.lstrip(".").lower() for e in config["compressible_extensions"]]))
+    cg.add(var.set_precompress(config["precompress"]))
+    cg.add(var.set_workers(config["bulk_workers"], config["metadata_workers"], config["worker_queue_length"]))
+    cg.add(var.set_request_arena_size(config["request_arena_size"]))
+    if "bandwidth" in config:
+        bw = config["bandwidth"]
+        cg.add(var.set_bandwidth_limits(bw["max_rate"], bw["per_client_rate"]))
+        for cls in bw["classes"]:
+            cg.add(var.add_priority_class(cls["name"], cls["weight"], cls["uri_prefix"]))
+    if "probe_filter" in config:
+        pf = config["probe_filter"]
+        # Règles RAM d'abord : la première règle correspondante l'emporte
+        for pattern in pf["ram_patterns"]:
+            cg.add(var.add_probe_rule(pattern, True))
+        for pattern in pf["patterns"]:
+            cg.add(var.add_probe_rule(pattern, False))
+        cg.add(var.set_probe_cache(pf["negative_cache_size"], pf["ram_store_size"], pf["ram_max_file_size"]))
+    
+    cg.add(var.set_min_free_space(config["min_free_space"]))
+    for quota in config["upload_quotas"]:
+        cg.add(var.add_upload_quota(quota["path"], quota["max_size"]))
     
     if CONF_USERNAME in config:
         cg.add(var.set_username(config[CONF_USERNAME]))
     if CONF_PASSWORD in config:
         cg.add(var.set_password(config[CONF_PASSWORD]))
+    # Identifiants renseignés : Basic exigé sur toutes les requêtes sauf OPTIONS
+    if config[CONF_USERNAME]:
+        cg.add(var.enable_authentication(True))
     
     return var
 
@@ -4,7 +4,6 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <unistd.h>
-#include <fstream>
 #include <errno.h>
 #include "esp_err.h"
 #include "esp_netif.h"
@@ -14,7 +13,12 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <arpa/inet.h>
 #include "esp_timer.h"
+#include "mbedtls/base64.h"
+#include <map>
+#include <memory>
+#include <algorithm>
 
 
 namespace esphome {
@@ -24,6 +28,15 @@ namespace webdavbox3 {
 
 static const char *const TAG = "webdavbox3";
 
+// Taille des chunks du corps Multi-Status (une dizaine de <D:response>)
+static const size_t PROPFIND_BUFFER_SIZE = 8192;
+
+// Le répertoire interne n'existe qu'à la racine : un dossier utilisateur du
+// même nom plus bas reste listé
+static bool is_state_dir(const DirEntry &entry, bool at_root) {
+  return at_root && entry.is_dir && entry.name == STATE_DIR;
+}
+
 bool create_directories_util(const std::string& path) {
     char tmp[256];
     char *p = NULL;
@@ -67,40 +80,14 @@ bool create_directories_util(const std::string& path) {
     return true;
 }
 
-// Nouvelle fonction pour décoder les URL
-std::string url_decode(const std::string &src) {
-    std::string result;
-    result.reserve(src.length());  // Pré-allouer pour éviter les réallocations
-
-    const char* str = src.c_str();
-    int i = 0;
-    char ch;
-    int j;
-    
-    while (str[i]) {
-        if (str[i] == '%' && str[i+1] && str[i+2]) {
-            if (sscanf(str + i + 1, "%2x", &j) == 1) {
-                ch = static_cast<char>(j);
-                result += ch;
-                i += 3;
-            } else {
-                result += str[i++];
-            }
-        } else if (str[i] == '+') {
-            result += ' ';
-            i++;
-        } else {
-            result += str[i++];
-        }
-    }
-    
-    return result;
-}
-
-
 void WebDAVBox3::setup() {
   // [Votre code existant]
   
+  // Volume FAT de la carte : parcours en une passe, préallocation et place libre
+  if (sd_card_ != nullptr) {
+    DirectoryReader::set_fatfs_volume(sd_card_->get_mount_point(), sd_card_->get_fatfs_pdrv());
+  }
+  
   ESP_LOGI(TAG, "Diagnostic du système de fichiers");
   
   // 1. Vérifier si le répertoire racine est accessible  
@@ -152,6 +139,77 @@ void WebDAVBox3::setup() {
     ESP_LOGE(TAG, "Impossible de créer un fichier test (errno: %d)", errno);
   }
   
+  // Buffers de transfert préalloués avant le démarrage du serveur
+  if (!buffer_pool_.init()) {
+    ESP_LOGW(TAG, "Pool de transfert incomplet, les transferts simultanés seront limités");
+  }
+  
+  // Une arène par tâche qui exécute des gestionnaires : workers et tâche httpd
+  arenas_.init(workers_.get_worker_count(WORK_BULK) + workers_.get_worker_count(WORK_METADATA) + 1);
+  
+  // Un buffer Multi-Status par tâche qui exécute des gestionnaires : les
+  // listings ne dépendent pas des buffers pris par les gros transferts
+  multistatus_pool_.add_class(PROPFIND_BUFFER_SIZE, workers_.get_worker_count(WORK_BULK) +
+                                                        workers_.get_worker_count(WORK_METADATA) + 1);
+  if (!multistatus_pool_.init()) {
+    ESP_LOGW(TAG, "Buffers Multi-Status incomplets, repli sur le pool de transfert");
+  }
+  
+  // Workers démarrés avant le serveur : les handlers enregistrés y renvoient
+  if (!workers_.start()) {
+    ESP_LOGW(TAG, "Workers asynchrones incomplets, les classes sans worker sont traitées dans la tâche httpd");
+  }
+  
+  // Compression des ressources texte en tâche de fond
+  if (precompress_) {
+    precompressor_ = new AssetPrecompressor(root_path_, compressible_exts_);
+    precompressor_->set_on_change([this](const std::string &path) {
+      this->dir_cache_.invalidate_path(path);
+      this->record_change(JOURNAL_EXTERNAL, path);
+    });
+    precompressor_->start();
+  }
+  
+  // Écritures faites par d'autres composants via l'API SdMmc
+  if (sd_card_ != nullptr) {
+    sd_card_->add_on_write_callback([this](const std::string &path) {
+      this->invalidate_cached_path(path);
+      this->record_change(JOURNAL_EXTERNAL, path);
+    });
+  }
+  
+  // Temporaires des PUT : ceux laissés par une coupure sont supprimés
+  upload_dir_ = root_path_;
+  if (upload_dir_.back() != '/') upload_dir_ += '/';
+  upload_dir_ += std::string(STATE_DIR) + "/uploads";
+  if (create_directories_util(upload_dir_)) {
+    UploadFile::purge(upload_dir_);
+  } else {
+    ESP_LOGW(TAG, "Dossier des envois indisponible: %s", upload_dir_.c_str());
+  }
+  
+  // Corbeille des DELETE : vidée en tâche de fond, y compris ce qu'une coupure y a laissé
+  std::string trash_dir = root_path_;
+  if (trash_dir.back() != '/') trash_dir += '/';
+  trash_dir += std::string(STATE_DIR) + "/trash";
+  trash_.set_on_reclaimed([this, trash_dir]() { this->storage_.invalidate(trash_dir); });
+  if (!create_directories_util(trash_dir) || !trash_.start(trash_dir)) {
+    ESP_LOGW(TAG, "Corbeille indisponible, DELETE synchrones");
+  }
+  
+  // Place libre lue une fois (parcours de la FAT au besoin), ensuite tenue par FatFs
+  storage_.configure(root_path_, min_free_space_);
+  
+  // Journal des modifications pour les REPORT sync-collection
+  if (journal_size_ > 0) {
+    std::string state_dir = root_path_;
+    if (state_dir.back() != '/') state_dir += '/';
+    journal_.configure(state_dir + STATE_DIR, journal_size_);
+    if (!journal_.open()) {
+      ESP_LOGW(TAG, "Journal des modifications indisponible, sync-collection désactivé");
+    }
+  }
+  
   // Continuer avec le reste du setup...
   this->configure_http_server();
   this->start_server();
@@ -163,13 +221,118 @@ void WebDAVBox3::loop() {
   // Rien pour le moment
 }
 
+void WebDAVBox3::dump_config() {
+  ESP_LOGCONFIG(TAG, "WebDAVBox3:");
+  ESP_LOGCONFIG(TAG, "  Root path: %s", root_path_.c_str());
+  ESP_LOGCONFIG(TAG, "  Port: %u", port_);
+  ESP_LOGCONFIG(TAG, "  Read-ahead buffers: %zu", read_ahead_depth_);
+  ESP_LOGCONFIG(TAG, "  Write-behind buffers: %zu", write_behind_depth_);
+  if (file_cache_.get_budget() > 0) {
+    FileCacheStats stats = file_cache_.get_stats();
+    ESP_LOGCONFIG(TAG, "  File cache: %zu bytes (max %zu per file)", file_cache_.get_budget(),
+                  file_cache_.get_max_entry_size());
+    ESP_LOGCONFIG(TAG, "    Hits: %u, misses: %u, evictions: %u, entries: %zu (%zu bytes)", (unsigned) stats.hits,
+                  (unsigned) stats.misses, (unsigned) stats.evictions, stats.entries, stats.bytes_used);
+  } else {
+    ESP_LOGCONFIG(TAG, "  File cache: disabled");
+  }
+  if (dir_cache_.is_enabled()) {
+    DirCacheStats dc = dir_cache_.get_stats();
+    ESP_LOGCONFIG(TAG, "  Directory cache: %zu bytes", dir_cache_.get_budget());
+    ESP_LOGCONFIG(TAG, "    Hits: %u, misses: %u, invalidations: %u, listings: %zu (%zu bytes)", (unsigned) dc.hits,
+                  (unsigned) dc.misses, (unsigned) dc.invalidations, dc.listings, dc.bytes_used);
+  } else {
+    ESP_LOGCONFIG(TAG, "  Directory cache: disabled");
+  }
+  if (journal_.is_open()) {
+    JournalStats js = journal_.get_stats();
+    ESP_LOGCONFIG(TAG, "  Sync journal: %u records max, tokens %u..%u (epoch %08x, %u compactions)",
+                  (unsigned) journal_size_, (unsigned) js.min_seq, (unsigned) js.last_seq, (unsigned) js.epoch,
+                  (unsigned) js.compactions);
+  } else {
+    ESP_LOGCONFIG(TAG, "  Sync journal: disabled");
+  }
+  if (probes_.is_enabled()) {
+    ProbeStats ps = probes_.get_stats();
+    ESP_LOGCONFIG(TAG, "  Probe filter: %u absorbed, %u passed to card", (unsigned) ps.absorbed, (unsigned) ps.passed);
+    ESP_LOGCONFIG(TAG, "    Negative cache: %zu entries, %u hits, %u inserts", ps.negative_entries,
+                  (unsigned) ps.negative_hits, (unsigned) ps.negative_inserts);
+    ESP_LOGCONFIG(TAG, "    RAM store: %zu files (%zu bytes), %u reads, %u writes, %u evictions", ps.ram_files,
+                  ps.ram_bytes, (unsigned) ps.ram_reads, (unsigned) ps.ram_writes, (unsigned) ps.ram_evictions);
+  } else {
+    ESP_LOGCONFIG(TAG, "  Probe filter: disabled");
+  }
+  if (arenas_.is_enabled()) {
+    ArenaStats as = arenas_.get_stats();
+    ESP_LOGCONFIG(TAG, "  Request arenas: %u x %zu bytes (internal RAM)", (unsigned) as.count, as.arena_size);
+    ESP_LOGCONFIG(TAG, "    Requests: %u, usage avg %zu / peak %zu bytes, %u overflows (%u bytes), %u without arena",
+                  (unsigned) as.requests, as.average(), as.peak, (unsigned) as.overflows,
+                  (unsigned) as.overflow_bytes, (unsigned) as.exhausted);
+  } else {
+    ESP_LOGCONFIG(TAG, "  Request arenas: disabled");
+  }
+  AdmissionStats ads = storage_.get_stats();
+  ESP_LOGCONFIG(TAG, "  Authentication: %s", auth_enabled_ ? "YES" : "NO");
+  if (ads.free_bytes != UINT64_MAX) {
+    ESP_LOGCONFIG(TAG, "  Upload admission: %llu bytes free (%llu reserved, %llu kept free)",
+                  (unsigned long long) ads.free_bytes, (unsigned long long) ads.reserved_bytes,
+                  (unsigned long long) min_free_space_);
+  }
+  ESP_LOGCONFIG(TAG, "    Admitted: %u, refused: %u auth / %u space / %u quota (%llu bytes never received)",
+                (unsigned) ads.admitted, (unsigned) ads.rejected_auth, (unsigned) ads.rejected_space,
+                (unsigned) ads.rejected_quota, (unsigned long long) ads.bytes_refused);
+  for (const auto &q : storage_.get_quotas()) {
+    if (q.counted) {
+      ESP_LOGCONFIG(TAG, "    Quota %s: %llu / %llu bytes", q.path.c_str(), (unsigned long long) q.used,
+                    (unsigned long long) q.limit);
+    } else {
+      ESP_LOGCONFIG(TAG, "    Quota %s: %llu bytes (not counted yet)", q.path.c_str(), (unsigned long long) q.limit);
+    }
+  }
+  if (trash_.is_enabled()) {
+    TrashStats ts = trash_.get_stats();
+    ESP_LOGCONFIG(TAG, "  Trash: %u deletes deferred, %u recovered at boot, %u failures", (unsigned) ts.discarded,
+                  (unsigned) ts.recovered, (unsigned) ts.failures);
+    ESP_LOGCONFIG(TAG, "    Reclaimed: %u files, %u dirs, %llu bytes", (unsigned) ts.reclaimed_files,
+                  (unsigned) ts.reclaimed_dirs, (unsigned long long) ts.reclaimed_bytes);
+  } else {
+    ESP_LOGCONFIG(TAG, "  Trash: disabled");
+  }
+  ESP_LOGCONFIG(TAG, "  Pre-compression: %s", precompress_ ? "YES" : "NO");
+  if (bandwidth_.is_enabled()) {
+    ESP_LOGCONFIG(TAG, "  Bandwidth: global %u B/s, per client %u B/s", (unsigned) bandwidth_.get_global_rate(),
+                  (unsigned) bandwidth_.get_client_rate());
+    for (const auto &c : bandwidth_.get_client_stats()) {
+      ESP_LOGCONFIG(TAG, "    %s [%s]: %u active, %u/%u B/s, %llu bytes sent", c.client.c_str(), c.priority_class,
+                    c.active_transfers, (unsigned) c.achieved_rate, (unsigned) c.allowed_rate,
+                    (unsigned long long) c.bytes_sent);
+    }
+  }
+  WorkerPoolStats ws = workers_.get_stats();
+  ESP_LOGCONFIG(TAG, "  Workers: %u bulk, %u metadata", workers_.get_worker_count(WORK_BULK),
+                workers_.get_worker_count(WORK_METADATA));
+  ESP_LOGCONFIG(TAG, "    Dispatched: %u bulk, %u metadata (rejected %u/%u)", (unsigned) ws.dispatched[WORK_BULK],
+                (unsigned) ws.dispatched[WORK_METADATA], (unsigned) ws.rejected[WORK_BULK],
+                (unsigned) ws.rejected[WORK_METADATA]);
+  for (const auto &c : multistatus_pool_.get_stats()) {
+    ESP_LOGCONFIG(TAG, "  Multi-Status buffers: %zu bytes x%u, high-water %u, %u borrows", c.size, c.count,
+                  c.high_water, (unsigned) c.borrows);
+  }
+  ESP_LOGCONFIG(TAG, "  Transfer buffers (timeout %u ms):", (unsigned) buffer_timeout_ms_);
+  for (const auto &c : buffer_pool_.get_stats()) {
+    ESP_LOGCONFIG(TAG, "    %zu bytes x%u: high-water %u, %u borrows, %u waits (%.1f ms max), %u timeouts", c.size,
+                  c.count, c.high_water, (unsigned) c.borrows, (unsigned) c.waits, c.max_wait_us / 1000.0f,
+                  (unsigned) c.timeouts);
+  }
+}
+
 void WebDAVBox3::configure_http_server() {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     
     // Configuration de base
     config.server_port = port_;
     config.ctrl_port = port_ + 1000;
-    config.max_uri_handlers = 16;
+    config.max_uri_handlers = 20;
     
     // Paramètres de performance
     config.stack_size = 8192;
@@ -208,7 +371,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t root_uri = {
     .uri = "/",
     .method = HTTP_GET,
-    .handler = handle_root,
+    .handler = dispatch<handle_root, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &root_uri);
@@ -217,7 +380,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t options_uri = {
     .uri = "/*",
     .method = HTTP_OPTIONS,
-    .handler = handle_webdav_options,
+    .handler = dispatch<handle_webdav_options, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &options_uri);
@@ -226,7 +389,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t propfind_uri = {
     .uri = "/",
     .method = HTTP_PROPFIND,
-    .handler = handle_webdav_propfind,
+    .handler = dispatch<handle_webdav_propfind, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &propfind_uri);
@@ -234,7 +397,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t propfind_wildcard_uri = {
     .uri = "/*",
     .method = HTTP_PROPFIND,
-    .handler = handle_webdav_propfind,
+    .handler = dispatch<handle_webdav_propfind, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &propfind_wildcard_uri);
@@ -243,7 +406,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t proppatch_uri = {
     .uri = "/*",
     .method = HTTP_PROPPATCH,
-    .handler = handle_webdav_proppatch,
+    .handler = dispatch<handle_webdav_proppatch, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &proppatch_uri);
@@ -253,7 +416,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t get_uri = {
     .uri = "/*",
     .method = HTTP_GET,
-    .handler = handle_webdav_get,
+    .handler = dispatch<handle_webdav_get, WORK_BULK>,
     .user_ctx = this,
     //.is_websocket = false,
     //.handle_ws_control_frames = false,
@@ -265,7 +428,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t head_uri = {
     .uri = "/*",
     .method = HTTP_HEAD,
-    .handler = handle_webdav_get, // Utilisation de GET pour HEAD en attendant une implémentation spécifique
+    .handler = dispatch<handle_webdav_head, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &head_uri);
@@ -273,7 +436,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t put_uri = {
     .uri = "/*",
     .method = HTTP_PUT,
-    .handler = handle_webdav_put,
+    .handler = dispatch<handle_webdav_put, WORK_BULK>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &put_uri);
@@ -281,7 +444,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t delete_uri = {
     .uri = "/*",
     .method = HTTP_DELETE,
-    .handler = handle_webdav_delete,
+    .handler = dispatch<handle_webdav_delete, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &delete_uri);
@@ -289,7 +452,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t mkcol_uri = {
     .uri = "/*",
     .method = HTTP_MKCOL,
-    .handler = handle_webdav_mkcol,
+    .handler = dispatch<handle_webdav_mkcol, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &mkcol_uri);
@@ -297,7 +460,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t move_uri = {
     .uri = "/*",
     .method = HTTP_MOVE,
-    .handler = handle_webdav_move,
+    .handler = dispatch<handle_webdav_move, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &move_uri);
@@ -305,7 +468,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t copy_uri = {
     .uri = "/*",
     .method = HTTP_COPY,
-    .handler = handle_webdav_copy,
+    .handler = dispatch<handle_webdav_copy, WORK_BULK>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &copy_uri);
@@ -314,7 +477,7 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t lock_uri = {
     .uri = "/*",
     .method = HTTP_LOCK,
-    .handler = handle_webdav_lock,
+    .handler = dispatch<handle_webdav_lock, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &lock_uri);
@@ -322,11 +485,29 @@ void WebDAVBox3::configure_http_server() {
   httpd_uri_t unlock_uri = {
     .uri = "/*",
     .method = HTTP_UNLOCK,
-    .handler = handle_webdav_unlock,
+    .handler = dispatch<handle_webdav_unlock, WORK_METADATA>,
     .user_ctx = this
   };
   httpd_register_uri_handler(server_, &unlock_uri);
   
+  // Écritures partielles (X-Update-Range)
+  httpd_uri_t patch_uri = {
+    .uri = "/*",
+    .method = HTTP_PATCH,
+    .handler = dispatch<handle_webdav_patch, WORK_BULK>,
+    .user_ctx = this
+  };
+  httpd_register_uri_handler(server_, &patch_uri);
+  
+  // REPORT sync-collection (RFC 6578)
+  httpd_uri_t report_uri = {
+    .uri = "/*",
+    .method = HTTP_REPORT,
+    .handler = dispatch<handle_webdav_report, WORK_METADATA>,
+    .user_ctx = this
+  };
+  httpd_register_uri_handler(server_, &report_uri);
+  
   ESP_LOGI(TAG, "Tous les gestionnaires WebDAV ont été enregistrés");
 }
 void WebDAVBox3::start_server() {
@@ -397,50 +578,11 @@ esp_err_t WebDAVBox3::handle_webdav_proppatch(httpd_req_t *req) {
   return ESP_OK;
 }
 
-std::string WebDAVBox3::get_file_path(httpd_req_t *req, const std::string &root_path) {
-  std::string uri = req->uri;
-  std::string path = root_path;
-  
-  // Log avant décodage
-  ESP_LOGI(TAG, "URI brute: %s", uri.c_str());
-  
-  // Décoder l'URL
-  uri = url_decode(uri);
-  ESP_LOGI(TAG, "URI décodée: %s", uri.c_str());
-  
-  // Vérifier si le chemin racine se termine par un '/'
-  if (path.back() != '/') {
-    path += '/';
-  }
-  
-  // Supprimer le premier '/' de l'URI s'il existe
-  if (!uri.empty() && uri.front() == '/') {
-    uri = uri.substr(1);
-  }
-  
-  // Si c'est la racine, retourner le chemin racine sans ajouter de '/'
-  if (uri.empty()) {
-    ESP_LOGI(TAG, "Accès à la racine: %s", path.c_str());
-    return path.substr(0, path.length() - 1); // Enlever le dernier '/'
-  }
-  
-  // Normaliser les barres obliques en évitant les doubles barres
-  path += uri;
-  
-  ESP_LOGI(TAG, "Mapped URI %s to path %s", req->uri, path.c_str());
-  
-  // Vérifier si le chemin existe
-  struct stat st;
-  if (stat(path.c_str(), &st) == 0) {
-    ESP_LOGI(TAG, "Chemin existe: %s", path.c_str());
-  } else {
-    ESP_LOGI(TAG, "⚠️ Chemin n'existe PAS: %s (errno: %d)", path.c_str(), errno);
-  }
-  
-  return path;
+// URI refusée à la résolution (remontée hors de la racine, octet nul)
+static esp_err_t send_invalid_path(httpd_req_t *req) {
+  return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid path");
 }
 
-
 bool WebDAVBox3::is_dir(const std::string &path) {
   struct stat st;
   if (stat(path.c_str(), &st) == 0)
@@ -450,88 +592,449 @@ bool WebDAVBox3::is_dir(const std::string &path) {
 
 std::vector<std::string> WebDAVBox3::list_dir(const std::string &path) {
   std::vector<std::string> files;
-  DIR *dir = opendir(path.c_str());
-  if (dir != nullptr) {
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != nullptr) {
-      if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
-        files.push_back(entry->d_name);
-      }
-    }
-    closedir(dir);
-  } else {
+  DirectoryReader reader;
+  if (!reader.open(path)) {
     ESP_LOGE(TAG, "Impossible d'ouvrir le répertoire: %s (errno: %d)", path.c_str(), errno);
+    return files;
+  }
+  DirEntry entry;
+  while (reader.next(entry)) {
+    files.push_back(entry.name);
   }
   return files;
 }
 
-// Fonction utilitaire pour générer la réponse XML pour un fichier ou répertoire
-std::string WebDAVBox3::generate_prop_xml(const std::string &href, bool is_directory, time_t modified, size_t size) {
-  // Format RFC1123 préféré par de nombreux clients WebDAV
-  char time_buf[50];
-  struct tm *gmt = gmtime(&modified);
-  strftime(time_buf, sizeof(time_buf), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-  
-  // Extraire juste le nom pour displayname
-  std::string display_name = href;
-  if (href.back() == '/') {
-    display_name = href.substr(0, href.length() - 1);  // Enlever le '/' final
-  }
-  size_t last_slash = display_name.find_last_of('/');
-  if (last_slash != std::string::npos) {
-    display_name = display_name.substr(last_slash + 1);
-  }
-  if (display_name.empty() && href == "/") {
-    display_name = "Root";  // Nom spécial pour la racine
-  }
-  
-  std::string xml = "  <D:response>\n";
-  xml += "    <D:href>" + href + "</D:href>\n";
-  xml += "    <D:propstat>\n";
-  xml += "      <D:prop>\n";
-  xml += "        <D:resourcetype>";
-  if (is_directory) {
-    xml += "<D:collection/>";
-  }
-  xml += "</D:resourcetype>\n";
-  xml += "        <D:getlastmodified>" + std::string(time_buf) + "</D:getlastmodified>\n";
-  xml += "        <D:creationdate>" + std::string(time_buf) + "</D:creationdate>\n";
-  xml += "        <D:displayname>" + display_name + "</D:displayname>\n";
-  
-  if (!is_directory) {
-    xml += "        <D:getcontentlength>" + std::to_string(size) + "</D:getcontentlength>\n";
-    
-    // Identifier le type MIME en fonction de l'extension
-    std::string content_type = "application/octet-stream";
-    size_t dot_pos = href.find_last_of(".");
-    if (dot_pos != std::string::npos) {
-      std::string ext = href.substr(dot_pos + 1);
-      // Convertir en minuscules
-      std::transform(ext.begin(), ext.end(), ext.begin(), 
-                    [](unsigned char c){ return std::tolower(c); });
-      
-      if (ext == "txt") content_type = "text/plain";
-      else if (ext == "html" || ext == "htm") content_type = "text/html";
-      else if (ext == "css") content_type = "text/css";
-      else if (ext == "js") content_type = "application/javascript";
-      else if (ext == "jpg" || ext == "jpeg") content_type = "image/jpeg";
-      else if (ext == "png") content_type = "image/png";
-      else if (ext == "gif") content_type = "image/gif";
-      else if (ext == "mp3") content_type = "audio/mpeg";
-      else if (ext == "mp4") content_type = "video/mp4";
-      else if (ext == "pdf") content_type = "application/pdf";
-      else if (ext == "flac") content_type = "audio/flac";  
+// ========== EN-TÊTES / VALIDATEURS ==========
+
+// Format IMF-fixdate utilisé par Last-Modified / If-Range
+static void format_http_date(time_t t, char *buf, size_t len) {
+  struct tm gmt;
+  gmtime_r(&t, &gmt);
+  strftime(buf, len, "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+}
+
+// ETag faible dérivé de la taille et de la date de modification
+static void make_etag(const struct stat &st, char *buf, size_t len) {
+  snprintf(buf, len, "W/\"%lx-%lx\"", (unsigned long) st.st_size, (unsigned long) st.st_mtime);
+}
+
+const char *WebDAVBox3::content_type_for(const char *path) {
+  const char *ext = strrchr(path, '.');
+  if (!ext) return "application/octet-stream";
+  ext++; // Avancer après le point
+  if (strcasecmp(ext, "mp3") == 0) return "audio/mpeg";
+  if (strcasecmp(ext, "mp4") == 0) return "video/mp4";
+  if (strcasecmp(ext, "jpg") == 0 || strcasecmp(ext, "jpeg") == 0) return "image/jpeg";
+  if (strcasecmp(ext, "png") == 0) return "image/png";
+  if (strcasecmp(ext, "flac") == 0) return "audio/flac";
+  if (strcasecmp(ext, "gif") == 0) return "image/gif";
+  if (strcasecmp(ext, "pdf") == 0) return "application/pdf";
+  if (strcasecmp(ext, "txt") == 0) return "text/plain";
+  if (strcasecmp(ext, "html") == 0 || strcasecmp(ext, "htm") == 0) return "text/html";
+  if (strcasecmp(ext, "css") == 0) return "text/css";
+  if (strcasecmp(ext, "js") == 0) return "application/javascript";
+  return "application/octet-stream";
+}
+
+// Écriture brute sur la socket de la requête (gère les envois partiels)
+static esp_err_t send_raw(httpd_req_t *req, const char *data, size_t len) {
+  int sockfd = httpd_req_to_sockfd(req);
+  if (sockfd < 0) return ESP_FAIL;
+  while (len > 0) {
+    ssize_t sent = send(sockfd, data, len, 0);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      ESP_LOGE(TAG, "Erreur d'envoi sur la socket (errno: %d)", errno);
+      return ESP_FAIL;
     }
-    
-    xml += "        <D:getcontenttype>" + content_type + "</D:getcontenttype>\n";
+    data += sent;
+    len -= sent;
   }
-  
-  xml += "      </D:prop>\n";
-  xml += "      <D:status>HTTP/1.1 200 OK</D:status>\n";
-  xml += "    </D:propstat>\n";
-  xml += "  </D:response>\n";
-  
-  return xml;
+  return ESP_OK;
+}
+
+// En-têtes d'une réponse à longueur fixe écrite directement sur la socket :
+// httpd_resp_set_hdr() n'est pas pris en compte sur ce chemin
+class RawResponse {
+ public:
+  explicit RawResponse(const char *status) {
+    this->head_.reserve(512);
+    this->head_ = "HTTP/1.1 ";
+    this->head_ += status;
+    this->head_ += "\r\n";
+  }
+  void add(const char *name, const char *value) {
+    this->head_ += name;
+    this->head_ += ": ";
+    this->head_ += value;
+    this->head_ += "\r\n";
+  }
+  void add(const char *name, size_t value) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%zu", value);
+    this->add(name, buf);
+  }
+  esp_err_t send(httpd_req_t *req) {
+    this->head_ += "\r\n";
+    return send_raw(req, this->head_.data(), this->head_.size());
+  }
+
+ protected:
+  std::string head_;
+};
+
+size_t WebDAVBox3::format_head_headers(const struct stat &st, const char *content_type, char *buf, size_t len,
+                                       const char *content_encoding, const char *extra_headers) {
+  char date_buf[50];
+  char etag_buf[32];
+  char encoding_hdr[64] = {0};
+  format_http_date(st.st_mtime, date_buf, sizeof(date_buf));
+  make_etag(st, etag_buf, sizeof(etag_buf));
+  if (content_encoding != nullptr) {
+    snprintf(encoding_hdr, sizeof(encoding_hdr), "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n", content_encoding);
+  }
+
+  int n = snprintf(buf, len,
+                   "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: %s\r\n"
+                   "Content-Length: %zu\r\n"
+                   "%s"
+                   "Last-Modified: %s\r\n"
+                   "ETag: %s\r\n"
+                   "Accept-Ranges: bytes\r\n"
+                   "%s"
+                   "Access-Control-Allow-Origin: *\r\n"
+                   "\r\n",
+                   content_type, S_ISDIR(st.st_mode) ? (size_t) 0 : (size_t) st.st_size, encoding_hdr, date_buf,
+                   etag_buf, extra_headers != nullptr ? extra_headers : "");
+  return (n < 0 || (size_t) n >= len) ? 0 : (size_t) n;
+}
+
+// Adresse IP du client, clé du partage de débit
+static std::string client_address(httpd_req_t *req) {
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  char buf[INET6_ADDRSTRLEN] = "?";
+  if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *) &addr, &addr_len) != 0)
+    return buf;
+
+  if (addr.ss_family == AF_INET6) {
+    const uint8_t *a = ((struct sockaddr_in6 *) &addr)->sin6_addr.s6_addr;
+    static const uint8_t V4_MAPPED[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    if (memcmp(a, V4_MAPPED, sizeof(V4_MAPPED)) == 0) {
+      // httpd écoute en IPv6 : les clients IPv4 arrivent en ::ffff:a.b.c.d
+      snprintf(buf, sizeof(buf), "%u.%u.%u.%u", a[12], a[13], a[14], a[15]);
+    } else {
+      inet_ntop(AF_INET6, a, buf, sizeof(buf));
+    }
+  } else {
+    inet_ntop(AF_INET, &((struct sockaddr_in *) &addr)->sin_addr, buf, sizeof(buf));
+  }
+  return buf;
+}
+
+// ========== NÉGOCIATION DU CONTENT-ENCODING ==========
+
+// Vrai si le codage figure dans Accept-Encoding avec un q non nul
+static bool accepts_encoding(const char *header, const char *coding) {
+  size_t coding_len = strlen(coding);
+  const char *p = header;
+  while (*p) {
+    while (*p == ' ' || *p == '\t' || *p == ',') p++;
+    const char *token = p;
+    while (*p && *p != ',' && *p != ';' && *p != ' ') p++;
+    size_t token_len = p - token;
+    bool named = (token_len == coding_len && strncasecmp(token, coding, coding_len) == 0) ||
+                 (token_len == 1 && *token == '*');
+
+    float q = 1.0f;
+    while (*p && *p != ',') {
+      if (*p == ';') {
+        const char *param = p + 1;
+        while (*param == ' ') param++;
+        if ((param[0] == 'q' || param[0] == 'Q') && param[1] == '=') q = strtof(param + 2, nullptr);
+      }
+      p++;
+    }
+    if (named) return q > 0.0f;
+  }
+  return false;
+}
+
+bool WebDAVBox3::is_compressible(const std::string &path) const {
+  const char *ext = strrchr(path.c_str(), '.');
+  if (ext == nullptr) return false;
+  ext++;
+  for (const auto &e : compressible_exts_) {
+    if (strcasecmp(ext, e.c_str()) == 0) return true;
+  }
+  return false;
+}
+
+const char *WebDAVBox3::select_encoded_variant(httpd_req_t *req, std::string &path, struct stat &st) {
+  char accept[128] = {0};
+  if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept)) != ESP_OK &&
+      httpd_req_get_hdr_value_len(req, "Accept-Encoding") == 0) {
+    return nullptr;
+  }
+
+  // Brotli d'abord (meilleur taux), puis gzip
+  static const struct {
+    const char *coding;
+    const char *suffix;
+  } VARIANTS[] = {{"br", ".br"}, {"gzip", ".gz"}};
+
+  for (const auto &v : VARIANTS) {
+    if (!accepts_encoding(accept, v.coding)) continue;
+    std::string variant = path + v.suffix;
+    struct stat variant_st;
+    // La variante doit être au moins aussi récente que l'original
+    if (stat(variant.c_str(), &variant_st) == 0 && S_ISREG(variant_st.st_mode) &&
+        variant_st.st_mtime >= st.st_mtime) {
+      ESP_LOGD(TAG, "Variante %s servie pour %s", v.coding, path.c_str());
+      path = std::move(variant);
+      st = variant_st;
+      return v.coding;
+    }
+  }
+  return nullptr;
+}
+
+// ========== REQUÊTES CONDITIONNELLES (RFC 7232) ==========
+
+// Lecture d'une date IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT") ; les
+// formats obsolètes sont refusés et l'en-tête correspondant est alors ignoré
+static bool parse_http_date(const char *value, time_t *out) {
+  static const char *const MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char month[4] = {0};
+  int day, year, hour, minute, second;
+  if (sscanf(value, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &day, month, &year, &hour, &minute, &second) != 6) {
+    return false;
+  }
+  const char *m = strstr(MONTHS, month);
+  if (m == nullptr || strlen(month) != 3 || (m - MONTHS) % 3 != 0) {
+    return false;
+  }
+  int mon = (m - MONTHS) / 3 + 1;
+
+  // Jours depuis l'epoch (algorithme "days from civil"), évite timegm()
+  int y = year - (mon <= 2);
+  int era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned) (y - era * 400);
+  unsigned doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  long days = (long) era * 146097 + (long) doe - 719468;
+
+  *out = (time_t) (days * 86400L + hour * 3600L + minute * 60L + second);
+  return true;
+}
+
+// Cherche etag dans une liste "a", W/"b", ... ; la comparaison porte sur la
+// valeur opaque (les ETags émis sont faibles, W/ est donc ignoré des deux côtés)
+static bool etag_list_matches(const char *list, const char *etag) {
+  if (strncmp(etag, "W/", 2) == 0) etag += 2;
+  size_t etag_len = strlen(etag);
+
+  const char *p = list;
+  while (*p) {
+    while (*p == ' ' || *p == '\t' || *p == ',') p++;
+    if (!*p) break;
+    if (strncmp(p, "W/", 2) == 0) p += 2;
+    const char *end = p;
+    if (*p == '"') {
+      end = strchr(p + 1, '"');
+      end = end ? end + 1 : p + strlen(p);
+    } else {
+      while (*end && *end != ',') end++;
+    }
+    if ((size_t) (end - p) == etag_len && strncmp(p, etag, etag_len) == 0) {
+      return true;
+    }
+    p = end;
+  }
+  return false;
+}
+
+static bool get_header(httpd_req_t *req, const char *name, std::string &value) {
+  size_t len = httpd_req_get_hdr_value_len(req, name);
+  if (len == 0) return false;
+  value.assign(len + 1, '\0');
+  if (httpd_req_get_hdr_value_str(req, name, &value[0], value.size()) != ESP_OK) return false;
+  value.resize(len);
+  return true;
+}
+
+ConditionalResult WebDAVBox3::evaluate_preconditions(httpd_req_t *req, const struct stat *st) {
+  const bool safe_method = req->method == HTTP_GET || req->method == HTTP_HEAD;
+  char etag[32] = {0};
+  if (st != nullptr) make_etag(*st, etag, sizeof(etag));
+
+  std::string value;
+  time_t date;
+
+  // 1. If-Match, sinon 2. If-Unmodified-Since
+  if (get_header(req, "If-Match", value)) {
+    bool match = st != nullptr && (value == "*" || etag_list_matches(value.c_str(), etag));
+    if (!match) return COND_PRECONDITION_FAILED;
+  } else if (st != nullptr && get_header(req, "If-Unmodified-Since", value) && parse_http_date(value.c_str(), &date)) {
+    if (st->st_mtime > date) return COND_PRECONDITION_FAILED;
+  }
+
+  // 3. If-None-Match, sinon 4. If-Modified-Since (GET/HEAD uniquement)
+  if (get_header(req, "If-None-Match", value)) {
+    bool match = st != nullptr && (value == "*" || etag_list_matches(value.c_str(), etag));
+    if (match) return safe_method ? COND_NOT_MODIFIED : COND_PRECONDITION_FAILED;
+  } else if (safe_method && st != nullptr && get_header(req, "If-Modified-Since", value) &&
+             parse_http_date(value.c_str(), &date)) {
+    if (st->st_mtime <= date) return COND_NOT_MODIFIED;
+  }
+
+  return COND_OK;
+}
+
+esp_err_t WebDAVBox3::send_conditional_response(httpd_req_t *req, ConditionalResult result, const struct stat *st) {
+  if (result == COND_NOT_MODIFIED) {
+    // 304 : validateurs uniquement, ni corps ni Content-Length
+    char date_buf[50];
+    char etag_buf[32];
+    format_http_date(st->st_mtime, date_buf, sizeof(date_buf));
+    make_etag(*st, etag_buf, sizeof(etag_buf));
+    RawResponse resp("304 Not Modified");
+    resp.add("ETag", etag_buf);
+    resp.add("Last-Modified", date_buf);
+    resp.add("Cache-Control", "max-age=3600");
+    resp.add("Access-Control-Allow-Origin", "*");
+    return resp.send(req);
+  }
+
+  httpd_resp_set_status(req, "412 Precondition Failed");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, NULL, 0);
+}
+
+// ========== RANGE (RFC 7233) ==========
+
+// Au-delà, l'en-tête Range est ignoré et le fichier est envoyé en entier
+static const size_t MAX_BYTE_RANGES = 16;
+// Buffers d'écriture différée des PUT : multiple de la taille de cluster
+static const size_t UPLOAD_CHUNK_SIZE = 65536;
+static const char *const MULTIPART_BOUNDARY = "WEBDAVBOX3_BYTERANGES";
+static const char *const MULTIPART_PART_FMT = "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %zu-%zu/%zu\r\n\r\n";
+static const char *const MULTIPART_END_FMT = "\r\n--%s--\r\n";
+
+RangeParseResult WebDAVBox3::parse_range_header(const char *value, size_t file_size, std::vector<ByteRange> &ranges) {
+  ranges.clear();
+  while (*value == ' ' || *value == '\t') value++;
+  if (strncasecmp(value, "bytes=", 6) != 0) {
+    return RANGE_NONE;  // Unité inconnue : on ignore l'en-tête
+  }
+
+  const char *p = value + 6;
+  bool any_spec = false;
+
+  while (*p) {
+    while (*p == ' ' || *p == '\t' || *p == ',') p++;
+    if (!*p) break;
+
+    // first-byte-pos "-" [last-byte-pos]  ou  "-" suffix-length
+    uint64_t first = 0, last = 0;
+    bool has_first = false, has_last = false;
+    while (*p >= '0' && *p <= '9') {
+      if (first < (1ULL << 48)) first = first * 10 + (*p - '0');
+      has_first = true;
+      p++;
+    }
+    if (*p != '-') return RANGE_NONE;
+    p++;
+    while (*p >= '0' && *p <= '9') {
+      if (last < (1ULL << 48)) last = last * 10 + (*p - '0');
+      has_last = true;
+      p++;
+    }
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p && *p != ',') return RANGE_NONE;
+    if (!has_first && !has_last) return RANGE_NONE;
+    if (has_first && has_last && last < first) return RANGE_NONE;
+    any_spec = true;
+
+    ByteRange r;
+    if (!has_first) {
+      // Suffixe : les N derniers octets
+      if (last == 0 || file_size == 0) continue;
+      r.start = last >= file_size ? 0 : file_size - (size_t) last;
+      r.end = file_size - 1;
+    } else {
+      if (first >= file_size) continue;  // Plage non satisfaisable, on la saute
+      r.start = (size_t) first;
+      r.end = (!has_last || last >= file_size) ? file_size - 1 : (size_t) last;
+    }
+
+    if (ranges.size() >= MAX_BYTE_RANGES) {
+      ESP_LOGW(TAG, "Trop de plages demandées, envoi du fichier complet");
+      ranges.clear();
+      return RANGE_NONE;
+    }
+    ranges.push_back(r);
+  }
+
+  if (!any_spec) return RANGE_NONE;
+  return ranges.empty() ? RANGE_UNSATISFIABLE : RANGE_OK;
+}
+
+bool WebDAVBox3::if_range_matches(httpd_req_t *req, const struct stat &st) {
+  char value[64] = {0};
+  if (httpd_req_get_hdr_value_str(req, "If-Range", value, sizeof(value)) != ESP_OK) {
+    return true;  // Pas de condition
+  }
+
+  // Validateur de type entity-tag : les ETags émis sont faibles, la comparaison
+  // forte exigée par If-Range échoue donc et le client reçoit la représentation complète
+  if (value[0] == '"' || strncmp(value, "W/", 2) == 0) {
+    return false;
+  }
+
+  // Validateur de type date : correspondance exacte avec Last-Modified
+  char date_buf[50];
+  format_http_date(st.st_mtime, date_buf, sizeof(date_buf));
+  return strcmp(value, date_buf) == 0;
+}
+
+esp_err_t WebDAVBox3::send_file_window(httpd_req_t *req, FILE *file, size_t offset, size_t length,
+                                       char *buffer, size_t chunk_size, size_t &total_sent, BandwidthFlow *flow) {
+  // Positionnement direct sur la fenêtre demandée : un seek ne coûte que les octets lus
+  if (fseek(file, offset, SEEK_SET) != 0) {
+    ESP_LOGE(TAG, "Échec du positionnement à l'offset %zu (errno: %d)", offset, errno);
+    return ESP_FAIL;
+  }
+
+  size_t remaining = length;
+  size_t since_yield = 0;
+  while (remaining > 0) {
+    size_t to_read = remaining < chunk_size ? remaining : chunk_size;
+    size_t read_bytes = fread(buffer, 1, to_read, file);
+    if (read_bytes == 0) {
+      ESP_LOGE(TAG, "Lecture interrompue à %zu/%zu octets", length - remaining, length);
+      return ESP_FAIL;
+    }
+
+    if (flow) flow->consume(read_bytes);
+    esp_err_t err = send_raw(req, buffer, read_bytes);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Erreur d'envoi du chunk (%zu bytes): %d", read_bytes, err);
+      return err;
+    }
+
+    remaining -= read_bytes;
+    total_sent += read_bytes;
+    since_yield += read_bytes;
+
+    // Pause minimale tous les 10MB pour les longues fenêtres
+    if (since_yield >= 10 * 1024 * 1024) {
+      taskYIELD();
+      since_yield = 0;
+    }
+  }
+  return ESP_OK;
 }
 
 
@@ -563,13 +1066,13 @@ void WebDAVBox3::register_handlers() {
         esp_err_t (*handler)(httpd_req_t *req);
         const char *description;
     } handlers[] = {
-        {"/*", HTTP_GET, handle_webdav_get, "GET"},
-        {"/*", HTTP_HEAD, handle_webdav_get, "HEAD"},
-        {"/*", HTTP_PUT, handle_webdav_put, "PUT"},
-        {"/*", HTTP_DELETE, handle_webdav_delete, "DELETE"},
-        {"/*", HTTP_MKCOL, handle_webdav_mkcol, "MKCOL"},
-        {"/*", HTTP_PROPFIND, handle_webdav_propfind, "PROPFIND"},
-        {"/*", HTTP_OPTIONS, handle_webdav_options, "OPTIONS"},
+        {"/*", HTTP_GET, dispatch<handle_webdav_get, WORK_BULK>, "GET"},
+        {"/*", HTTP_HEAD, dispatch<handle_webdav_head, WORK_METADATA>, "HEAD"},
+        {"/*", HTTP_PUT, dispatch<handle_webdav_put, WORK_BULK>, "PUT"},
+        {"/*", HTTP_DELETE, dispatch<handle_webdav_delete, WORK_METADATA>, "DELETE"},
+        {"/*", HTTP_MKCOL, dispatch<handle_webdav_mkcol, WORK_METADATA>, "MKCOL"},
+        {"/*", HTTP_PROPFIND, dispatch<handle_webdav_propfind, WORK_METADATA>, "PROPFIND"},
+        {"/*", HTTP_OPTIONS, dispatch<handle_webdav_options, WORK_METADATA>, "OPTIONS"},
         // Ajoutez d'autres handlers au besoin
     };
     
@@ -598,15 +1101,15 @@ esp_err_t WebDAVBox3::handle_webdav_options(httpd_req_t *req) {
     // CRUCIAL: Complete CORS headers for all requests
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Methods", 
-                     "GET, HEAD, PUT, DELETE, PROPFIND, PROPPATCH, MKCOL, COPY, MOVE, OPTIONS");
+                     "GET, HEAD, PUT, PATCH, DELETE, PROPFIND, PROPPATCH, MKCOL, COPY, MOVE, REPORT, OPTIONS");
     httpd_resp_set_hdr(req, "Access-Control-Allow-Headers", 
-                     "Authorization, Content-Type, Depth, Destination, Overwrite");
+                     "Authorization, Content-Type, Content-Range, Depth, Destination, Overwrite, X-Update-Range");
     httpd_resp_set_hdr(req, "Access-Control-Max-Age", "3600");
     
     // Standard WebDAV headers
-    httpd_resp_set_hdr(req, "DAV", "1, 2");
+    httpd_resp_set_hdr(req, "DAV", "1, 2, sabredav-partialupdate");
     httpd_resp_set_hdr(req, "Allow", 
-                     "GET, HEAD, PUT, DELETE, PROPFIND, PROPPATCH, MKCOL, COPY, MOVE, OPTIONS");
+                     "GET, HEAD, PUT, PATCH, DELETE, PROPFIND, PROPPATCH, MKCOL, COPY, MOVE, REPORT, OPTIONS");
     httpd_resp_set_hdr(req, "MS-Author-Via", "DAV");
     
     // Set the content type
@@ -618,34 +1121,203 @@ esp_err_t WebDAVBox3::handle_webdav_options(httpd_req_t *req) {
 
 
 
+static const size_t PROPFIND_MAX_BODY = 16384;
+
+// Sync-token (RFC 6578) : époque du journal et numéro de la dernière modification vue
+static const char SYNC_TOKEN_FORMAT[] = "urn:x-webdavbox3:sync:%08x:%u";
+static const size_t SYNC_MAX_CHANGES = 1000;
+
+// Erreur portant une précondition DAV: (RFC 4918 §16)
+static esp_err_t send_dav_error(httpd_req_t *req, const char *status, const char *condition) {
+  char body[192];
+  int n = snprintf(body, sizeof(body),
+                   "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                   "<D:error xmlns:D=\"DAV:\"><D:%s/></D:error>",
+                   condition);
+  httpd_resp_set_status(req, status);
+  httpd_resp_set_type(req, "application/xml; charset=utf-8");
+  return httpd_resp_send(req, body, n);
+}
+
+enum WalkResult { WALK_COMPLETE, WALK_CLIENT_GONE, WALK_LIMIT_EXCEEDED };
+
+// Parcours en profondeur de toute l'arborescence sous path (Depth: infinity).
+// Pile explicite de lecteurs ouverts, un par niveau : la mémoire dépend de
+// max_depth, pas de la taille de l'arbre, et la pile de la tâche n'est pas
+// sollicitée. Chemin et href sont tronqués en remontant au lieu d'être copiés.
+// Avec descend_last à false, les répertoires du dernier niveau sont listés
+// sans être ouverts (sync-level 1) au lieu de compter comme un dépassement.
+// from_root : path est la racine WebDAV, son répertoire interne est sauté.
+static WalkResult walk_depth_infinity(MultistatusWriter &writer, Arena *arena, const char *path, const char *uri_path,
+                                      bool from_root, uint8_t max_depth, uint32_t max_entries,
+                                      bool descend_last = true) {
+  struct Frame {
+    std::unique_ptr<DirectoryReader> reader;
+    size_t path_len;
+    size_t href_len;
+  };
+  // Un niveau de plus que max_depth : sert seulement à vérifier qu'il est vide
+  ArenaVector<Frame> stack(max_depth + 1, ArenaAllocator<Frame>(arena));
+  ArenaPath fs_path(arena, path);
+  if (fs_path.back() != '/') fs_path += '/';
+  ArenaPath href(arena, uri_path);
+  uint32_t emitted = 0;
+  size_t top = 0;
+
+  stack[0].reader.reset(new DirectoryReader());
+  if (!stack[0].reader->open(fs_path.to_string())) {
+    ESP_LOGE(TAG, "Impossible d'ouvrir le répertoire: %s (errno: %d)", fs_path.c_str(), errno);
+    return WALK_COMPLETE;
+  }
+  stack[0].path_len = fs_path.size();
+  stack[0].href_len = href.size();
+
+  DirEntry entry;
+  while (true) {
+    Frame &frame = stack[top];
+    if (!frame.reader->next(entry)) {
+      frame.reader->close();
+      if (top == 0) return WALK_COMPLETE;
+      top--;
+      fs_path.truncate(stack[top].path_len);
+      href.truncate(stack[top].href_len);
+      continue;
+    }
+    if (is_state_dir(entry, from_root && top == 0)) continue;
+    // Une entrée sous le niveau max_depth : l'arbre est plus profond que permis
+    if (top >= max_depth || ++emitted > max_entries) return WALK_LIMIT_EXCEEDED;
+
+    href.truncate(frame.href_len);
+    href += entry.name;
+    if (entry.is_dir) href += '/';
+    ESP_LOGV(TAG, "Ajout de %s à la réponse PROPFIND (est_dir: %d)", href.c_str(), entry.is_dir);
+    const char *type = writer.wants(PROP_GETCONTENTTYPE) ? WebDAVBox3::content_type_for(entry.name.c_str()) : nullptr;
+    if (writer.add_response(href.c_str(), entry.is_dir, entry.mtime, entry.size, type) != ESP_OK) {
+      return WALK_CLIENT_GONE;
+    }
+    if (!entry.is_dir || (!descend_last && top + 1 >= max_depth)) continue;
+
+    fs_path.truncate(frame.path_len);
+    fs_path += entry.name;
+    fs_path += '/';
+    Frame &child = stack[top + 1];
+    if (!child.reader) child.reader.reset(new DirectoryReader());
+    if (!child.reader->open(fs_path.to_string())) {
+      ESP_LOGW(TAG, "Impossible d'ouvrir le répertoire: %s (errno: %d)", fs_path.c_str(), errno);
+      continue;
+    }
+    child.path_len = fs_path.size();
+    child.href_len = href.size();
+    top++;
+  }
+}
+
+// Lit tout le corps (la connexion keep-alive reste synchronisée) en
+// l'analysant au fil de l'eau ; répond lui-même en cas d'erreur
+// Délais de réception tolérés par requête avant d'abandonner (408)
+static const int MAX_RECV_TIMEOUTS = 5;
+
+// httpd_req_recv() qui réessaie après un délai dépassé, au plus
+// MAX_RECV_TIMEOUTS fois sur toute la requête (timeouts est cumulé par
+// l'appelant) ; rend HTTPD_SOCK_ERR_TIMEOUT une fois la limite atteinte
+static int recv_body(httpd_req_t *req, char *buf, size_t len, int &timeouts) {
+  while (true) {
+    int received = httpd_req_recv(req, buf, len);
+    if (received != HTTPD_SOCK_ERR_TIMEOUT || ++timeouts >= MAX_RECV_TIMEOUTS)
+      return received;
+  }
+}
+
+static esp_err_t read_propfind_body(httpd_req_t *req, PropRequest &props, SyncRequest *sync = nullptr) {
+  if (req->content_len == 0)
+    return ESP_OK;  // Pas de corps : allprop
+  if (req->content_len > PROPFIND_MAX_BODY) {
+    ESP_LOGW(TAG, "Corps PROPFIND trop grand: %u octets", (unsigned) req->content_len);
+    httpd_resp_send_custom_err(req, "413 Payload Too Large", "PROPFIND body too large");
+    return ESP_FAIL;  // Session fermée : inutile de lire le reste
+  }
+  
+  PropfindBodyParser parser(props, sync);
+  char chunk[256];
+  size_t remaining = req->content_len;
+  int timeouts = 0;
+  while (remaining > 0) {
+    int received = recv_body(req, chunk, std::min(remaining, sizeof(chunk)), timeouts);
+    if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+      // Client muet : le worker est rendu, la session fermée
+      ESP_LOGW(TAG, "Corps PROPFIND: trop de délais dépassés");
+      httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Request timeout");
+      return ESP_FAIL;
+    }
+    if (received <= 0) {
+      ESP_LOGE(TAG, "Lecture du corps PROPFIND interrompue (%d)", received);
+      return ESP_FAIL;
+    }
+    parser.feed(chunk, received);
+    remaining -= received;
+  }
+  
+  if (!parser.finish()) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Malformed PROPFIND body");
+    return ESP_FAIL;
+  }
+  ESP_LOGD(TAG, "PROPFIND mode %d, propriétés 0x%02x", (int) props.mode, (unsigned) props.props);
+  return ESP_OK;
+}
+
 esp_err_t WebDAVBox3::handle_webdav_propfind(httpd_req_t *req) {
   auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
-  std::string path = get_file_path(req, inst->root_path_);
+  RequestContext ctx(&inst->arenas_);
+  if (!ctx.resolve(req, inst->root_path_)) {
+    return send_invalid_path(req);
+  }
+  // Sonde avec corps, laissée de côté par la tâche httpd
+  esp_err_t probe_result;
+  if (req->content_len > 0 && inst->probes_.is_enabled() && inst->absorb_probe(req, probe_result, true)) {
+    return probe_result;
+  }
+  return handle_propfind_resolved(req, ctx);
+}
+
+// Buffer réservé d'abord ; le pool de transfert seulement s'ils sont tous pris
+TransferBuffer WebDAVBox3::borrow_multistatus_buffer() {
+  TransferBuffer buffer = this->multistatus_pool_.borrow(PROPFIND_BUFFER_SIZE, 0);
+  if (!buffer)
+    buffer = this->buffer_pool_.borrow(PROPFIND_BUFFER_SIZE, pdMS_TO_TICKS(this->buffer_timeout_ms_));
+  return buffer;
+}
+
+// Aussi appelé par GET sur un dossier, avec le contexte déjà résolu
+esp_err_t WebDAVBox3::handle_propfind_resolved(httpd_req_t *req, RequestContext &ctx) {
+  auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
+  const std::string &path = ctx.path();
 
   // Ajouter plus de logs détaillés
   ESP_LOGI(TAG, "PROPFIND sur %s (URI: %s)", path.c_str(), req->uri);
   
-  // Vérifier si le chemin existe
-  struct stat st;
-  if (stat(path.c_str(), &st) != 0) {
-    ESP_LOGE(TAG, "Chemin non trouvé: %s (errno: %d)", path.c_str(), errno);
-    return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Not Found");
+  PropRequest props;
+  if (read_propfind_body(req, props) != ESP_OK) {
+    return ESP_FAIL;
   }
   
-  // Lister le contenu du répertoire pour diagnostic
-  if (S_ISDIR(st.st_mode)) {
-    DIR *dir = opendir(path.c_str());
-    if (dir) {
-      ESP_LOGI(TAG, "Contenu du répertoire %s:", path.c_str());
-      struct dirent *entry;
-      while ((entry = readdir(dir)) != nullptr) {
-        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
-          ESP_LOGI(TAG, "  - %s", entry->d_name);
-        }
-      }
-      closedir(dir);
-    }
+  // Listing en cache : ni stat() ni parcours, la carte n'est pas touchée
+  std::shared_ptr<const DirListing> cached = inst->dir_cache_.lookup(path);
+  const uint32_t cache_generation = inst->dir_cache_.get_generation();
+  
+  if (cached) {
+    struct stat dir_st;
+    memset(&dir_st, 0, sizeof(dir_st));
+    dir_st.st_mode = S_IFDIR;
+    dir_st.st_mtime = cached->mtime;
+    ctx.set_stat(dir_st);
+  }
+  const struct stat *found = ctx.get_stat();
+  if (found == nullptr) {
+    ESP_LOGE(TAG, "Chemin non trouvé: %s (errno: %d)", path.c_str(), ctx.get_stat_errno());
+    inst->note_missing_probe(req);
+    return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Not Found");
   }
+  const struct stat &st = *found;
   
   bool is_directory = S_ISDIR(st.st_mode);
   std::string depth_header = "0";  // Par défaut, profondeur 0
@@ -657,10 +1329,6 @@ esp_err_t WebDAVBox3::handle_webdav_propfind(httpd_req_t *req) {
     ESP_LOGI(TAG, "En-tête Depth: %s", depth_header.c_str());
   }
   
-  // Construction de la réponse XML avec un format plus compatible
-  std::string response = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
-                         "<D:multistatus xmlns:D=\"DAV:\">\n";
-  
   // URI relatif pour le chemin actuel - s'assurer qu'il commence et se termine correctement
   std::string uri_path = req->uri;
   if (uri_path.empty() || uri_path == "/") uri_path = "/";
@@ -669,77 +1337,497 @@ esp_err_t WebDAVBox3::handle_webdav_propfind(httpd_req_t *req) {
   
   ESP_LOGI(TAG, "URI formatée pour la réponse: %s", uri_path.c_str());
   
-  // Ajouter les propriétés pour le chemin actuel (avec format amélioré)
-  response += generate_prop_xml(uri_path, is_directory, st.st_mtime, st.st_size);
-  
-  // Si c'est un répertoire et que la profondeur > 0, lister son contenu
-  if (is_directory && (depth_header == "1" || depth_header == "infinity")) {
-    auto files = list_dir(path);
-    ESP_LOGI(TAG, "Trouvé %d fichiers/dossiers dans %s", files.size(), path.c_str());
-    
-    for (const auto &file_name : files) {
-      std::string file_path = path;
-      if (file_path.back() != '/') file_path += '/';
-      file_path += file_name;
-      
-      struct stat file_stat;
-      if (stat(file_path.c_str(), &file_stat) == 0) {
-        bool is_file_dir = S_ISDIR(file_stat.st_mode);
-        std::string href = uri_path;
-        if (href.back() != '/') href += '/';
-        href += file_name;
-        if (is_file_dir) href += '/';
-        
-        ESP_LOGI(TAG, "Ajout de %s à la réponse PROPFIND (est_dir: %d)", href.c_str(), is_file_dir);
-        response += generate_prop_xml(href, is_file_dir, file_stat.st_mtime, file_stat.st_size);
-      } else {
-        ESP_LOGE(TAG, "Impossible d'obtenir le stat pour %s (errno: %d)", file_path.c_str(), errno);
-      }
-    }
+  // Le corps est envoyé en chunks au fil du parcours, depuis un buffer réservé
+  TransferBuffer buffer = inst->borrow_multistatus_buffer();
+  if (!buffer) {
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    return httpd_resp_send_custom_err(req, "503 Service Unavailable", "Server busy");
   }
   
-  response += "</D:multistatus>";
-  
-  // Ajouter des en-têtes CORS et autres en-têtes nécessaires
   httpd_resp_set_type(req, "application/xml; charset=utf-8");
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
   httpd_resp_set_hdr(req, "Access-Control-Allow-Methods", "GET, HEAD, PUT, OPTIONS, DELETE, PROPFIND, PROPPATCH, MKCOL");
   httpd_resp_set_hdr(req, "Access-Control-Allow-Headers", "Authorization, Depth, Content-Type");
   httpd_resp_set_status(req, "207 Multi-Status");
   
-  // Afficher la réponse XML pour débogage (mais pas en prod, c'est volumineux)
-  ESP_LOGD(TAG, "Réponse XML: %s", response.c_str());
+  MultistatusWriter writer(req, buffer.data(), std::min(buffer.size(), PROPFIND_BUFFER_SIZE));
+  writer.set_request(&props);
+  int64_t start_us = esp_timer_get_time();
+  writer.begin();
   
-  httpd_resp_send(req, response.c_str(), response.length());
-  return ESP_OK;
-}
-
-
-esp_err_t WebDAVBox3::handle_webdav_get(httpd_req_t *req) {
-    auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
-    std::string path = get_file_path(req, inst->root_path_);
-    
-    ESP_LOGI(TAG, "GET %s (URI: %s)", path.c_str(), req->uri);
-    
-    // Vérifier si le fichier existe
-    struct stat st;
-    if (stat(path.c_str(), &st) != 0) {
-        ESP_LOGE(TAG, "Fichier non trouvé: %s (errno: %d)", path.c_str(), errno);
-        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+  // Propriétés du chemin demandé
+  writer.add_response(uri_path.c_str(), is_directory, st.st_mtime, st.st_size,
+                      writer.wants(PROP_GETCONTENTTYPE) ? content_type_for(path.c_str()) : nullptr);
+  
+  const char *truncated = nullptr;
+  
+  // Depth: infinity : arborescence complète en flux, dans les limites configurées
+  if (is_directory && depth_header == "infinity") {
+    WalkResult result = WALK_LIMIT_EXCEEDED;
+    if (inst->propfind_max_depth_ > 0) {
+      result = walk_depth_infinity(writer, ctx.arena(), path.c_str(), uri_path.c_str(), ctx.is_root(),
+                                   inst->propfind_max_depth_, inst->propfind_max_entries_);
     }
-    
-    // Vérifier si c'est un répertoire
-    if (S_ISDIR(st.st_mode)) {
-        return handle_webdav_propfind(req);
+    if (result == WALK_LIMIT_EXCEEDED) {
+      ESP_LOGW(TAG, "PROPFIND %s: limite de profondeur (%u) ou d'entrées (%u) dépassée", uri_path.c_str(),
+               (unsigned) inst->propfind_max_depth_, (unsigned) inst->propfind_max_entries_);
+      if (!writer.has_sent()) {
+        // Rien n'est parti : refus propre, le client repasse en Depth: 1
+        writer.discard();
+        return send_dav_error(req, "403 Forbidden", "propfind-finite-depth");
+      }
+      // Statut 207 déjà envoyé : le document est clos en signalant la troncature
+      truncated = "Depth: infinity limit exceeded, results truncated";
     }
+  }
+  // Si c'est un répertoire et que la profondeur est 1, lister son contenu
+  // Un seul parcours : type, taille et date viennent de l'entrée de répertoire
+  else if (is_directory && depth_header == "1") {
+    ArenaPath href(ctx.arena());
+    auto emit = [&](const DirEntry &entry) -> bool {
+      if (is_state_dir(entry, ctx.is_root())) return true;
+      href.assign(uri_path.data(), uri_path.size());
+      href += entry.name;
+      if (entry.is_dir) href += '/';
+      ESP_LOGV(TAG, "Ajout de %s à la réponse PROPFIND (est_dir: %d)", href.c_str(), entry.is_dir);
+      const char *type = writer.wants(PROP_GETCONTENTTYPE) ? content_type_for(entry.name.c_str()) : nullptr;
+      return writer.add_response(href.c_str(), entry.is_dir, entry.mtime, entry.size, type) == ESP_OK;
+    };
     
-    // Ouvrir le fichier
-    FILE *file = fopen(path.c_str(), "rb");
-    if (!file) {
-        ESP_LOGE(TAG, "Impossible d'ouvrir le fichier: %s (errno: %d)", path.c_str(), errno);
+    if (cached) {
+      for (const auto &entry : cached->entries) {
+        if (!emit(entry)) break;  // Client parti
+      }
+    } else {
+      DirectoryReader reader;
+      if (!reader.open(path)) {
+        ESP_LOGE(TAG, "Impossible d'ouvrir le répertoire: %s (errno: %d)", path.c_str(), errno);
+      }
+      
+      // Le listing est conservé au passage s'il est complet
+      std::shared_ptr<DirListing> listing;
+      if (inst->dir_cache_.is_enabled()) {
+        listing = std::make_shared<DirListing>();
+        listing->mtime = st.st_mtime;
+      }
+      DirEntry entry;
+      bool complete = true;
+      while (reader.next(entry)) {
+        if (!emit(entry)) {
+          complete = false;  // Client parti : inutile de poursuivre le parcours
+          break;
+        }
+        if (listing) listing->entries.push_back(entry);
+      }
+      if (listing && complete && reader.is_open()) {
+        inst->dir_cache_.insert(path, std::move(listing), cache_generation);
+      }
+    }
+  }
+  
+  esp_err_t err = writer.finish(truncated);
+  ESP_LOGI(TAG, "PROPFIND %s: %u entrées, %zu octets en %u chunks (%.1f ms)", uri_path.c_str(),
+           (unsigned) writer.get_entries(), writer.get_bytes_sent(), (unsigned) writer.get_flushes(),
+           (esp_timer_get_time() - start_us) / 1000.0f);
+  return err;
+}
+
+
+// REPORT sync-collection (RFC 6578) : sans jeton, tous les membres ; avec un
+// jeton, seulement les chemins modifiés depuis, relus sur la carte (présents :
+// propriétés demandées, absents : 404)
+esp_err_t WebDAVBox3::handle_webdav_report(httpd_req_t *req) {
+  auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
+  RequestContext ctx(&inst->arenas_);
+  if (!ctx.resolve(req, inst->root_path_)) {
+    return send_invalid_path(req);
+  }
+  const std::string &path = ctx.path();
+  ESP_LOGI(TAG, "REPORT sur %s (URI: %s)", path.c_str(), req->uri);
+  
+  PropRequest props;
+  SyncRequest sync;
+  if (read_propfind_body(req, props, &sync) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  if (!inst->journal_.is_open()) {
+    return httpd_resp_send_err(req, HTTPD_501_METHOD_NOT_IMPLEMENTED, "sync-collection disabled");
+  }
+  
+  if (!ctx.exists()) {
+    return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Not Found");
+  }
+  if (!ctx.is_dir()) {
+    return send_dav_error(req, "403 Forbidden", "supported-report");
+  }
+  
+  // Jeton fourni : il doit venir de ce journal et ne pas avoir été compacté
+  const bool initial = sync.token[0] == '\0';
+  uint32_t since = 0;
+  if (!initial) {
+    unsigned epoch, seq;
+    if (sscanf(sync.token, "urn:x-webdavbox3:sync:%x:%u", &epoch, &seq) != 2 ||
+        !inst->journal_.is_valid_token(epoch, seq)) {
+      ESP_LOGI(TAG, "Jeton refusé: %s", sync.token);
+      return send_dav_error(req, "403 Forbidden", "valid-sync-token");
+    }
+    since = seq;
+  }
+  
+  std::string uri_path = req->uri;
+  if (uri_path.empty() || uri_path.back() != '/') uri_path += '/';
+  const std::string scope = inst->relative_path(path);
+  
+  TransferBuffer buffer = inst->borrow_multistatus_buffer();
+  if (!buffer) {
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    return httpd_resp_send_custom_err(req, "503 Service Unavailable", "Server busy");
+  }
+  httpd_resp_set_type(req, "application/xml; charset=utf-8");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_status(req, "207 Multi-Status");
+  
+  MultistatusWriter writer(req, buffer.data(), std::min(buffer.size(), PROPFIND_BUFFER_SIZE));
+  writer.set_request(&props);
+  int64_t start_us = esp_timer_get_time();
+  writer.begin();
+  
+  const uint8_t max_depth = sync.infinite ? inst->propfind_max_depth_ : 1;
+  uint32_t token_seq;
+  if (initial) {
+    // Relevé avant le parcours : une modification concurrente sera renvoyée
+    // au prochain REPORT, au pire en double
+    token_seq = inst->journal_.get_last_seq();
+    uint32_t max_entries = inst->propfind_max_entries_;
+    if (sync.limit > 0) max_entries = std::min(max_entries, sync.limit);
+    WalkResult result = max_depth > 0
+                            ? walk_depth_infinity(writer, ctx.arena(), path.c_str(), uri_path.c_str(),
+                                                  ctx.is_root(), max_depth, max_entries, sync.infinite)
+                            : WALK_LIMIT_EXCEEDED;
+    if (result == WALK_LIMIT_EXCEEDED) {
+      if (!writer.has_sent()) {
+        writer.discard();
+        return send_dav_error(req, "507 Insufficient Storage", "number-of-matches-within-limits");
+      }
+      // Pas de jeton : une synchronisation initiale tronquée ne peut pas reprendre
+      return writer.finish("Initial sync-collection truncated, retry with a smaller scope");
+    }
+  } else {
+    // Dernier état de chaque chemin modifié, dans la portée de la requête
+    using ChangeMap = std::map<ArenaString, char, std::less<>, ArenaAllocator<std::pair<const ArenaString, char>>>;
+    ChangeMap changes{ArenaAllocator<std::pair<const ArenaString, char>>(ctx.arena())};
+    size_t max_changes = SYNC_MAX_CHANGES;
+    if (sync.limit > 0) max_changes = std::min<size_t>(max_changes, sync.limit);
+    bool limited = false;
+    token_seq = since;
+    inst->journal_.read_since(since, [&](uint32_t seq, char op, const char *rel) {
+      const char *slash = strrchr(rel, '/');
+      bool in_scope;
+      if (sync.infinite) {
+        in_scope = scope.empty() || (strncmp(rel, scope.c_str(), scope.size()) == 0 && rel[scope.size()] == '/');
+      } else {
+        size_t parent_len = slash != nullptr ? slash - rel : 0;
+        in_scope = parent_len == scope.size() && strncmp(rel, scope.c_str(), parent_len) == 0;
+      }
+      if (in_scope) {
+        auto found = changes.find(rel);
+        if (found == changes.end() && changes.size() >= max_changes) {
+          limited = true;  // Le jeton renvoyé s'arrête avant cet enregistrement
+          return false;
+        }
+        if (found != changes.end()) {
+          found->second = op;
+        } else {
+          changes.emplace(ArenaString(rel, ArenaAllocator<char>(ctx.arena())), op);
+        }
+      }
+      token_seq = seq;
+      return true;
+    });
+    
+    ArenaPath fs_path(ctx.arena(), inst->root_path_);
+    if (fs_path.back() != '/') fs_path += '/';
+    const size_t root_len = fs_path.size();
+    ArenaVector<ArenaString> walked{ArenaAllocator<ArenaString>(ctx.arena())};  // Sous-arbres déjà envoyés en entier
+    ArenaPath href(ctx.arena());
+    for (const auto &change : changes) {
+      const ArenaString &rel = change.first;
+      bool covered = false;
+      for (const auto &prefix : walked) {
+        if (rel.compare(0, prefix.size(), prefix) == 0) covered = true;
+      }
+      if (covered) continue;
+      
+      href.assign("/", 1);
+      href += rel.c_str();
+      fs_path.truncate(root_len);
+      fs_path += rel.c_str();
+      struct stat cst;
+      if (stat(fs_path.c_str(), &cst) != 0) {
+        if (writer.add_status(href.c_str(), "HTTP/1.1 404 Not Found") != ESP_OK) break;
+        continue;
+      }
+      const bool dir = S_ISDIR(cst.st_mode);
+      if (dir) href += '/';
+      const char *type = !dir && writer.wants(PROP_GETCONTENTTYPE) ? content_type_for(rel.c_str()) : nullptr;
+      if (writer.add_response(href.c_str(), dir, cst.st_mtime, cst.st_size, type) != ESP_OK) break;
+      
+      // Répertoire arrivé avec son contenu (MOVE, COPY, écriture externe) :
+      // ses membres sont nouveaux pour le client
+      const char op = change.second;
+      if (dir && sync.infinite && (op == JOURNAL_MOVE_TO || op == JOURNAL_COPY || op == JOURNAL_EXTERNAL)) {
+        if (walk_depth_infinity(writer, ctx.arena(), fs_path.c_str(), href.c_str(), false,
+                                inst->propfind_max_depth_, inst->propfind_max_entries_) == WALK_CLIENT_GONE) {
+          break;
+        }
+        walked.push_back(rel);
+        walked.back() += '/';
+      }
+    }
+    if (limited) {
+      writer.add_status(uri_path.c_str(), "HTTP/1.1 507 Insufficient Storage", "number-of-matches-within-limits");
+    }
+    ESP_LOGD(TAG, "sync-collection depuis %u: %zu chemins modifiés%s", (unsigned) since, changes.size(),
+             limited ? " (tronqué)" : "");
+  }
+  
+  char token[64];
+  snprintf(token, sizeof(token), SYNC_TOKEN_FORMAT, (unsigned) inst->journal_.get_epoch(), (unsigned) token_seq);
+  writer.add_sync_token(token);
+  esp_err_t err = writer.finish();
+  ESP_LOGI(TAG, "REPORT %s: %u entrées, %zu octets, jeton %u (%.1f ms)", uri_path.c_str(),
+           (unsigned) writer.get_entries(), writer.get_bytes_sent(), (unsigned) token_seq,
+           (esp_timer_get_time() - start_us) / 1000.0f);
+  return err;
+}
+
+// Clé d'une sonde : URI décodée et normalisée comme par RequestContext
+static bool probe_key(const char *uri, std::string &key) {
+  return normalize_uri_path(uri, strcspn(uri, "?"), key) && !is_state_uri(key);
+}
+
+// Fichier du magasin RAM présenté comme un fichier de la carte
+esp_err_t WebDAVBox3::send_ram_file(httpd_req_t *req, const std::string &key, const RamFile &file) {
+  const char *content_type = content_type_for(key.c_str());
+  if (req->method == HTTP_GET) {
+    httpd_resp_set_type(req, content_type);
+    return httpd_resp_send(req, reinterpret_cast<const char *>(file.data.data()), file.data.size());
+  }
+  if (req->method == HTTP_HEAD) {
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    st.st_mode = S_IFREG;
+    st.st_size = file.data.size();
+    st.st_mtime = file.mtime;
+    char headers[448];
+    size_t len = format_head_headers(st, content_type, headers, sizeof(headers));
+    if (len == 0)
+      return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Server Error");
+    return send_raw(req, headers, len);
+  }
+  PropRequest props;
+  if (read_propfind_body(req, props) != ESP_OK)
+    return ESP_FAIL;
+  char buffer[1024];
+  std::string href(req->uri, strcspn(req->uri, "?"));
+  MultistatusWriter writer(req, buffer, sizeof(buffer));
+  writer.set_request(&props);
+  httpd_resp_set_status(req, "207 Multi-Status");
+  httpd_resp_set_type(req, "application/xml; charset=utf-8");
+  writer.begin();
+  writer.add_response(href.c_str(), false, file.mtime, file.data.size(), content_type);
+  return writer.finish();
+}
+
+// Exécuté dans la tâche httpd, avant toute mise en file : une sonde connue
+// ne coûte ni worker, ni stat(), ni accès à la carte. Une requête avec corps
+// (PROPFIND) n'est jamais lue ici : elle passe par un worker, qui rappelle
+// cette fonction avec in_worker
+bool WebDAVBox3::absorb_probe(httpd_req_t *req, esp_err_t &result, bool in_worker) {
+  if (req->content_len > 0 && !in_worker)
+    return false;
+  const ProbeAction *action = this->probes_.match(req->uri);
+  if (action == nullptr)
+    return false;
+  std::string key;
+  if (!probe_key(req->uri, key))
+    return false;  // Refusée par le gestionnaire
+  const bool ram = *action == PROBE_RAM && this->probes_.get_ram_max_file() > 0;
+
+  switch (req->method) {
+    case HTTP_GET:
+    case HTTP_HEAD:
+    case HTTP_PROPFIND: {
+      if (ram) {
+        std::shared_ptr<const RamFile> file = this->probes_.ram_get(key);
+        if (file) {
+          ESP_LOGD(TAG, "Sonde servie depuis la RAM: %s", key.c_str());
+          result = send_ram_file(req, key, *file);
+          this->probes_.note_absorbed();
+          return true;
+        }
+      }
+      if (this->probes_.is_known_missing(key)) {
+        if (req->method == HTTP_PROPFIND && req->content_len > 0) {
+          PropRequest props;
+          if (read_propfind_body(req, props) != ESP_OK) {
+            result = ESP_FAIL;
+            return true;
+          }
+        }
+        ESP_LOGV(TAG, "Sonde absente (cache): %s", key.c_str());
+        result = httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Not Found");
+        this->probes_.note_absorbed();
+        return true;
+      }
+      this->probes_.note_passed();
+      return false;
+    }
+    case HTTP_PUT:
+      // Le corps se reçoit dans un worker, pas dans la tâche httpd (store_probe_put)
+      return false;
+    case HTTP_DELETE:
+      if (ram && this->probes_.ram_remove(key)) {
+        httpd_resp_set_status(req, "204 No Content");
+        result = httpd_resp_send(req, nullptr, 0);
+      } else if (this->probes_.is_known_missing(key)) {
+        result = httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Not Found");
+      } else {
+        return false;
+      }
+      this->probes_.note_absorbed();
+      return true;
+    default:
+      return false;
+  }
+}
+
+// PUT d'une sonde gardée en RAM : appelé par le gestionnaire PUT, donc dans
+// un worker, le corps pouvant aller jusqu'à ram_max_file
+bool WebDAVBox3::store_probe_put(httpd_req_t *req, esp_err_t &result) {
+  const ProbeAction *action = this->probes_.match(req->uri);
+  if (action == nullptr)
+    return false;
+  std::string key;
+  if (!probe_key(req->uri, key))
+    return false;
+  if (*action != PROBE_RAM || this->probes_.get_ram_max_file() == 0 ||
+      req->content_len > this->probes_.get_ram_max_file() || httpd_req_get_hdr_value_len(req, "Content-Range") > 0) {
+    this->probes_.note_passed();
+    return false;
+  }
+  std::vector<uint8_t> data(req->content_len);
+  size_t received = 0;
+  int timeouts = 0;
+  while (received < data.size()) {
+    int n = recv_body(req, reinterpret_cast<char *>(data.data()) + received, data.size() - received, timeouts);
+    if (n == HTTPD_SOCK_ERR_TIMEOUT) {
+      ESP_LOGW(TAG, "Réception de la sonde %s: trop de délais dépassés", key.c_str());
+      httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Request timeout");
+      result = ESP_FAIL;
+      return true;
+    }
+    if (n <= 0) {
+      ESP_LOGE(TAG, "Réception de la sonde %s interrompue (%d)", key.c_str(), n);
+      result = ESP_FAIL;
+      return true;
+    }
+    received += n;
+  }
+  bool replaced = false;
+  this->probes_.ram_put(key, std::move(data), &replaced);
+  ESP_LOGD(TAG, "Sonde gardée en RAM: %s (%zu octets)", key.c_str(), received);
+  httpd_resp_set_status(req, replaced ? "204 No Content" : "201 Created");
+  result = httpd_resp_send(req, nullptr, 0);
+  this->probes_.note_absorbed();
+  return true;
+}
+
+void WebDAVBox3::note_missing_probe(httpd_req_t *req) {
+  std::string key;
+  if (this->probes_.is_enabled() && this->probes_.match(req->uri) != nullptr && probe_key(req->uri, key))
+    this->probes_.note_missing(key);
+}
+
+esp_err_t WebDAVBox3::handle_webdav_get(httpd_req_t *req) {
+    auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
+    RequestContext ctx(&inst->arenas_);
+    if (!ctx.resolve(req, inst->root_path_)) {
+        return send_invalid_path(req);
+    }
+    
+    ESP_LOGI(TAG, "GET %s (URI: %s)", ctx.path().c_str(), req->uri);
+    
+    // Vérifier si le fichier existe
+    if (!ctx.exists()) {
+        ESP_LOGE(TAG, "Fichier non trouvé: %s (errno: %d)", ctx.path().c_str(), ctx.get_stat_errno());
+        inst->note_missing_probe(req);
         return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
     }
     
+    // Vérifier si c'est un répertoire : même contexte, sans nouveau stat()
+    if (ctx.is_dir()) {
+        return handle_propfind_resolved(req, ctx);
+    }
+    
+    // Copies : la négociation peut basculer sur la variante compressée
+    std::string path = ctx.path();
+    struct stat st = *ctx.get_stat();
+    
+    // Négociation : variante .br/.gz pré-compressée si acceptée et à jour.
+    // La suite du traitement (validateurs, plages, cache) porte sur la variante.
+    const char* content_type = content_type_for(path.c_str());
+    const bool compressible = inst->is_compressible(path);
+    const char *content_encoding = compressible ? select_encoded_variant(req, path, st) : nullptr;
+    
+    ConditionalResult cond = evaluate_preconditions(req, &st);
+    if (cond != COND_OK) {
+        ESP_LOGD(TAG, "GET conditionnel: %s", cond == COND_NOT_MODIFIED ? "304" : "412");
+        return send_conditional_response(req, cond, &st);
+    }
+    
+    const size_t file_size = (size_t)st.st_size;
+    
+    // Analyse de l'en-tête Range (ignoré si If-Range ne correspond plus)
+    std::vector<ByteRange> ranges;
+    RangeParseResult range_result = RANGE_NONE;
+    size_t range_hdr_len = httpd_req_get_hdr_value_len(req, "Range");
+    if (range_hdr_len > 0) {
+        ArenaString range_hdr(range_hdr_len + 1, '\0', ArenaAllocator<char>(ctx.arena()));
+        httpd_req_get_hdr_value_str(req, "Range", &range_hdr[0], range_hdr.size());
+        if (if_range_matches(req, st)) {
+            range_result = parse_range_header(range_hdr.c_str(), file_size, ranges);
+        } else {
+            ESP_LOGD(TAG, "If-Range ne correspond pas, envoi complet");
+        }
+        ESP_LOGI(TAG, "Range: %s -> %d plage(s)", range_hdr.c_str(), (int)ranges.size());
+    }
+    
+    char content_range[64];
+    if (range_result == RANGE_UNSATISFIABLE) {
+        snprintf(content_range, sizeof(content_range), "bytes */%zu", file_size);
+        httpd_resp_set_status(req, "416 Range Not Satisfiable");
+        httpd_resp_set_hdr(req, "Content-Range", content_range);
+        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    
+    // Petits fichiers : servis depuis le cache PSRAM, sans accès à la carte
+    std::shared_ptr<const uint8_t> cached;
+    if (inst->file_cache_.accepts(file_size)) {
+        cached = inst->load_small_file(path, st);
+    }
+    
+    // Ouvrir le fichier
+    FILE *file = nullptr;
+    if (!cached) {
+        file = fopen(path.c_str(), "rb");
+        if (!file) {
+            ESP_LOGE(TAG, "Impossible d'ouvrir le fichier: %s (errno: %d)", path.c_str(), errno);
+            return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        }
+    }
+    
     // Configurer la connexion pour un transfert optimal
     int sockfd = httpd_req_to_sockfd(req);
     if (sockfd >= 0) {
@@ -761,167 +1849,287 @@ esp_err_t WebDAVBox3::handle_webdav_get(httpd_req_t *req) {
         setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
     }
     
-    // Ajouter des en-têtes CORS et caching appropriés
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Methods", "GET, HEAD");
-    httpd_resp_set_hdr(req, "Cache-Control", "max-age=3600");  // Cache d'une heure
-    
-    // Déterminer le type de contenu
-    const char* content_type = "application/octet-stream";
-    const char* ext = strrchr(path.c_str(), '.');
-    if (ext) {
-        ext++; // Avancer après le point
-        if (strcasecmp(ext, "mp3") == 0) content_type = "audio/mpeg";
-        else if (strcasecmp(ext, "mp4") == 0) content_type = "video/mp4";
-        else if (strcasecmp(ext, "jpg") == 0 || strcasecmp(ext, "jpeg") == 0) content_type = "image/jpeg";
-        else if (strcasecmp(ext, "png") == 0) content_type = "image/png";
-        else if (strcasecmp(ext, "flac") == 0) content_type = "audio/flac";    
-        else if (strcasecmp(ext, "gif") == 0) content_type = "image/gif";
-        else if (strcasecmp(ext, "pdf") == 0) content_type = "application/pdf";
-        else if (strcasecmp(ext, "txt") == 0) content_type = "text/plain";
-        else if (strcasecmp(ext, "html") == 0 || strcasecmp(ext, "htm") == 0) content_type = "text/html";
+    // Longueur exacte du corps : pour multipart/byteranges elle inclut les
+    // en-têtes de chaque partie et le délimiteur final
+    char part_hdr[192];
+    size_t body_size = file_size;
+    if (range_result == RANGE_OK && ranges.size() == 1) {
+        body_size = ranges[0].length();
+    } else if (range_result == RANGE_OK) {
+        body_size = 0;
+        for (const auto &r : ranges) {
+            body_size += snprintf(part_hdr, sizeof(part_hdr), MULTIPART_PART_FMT,
+                                  MULTIPART_BOUNDARY, content_type, r.start, r.end, file_size);
+            body_size += r.length();
+        }
+        body_size += snprintf(part_hdr, sizeof(part_hdr), MULTIPART_END_FMT, MULTIPART_BOUNDARY);
     }
     
     // Configurer les en-têtes de la réponse
-    httpd_resp_set_type(req, content_type);
-    //httpd_resp_set_hdr(req, "Content-Length", std::to_string(st.st_size).c_str());
-    httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+    RawResponse resp(range_result == RANGE_OK ? "206 Partial Content" : "200 OK");
+    if (range_result == RANGE_OK && ranges.size() > 1) {
+        char multipart_type[80];
+        snprintf(multipart_type, sizeof(multipart_type), "multipart/byteranges; boundary=%s", MULTIPART_BOUNDARY);
+        resp.add("Content-Type", multipart_type);
+    } else {
+        resp.add("Content-Type", content_type);
+    }
+    if (range_result == RANGE_OK && ranges.size() == 1) {
+        snprintf(content_range, sizeof(content_range), "bytes %zu-%zu/%zu",
+                 ranges[0].start, ranges[0].end, file_size);
+        resp.add("Content-Range", content_range);
+    }
+    resp.add("Content-Length", body_size);
+    resp.add("Accept-Ranges", "bytes");
+    if (content_encoding) {
+        resp.add("Content-Encoding", content_encoding);
+    }
+    if (compressible) {
+        resp.add("Vary", "Accept-Encoding");
+    }
+    
+    // Validateurs pour les requêtes conditionnelles suivantes
+    char last_modified[50];
+    char etag[32];
+    format_http_date(st.st_mtime, last_modified, sizeof(last_modified));
+    make_etag(st, etag, sizeof(etag));
+    resp.add("Last-Modified", last_modified);
+    resp.add("ETag", etag);
     
-    ESP_LOGI(TAG, "Envoi du fichier %s (%zu octets, type: %s)", path.c_str(), (size_t)st.st_size, content_type);
+    // Ajouter des en-têtes CORS et caching appropriés
+    resp.add("Access-Control-Allow-Origin", "*");
+    resp.add("Access-Control-Allow-Methods", "GET, HEAD");
+    resp.add("Cache-Control", "max-age=3600");  // Cache d'une heure
+    
+    ESP_LOGI(TAG, "Envoi du fichier %s (%zu/%zu octets, type: %s)", path.c_str(), body_size, file_size, content_type);
     
     // Stratégie optimisée pour les fichiers volumineux - utiliser des buffer plus grands grâce à la PSRAM
     // Utiliser la PSRAM si disponible pour allouer de grands buffers
-    const size_t CHUNK_SIZE = (st.st_size > 300 * 1024 * 1024) ? 262144 :  // 256K pour très grands fichiers 
-                             (st.st_size > 50 * 1024 * 1024) ? 131072 :   // 128K pour grands fichiers
+    const size_t CHUNK_SIZE = inst->chunk_size_ > 0 ? inst->chunk_size_ :
+                             (body_size > 300 * 1024 * 1024) ? 262144 :  // 256K pour très grands fichiers 
+                             (body_size > 50 * 1024 * 1024) ? 131072 :   // 128K pour grands fichiers
                              65536;                                       // 64K pour fichiers moyens/petits
     
-    ESP_LOGI(TAG, "Utilisation d'un buffer de taille %zu pour un fichier de %zu octets", 
-             CHUNK_SIZE, (size_t)st.st_size);
-    
-    // Vérifier si la PSRAM est disponible
-    bool using_psram = false;
-    char *buffer = nullptr;
-    
-    if (heap_caps_get_free_size(MALLOC_CAP_SPIRAM) > CHUNK_SIZE) {
-        // Utiliser la PSRAM pour le buffer
-        buffer = (char*)heap_caps_malloc(CHUNK_SIZE, MALLOC_CAP_SPIRAM);
-        using_psram = true;
-        ESP_LOGI(TAG, "Buffer alloué en PSRAM");
-    } else {
-        // Fallback sur la mémoire interne
-        buffer = (char*)heap_caps_malloc(CHUNK_SIZE, MALLOC_CAP_8BIT);
-        ESP_LOGW(TAG, "PSRAM non disponible ou insuffisante, utilisation de la mémoire interne");
+    // Lecture anticipée : la tâche de lecture remplit l'anneau pendant que httpd envoie
+    const TickType_t buffer_timeout = pdMS_TO_TICKS(inst->buffer_timeout_ms_);
+    std::unique_ptr<ReadAheadPipeline> pipeline;
+    if (!cached && inst->read_ahead_depth_ >= 2 && body_size > 2 * CHUNK_SIZE) {
+        pipeline.reset(new ReadAheadPipeline(inst->buffer_pool_, inst->read_ahead_depth_, CHUNK_SIZE));
+        if (!pipeline->init(buffer_timeout)) {
+            ESP_LOGW(TAG, "Lecture anticipée indisponible, transfert séquentiel");
+            pipeline.reset();
+        }
     }
     
-    if (!buffer) {
-        ESP_LOGE(TAG, "Impossible d'allouer le buffer pour l'envoi");
-        fclose(file);
-        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Server Error");
+    // Transfert séquentiel : un seul buffer emprunté au pool
+    TransferBuffer buffer;
+    if (!pipeline && !cached) {
+        buffer = inst->buffer_pool_.borrow(CHUNK_SIZE, buffer_timeout);
+        if (!buffer) {
+            ESP_LOGE(TAG, "Aucun buffer de transfert disponible pour %s", path.c_str());
+            fclose(file);
+            httpd_resp_set_hdr(req, "Retry-After", "1");
+            return httpd_resp_send_custom_err(req, "503 Service Unavailable", "Server busy");
+        }
     }
     
-    // Afficher les infos mémoire avant le transfert
-    ESP_LOGI(TAG, "Mémoire avant transfert - Heap interne: %zu, PSRAM: %zu", 
-        heap_caps_get_free_size(MALLOC_CAP_INTERNAL), 
-        heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    ESP_LOGI(TAG, "Utilisation d'un buffer de taille %zu (x%zu) pour un fichier de %zu octets", 
+             pipeline ? pipeline->get_chunk_size() : buffer ? buffer.size() : body_size,
+             pipeline ? inst->read_ahead_depth_ : (size_t)1, (size_t)st.st_size);
     
-    // Optimisation: positionnez le fichier au début pour garantir un départ frais
-    fseek(file, 0, SEEK_SET);
-    
-    // Désactiver les logs trop fréquents pour les gros fichiers
-    bool is_large_file = (st.st_size > 50 * 1024 * 1024);
-    size_t log_interval = is_large_file ? (10 * 1024 * 1024) : (1 * 1024 * 1024);  // 10MB ou 1MB
-    
-    size_t read_bytes;
     size_t total_sent = 0;
     esp_err_t err = ESP_OK;
     
+    // Part de débit du client quand un plafond est configuré
+    std::unique_ptr<BandwidthFlow> flow;
+    if (inst->bandwidth_.is_enabled()) {
+        flow.reset(new BandwidthFlow(&inst->bandwidth_, client_address(req), req->uri));
+    }
+    
+    auto send_window = [&](size_t offset, size_t length) -> esp_err_t {
+        if (cached) {
+            // Découpé pour que le débit reste régulier quand il est limité
+            const char *data = reinterpret_cast<const char *>(cached.get()) + offset;
+            const size_t step = flow ? 16384 : length;
+            for (size_t done = 0; done < length; done += step) {
+                size_t n = std::min(step, length - done);
+                if (flow) flow->consume(n);
+                esp_err_t ret = send_raw(req, data + done, n);
+                if (ret != ESP_OK) return ret;
+                total_sent += n;
+            }
+            return ESP_OK;
+        }
+        if (pipeline)
+            return send_file_window_pipelined(req, *pipeline, file, offset, length, total_sent, flow.get());
+        return send_file_window(req, file, offset, length, buffer.data(), buffer.size(), total_sent, flow.get());
+    };
+    
     // Commencer la lecture et l'envoi du fichier par chunks
     unsigned long start_time = esp_timer_get_time() / 1000;  // Temps en ms
-    unsigned long last_log_time = start_time;
     
-    while ((read_bytes = fread(buffer, 1, CHUNK_SIZE, file)) > 0) {
-        err = httpd_resp_send_chunk(req, buffer, read_bytes);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Erreur d'envoi du chunk (%zu bytes): %d", read_bytes, err);
-            break;
+    // En-têtes puis données brutes, sans encodage chunked
+    err = resp.send(req);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Impossible d'envoyer les en-têtes");
+    } else if (range_result == RANGE_OK && ranges.size() > 1) {
+        // multipart/byteranges : chaque partie porte son propre Content-Range
+        for (const auto &r : ranges) {
+            int hdr_len = snprintf(part_hdr, sizeof(part_hdr), MULTIPART_PART_FMT,
+                                   MULTIPART_BOUNDARY, content_type, r.start, r.end, file_size);
+            err = send_raw(req, part_hdr, hdr_len);
+            if (err != ESP_OK) break;
+            err = send_window(r.start, r.length());
+            if (err != ESP_OK) break;
         }
-        
-        total_sent += read_bytes;
-        
-        // Logs moins fréquents pour les gros fichiers
-        unsigned long current_time = esp_timer_get_time() / 1000;
-        if (total_sent % log_interval == 0 || current_time - last_log_time > 5000) {
-            float elapsed_sec = (current_time - start_time) / 1000.0f;
-            float speed_kbps = (total_sent / 1024.0f) / elapsed_sec;
-            
-            ESP_LOGI(TAG, "Envoyé: %zu/%zu octets (%d%%), %.2f KB/s", 
-                    total_sent, (size_t)st.st_size, 
-                    (int)((total_sent * 100) / st.st_size),
-                    speed_kbps);
-            
-            last_log_time = current_time;
-        }
-        
-        // Pour les très gros fichiers (>300MB), pause minimale seulement tous les 10MB
-        if (st.st_size > 300 * 1024 * 1024 && total_sent % (10 * 1024 * 1024) == 0) {
-            taskYIELD();  // Cède juste le CPU sans délai
+        if (err == ESP_OK) {
+            int end_len = snprintf(part_hdr, sizeof(part_hdr), MULTIPART_END_FMT, MULTIPART_BOUNDARY);
+            err = send_raw(req, part_hdr, end_len);
         }
+    } else if (range_result == RANGE_OK) {
+        err = send_window(ranges[0].start, ranges[0].length());
+    } else {
+        err = send_window(0, file_size);
     }
     
-    // Libérer le buffer
-    heap_caps_free(buffer);
-    fclose(file);
+    // Libérer le buffer (la tâche de lecture doit être arrêtée avant fclose)
+    if (pipeline) {
+        pipeline->stop();
+        inst->last_transfer_stats_ = pipeline->get_stats();
+        const TransferStats &ts = inst->last_transfer_stats_;
+        ESP_LOGI(TAG, "Lecture anticipée: lecteur bloqué %u fois (%.1f ms), émetteur bloqué %u fois (%.1f ms) -> goulot: %s",
+                 (unsigned)ts.reader_stalls, ts.reader_wait_us / 1000.0f,
+                 (unsigned)ts.sender_stalls, ts.sender_wait_us / 1000.0f, ts.bottleneck());
+        pipeline.reset();
+    }
+    buffer.release();
+    if (file) fclose(file);
     
     unsigned long end_time = esp_timer_get_time() / 1000;
     float total_time = (end_time - start_time) / 1000.0f;
-    float avg_speed = (total_sent / 1024.0f / 1024.0f) / total_time;  // MB/s
-    
-    // Afficher les infos mémoire après le transfert
-    ESP_LOGI(TAG, "Mémoire après transfert - Heap interne: %zu, PSRAM: %zu", 
-        heap_caps_get_free_size(MALLOC_CAP_INTERNAL), 
-        heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    float avg_speed = total_time > 0 ? (total_sent / 1024.0f / 1024.0f) / total_time : 0.0f;  // MB/s
     
     if (err == ESP_OK) {
-        // Fermer la réponse avec un chunk vide
-        err = httpd_resp_send_chunk(req, NULL, 0);
-        ESP_LOGI(TAG, "Fichier envoyé avec succès: %zu octets en %.2f secondes (%.2f MB/s, buffer en %s)", 
-                total_sent, total_time, avg_speed, using_psram ? "PSRAM" : "RAM interne");
+        ESP_LOGI(TAG, "Fichier envoyé avec succès: %zu octets en %.2f secondes (%.2f MB/s)", 
+                total_sent, total_time, avg_speed);
     } else {
         ESP_LOGE(TAG, "Erreur lors de l'envoi du fichier: %d (total envoyé: %zu/%zu octets, %.2f MB/s)",
-                err, total_sent, (size_t)st.st_size, avg_speed);
+                err, total_sent, body_size, avg_speed);
     }
     
     return err;
 }
 
-float WebDAVBox3::benchmark_sd_read(const std::string &filepath) {
-    FILE *file = fopen(filepath.c_str(), "rb");
-    if (!file) {
-        ESP_LOGE(TAG, "Erreur ouverture %s", filepath.c_str());
-        return 0.0;
+esp_err_t WebDAVBox3::send_file_window_pipelined(httpd_req_t *req, ReadAheadPipeline &pipeline, FILE *file,
+                                                 size_t offset, size_t length, size_t &total_sent,
+                                                 BandwidthFlow *flow) {
+  esp_err_t err = pipeline.start(file, offset, length);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  const char *data;
+  size_t len;
+  while (pipeline.acquire(&data, &len)) {
+    // Le lecteur continue de remplir l'anneau pendant l'attente
+    if (flow) flow->consume(len);
+    err = send_raw(req, data, len);
+    pipeline.release();
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Erreur d'envoi du chunk (%zu bytes): %d", len, err);
+      pipeline.stop();
+      return err;
     }
+    total_sent += len;
+  }
+  return pipeline.has_error() ? ESP_FAIL : ESP_OK;
+}
 
-    // Utiliser un buffer plus grand grâce à la PSRAM
-    const size_t CHUNK = 65536;  // 64K au lieu de 8K
+// HEAD : uniquement stat(), le fichier n'est jamais ouvert. httpd_resp_send()
+// imposerait Content-Length: 0, les en-têtes sont donc écrits directement.
+esp_err_t WebDAVBox3::handle_webdav_head(httpd_req_t *req) {
+    auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
+    RequestContext ctx(&inst->arenas_);
+    if (!ctx.resolve(req, inst->root_path_)) {
+        return send_invalid_path(req);
+    }
     
-    // Essayer d'allouer en PSRAM d'abord
-    char *buf = NULL;
-    bool using_psram = false;
+    if (!ctx.exists()) {
+        ESP_LOGD(TAG, "HEAD: chemin non trouvé: %s", ctx.path().c_str());
+        inst->note_missing_probe(req);
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+    }
+    std::string path = ctx.path();
+    struct stat st = *ctx.get_stat();
     
-    if (heap_caps_get_free_size(MALLOC_CAP_SPIRAM) > CHUNK) {
-        buf = (char*)heap_caps_malloc(CHUNK, MALLOC_CAP_SPIRAM);
-        using_psram = true;
+    const char *content_type = S_ISDIR(st.st_mode) ? "httpd/unix-directory" : content_type_for(path.c_str());
+    const char *content_encoding = nullptr;
+    if (!S_ISDIR(st.st_mode) && inst->is_compressible(path)) {
+        content_encoding = select_encoded_variant(req, path, st);
     }
     
-    // Si pas de PSRAM disponible, fallback sur la mémoire interne
-    if (!buf) {
-        buf = (char*)heap_caps_malloc(CHUNK, MALLOC_CAP_8BIT);
-        using_psram = false;
+    ConditionalResult cond = evaluate_preconditions(req, &st);
+    if (cond != COND_OK) {
+        return send_conditional_response(req, cond, &st);
+    }
+    
+    // Envoi par morceaux en cours : reçu jusqu'ici et taille attendue
+    char upload_hdr[80] = {0};
+    size_t upload_total;
+    if (!S_ISDIR(st.st_mode) && inst->partial_uploads_.lookup(path, upload_total)) {
+        snprintf(upload_hdr, sizeof(upload_hdr), "Upload-Offset: %zu\r\nUpload-Length: %zu\r\n", (size_t) st.st_size,
+                 upload_total);
+    }
+    
+    char headers[512];
+    size_t len = format_head_headers(st, content_type, headers, sizeof(headers), content_encoding,
+                                     upload_hdr[0] != '\0' ? upload_hdr : nullptr);
+    if (len == 0) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Server Error");
     }
     
+    ESP_LOGD(TAG, "HEAD %s (%zu octets)", path.c_str(), (size_t)st.st_size);
+    return send_raw(req, headers, len);
+}
+
+float WebDAVBox3::benchmark_head(const std::string &filepath, int iterations) {
+    // Mesure le travail côté serveur d'un HEAD (stat + construction des en-têtes) ;
+    // le résultat doit rester constant quelle que soit la taille du fichier
+    if (iterations <= 0) iterations = 100;
+    
+    struct stat st;
+    if (stat(filepath.c_str(), &st) != 0) {
+        ESP_LOGE(TAG, "Erreur stat %s", filepath.c_str());
+        return 0.0;
+    }
+    
+    char headers[448];
+    size_t len = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        stat(filepath.c_str(), &st);
+        len = format_head_headers(st, content_type_for(filepath.c_str()), headers, sizeof(headers));
+    }
+    int64_t end = esp_timer_get_time();
+    
+    float avg_us = (float)(end - start) / iterations;
+    ESP_LOGI(TAG, "Benchmark HEAD: %s (%zu octets) -> %.1f us/requête (%d itérations, %zu octets d'en-têtes)",
+             filepath.c_str(), (size_t)st.st_size, avg_us, iterations, len);
+    return avg_us;
+}
+
+float WebDAVBox3::benchmark_sd_read(const std::string &filepath) {
+    FILE *file = fopen(filepath.c_str(), "rb");
+    if (!file) {
+        ESP_LOGE(TAG, "Erreur ouverture %s", filepath.c_str());
+        return 0.0;
+    }
+
+    // Même buffer que les transferts GET (64K)
+    TransferBuffer buf = buffer_pool_.borrow(65536, pdMS_TO_TICKS(buffer_timeout_ms_));
     if (!buf) {
         fclose(file);
-        ESP_LOGE(TAG, "Erreur allocation mémoire");
+        ESP_LOGE(TAG, "Aucun buffer de transfert disponible");
         return 0.0;
     }
 
@@ -929,41 +2137,217 @@ float WebDAVBox3::benchmark_sd_read(const std::string &filepath) {
     size_t r = 0;
     unsigned long start = esp_timer_get_time();
 
-    while ((r = fread(buf, 1, CHUNK, file)) > 0) {
+    while ((r = fread(buf.data(), 1, buf.size(), file)) > 0) {
         total += r;
     }
 
     unsigned long end = esp_timer_get_time();
-    heap_caps_free(buf);
+    size_t buf_size = buf.size();
+    buf.release();
     fclose(file);
 
     float elapsed = (end - start) / 1e6f;
     float mbps = (total / 1024.0f / 1024.0f) / elapsed;
 
-    ESP_LOGI(TAG, "Benchmark SD: %.2f MB lus en %.2f s (%.2f MB/s) avec buffer en %s", 
-             total / 1048576.0f, elapsed, mbps, using_psram ? "PSRAM" : "RAM interne");
+    ESP_LOGI(TAG, "Benchmark SD: %.2f MB lus en %.2f s (%.2f MB/s) avec un buffer de %zu octets", 
+             total / 1048576.0f, elapsed, mbps, buf_size);
     return mbps;
 }
-esp_err_t WebDAVBox3::handle_webdav_get_small_file(httpd_req_t *req, const std::string &path, size_t file_size) {
-    // Cette méthode est pour les fichiers jusqu'à 8MB
-    const size_t MAX_FILE_SIZE = 8 * 1024 * 1024; // 8 Mo
+// Ancien parcours de PROPFIND, conservé comme référence pour le benchmark
+static size_t list_with_stat(const std::string &dir_path) {
+  size_t count = 0;
+  DIR *dir = opendir(dir_path.c_str());
+  if (dir == nullptr) return 0;
+  struct dirent *entry;
+  struct stat st;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    if (stat((dir_path + "/" + entry->d_name).c_str(), &st) == 0) count++;
+  }
+  closedir(dir);
+  return count;
+}
+
+float WebDAVBox3::benchmark_listing(const std::string &dirpath, int max_entries) {
+    // Répertoire de test rempli progressivement : 10, 100, ... max_entries fichiers vides
+    std::string bench_dir = dirpath;
+    if (bench_dir.back() == '/') bench_dir.pop_back();
+    bench_dir += "/.webdav_bench";
+    if (mkdir(bench_dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        ESP_LOGE(TAG, "Impossible de créer %s (errno: %d)", bench_dir.c_str(), errno);
+        return 0.0f;
+    }
+
+    int created = 0;
+    float last_us_per_entry = 0.0f;
+    char name[32];
+    for (int target = 10; ; target = std::min(target * 10, max_entries)) {
+        for (; created < target; created++) {
+            snprintf(name, sizeof(name), "/file_%05d.dat", created);
+            FILE *f = fopen((bench_dir + name).c_str(), "wb");
+            if (f == nullptr) break;
+            fclose(f);
+        }
+
+        int64_t t0 = esp_timer_get_time();
+        DirectoryReader reader;
+        DirEntry entry;
+        size_t single_pass = 0;
+        if (reader.open(bench_dir)) {
+            while (reader.next(entry)) single_pass++;
+            reader.close();
+        }
+        int64_t t1 = esp_timer_get_time();
+        size_t with_stat = list_with_stat(bench_dir);
+        int64_t t2 = esp_timer_get_time();
+
+        last_us_per_entry = single_pass > 0 ? (float)(t1 - t0) / single_pass : 0.0f;
+        ESP_LOGI(TAG, "Benchmark listing: %5zu entrées -> une passe %.1f ms (%.0f us/entrée), readdir+stat %.1f ms (%zu)",
+                 single_pass, (t1 - t0) / 1000.0f, last_us_per_entry, (t2 - t1) / 1000.0f, with_stat);
+
+        if (target >= max_entries || created < target) break;
+    }
+
+    for (int i = 0; i < created; i++) {
+        snprintf(name, sizeof(name), "/file_%05d.dat", i);
+        unlink((bench_dir + name).c_str());
+    }
+    rmdir(bench_dir.c_str());
+    return last_us_per_entry;
+}
+
+// Ancienne résolution (sscanf par échappement, stat() dans get_file_path puis
+// dans le gestionnaire), conservée comme référence pour le benchmark ; les
+// quatre ESP_LOGI qu'elle émettait ne sont pas comptés
+static bool resolve_with_sscanf(const std::string &root_path, const char *uri) {
+  std::string decoded;
+  const char *str = uri;
+  int i = 0;
+  int j;
+  while (str[i]) {
+    if (str[i] == '%' && str[i + 1] && str[i + 2] && sscanf(str + i + 1, "%2x", &j) == 1) {
+      decoded += static_cast<char>(j);
+      i += 3;
+    } else {
+      decoded += str[i] == '+' ? ' ' : str[i];
+      i++;
+    }
+  }
+  std::string path = root_path;
+  if (path.back() != '/') path += '/';
+  if (!decoded.empty() && decoded.front() == '/') decoded = decoded.substr(1);
+  path += decoded;
+  struct stat st;
+  stat(path.c_str(), &st);
+  return stat(path.c_str(), &st) == 0;
+}
+
+float WebDAVBox3::benchmark_request(const std::string &uri, int iterations) {
+    if (iterations <= 0) iterations = 1000;
+
+    int64_t t0 = esp_timer_get_time();
+    int found_before = 0;
+    for (int i = 0; i < iterations; i++) {
+        if (resolve_with_sscanf(this->root_path_, uri.c_str())) found_before++;
+    }
+    int64_t t1 = esp_timer_get_time();
+    int found_after = 0;
+    for (int i = 0; i < iterations; i++) {
+        RequestContext ctx;
+        if (ctx.resolve_uri(uri.c_str(), strcspn(uri.c_str(), "?"), this->root_path_) && ctx.exists()) found_after++;
+    }
+    int64_t t2 = esp_timer_get_time();
+
+    float before_us = (float)(t1 - t0) / iterations;
+    float after_us = (float)(t2 - t1) / iterations;
+    ESP_LOGI(TAG, "Benchmark requête %s (%d itérations): avant %.1f us, après %.1f us par requête (%s)", uri.c_str(),
+             iterations, before_us, after_us, found_before == found_after ? "mêmes résultats" : "RÉSULTATS DIFFÉRENTS");
+    return after_us;
+}
 
-    if (file_size > MAX_FILE_SIZE) {
-        return ESP_FAIL;  // Trop grand, utiliser la méthode standard
+float WebDAVBox3::benchmark_upload(const std::string &dirpath, int size_mb) {
+    if (size_mb <= 0) size_mb = 16;
+    const size_t total = (size_t) size_mb * 1048576;
+
+    // Remplissage de la carte : la fragmentation pénalise surtout l'ancien parcours.
+    // Même volume que l'admission des envois (lecteur déduit de la racine)
+    FATFS *fs;
+    DWORD free_clusters = 0;
+    float fill = 0.0f;
+    const std::string &drive = storage_.get_fatfs_drive();
+    if (!drive.empty() && f_getfree(drive.c_str(), &free_clusters, &fs) == FR_OK && fs->n_fatent > 2) {
+        fill = 100.0f * (1.0f - (float) free_clusters / (fs->n_fatent - 2));
+    }
+
+    TransferBuffer buf = buffer_pool_.borrow(65536, pdMS_TO_TICKS(buffer_timeout_ms_));
+    if (!buf) {
+        ESP_LOGE(TAG, "Aucun buffer de transfert disponible");
+        return 0.0f;
+    }
+    memset(buf.data(), 0xA5, buf.size());
+
+    std::string dir = dirpath;
+    if (dir.back() == '/') dir.pop_back();
+    const std::string before_path = dir + "/.webdav_bench_put_a.dat";
+    const std::string after_path = dir + "/.webdav_bench_put_b.dat";
+
+    // Avant : écriture directe de la cible, morceaux de 16K, allocation au fil de l'eau
+    float before_mbps = 0.0f;
+    int64_t t0 = esp_timer_get_time();
+    FILE *f = fopen(before_path.c_str(), "wb");
+    if (f != nullptr) {
+        size_t written = 0;
+        while (written < total && fwrite(buf.data(), 1, 16384, f) == 16384) written += 16384;
+        bool ok = fclose(f) == 0 && written == total;
+        int64_t elapsed = esp_timer_get_time() - t0;
+        if (ok && elapsed > 0) before_mbps = (total / 1048576.0f) / (elapsed / 1e6f);
+    }
+
+    // Après : temporaire préalloué, écritures de 64K sans tampon stdio, renommage
+    float after_mbps = 0.0f;
+    bool preallocated = false;
+    t0 = esp_timer_get_time();
+    {
+        UploadFile upload;
+        if (upload.open(upload_dir_, upload_seq_++, after_path, total)) {
+            preallocated = upload.is_preallocated();
+            size_t written = 0;
+            while (written < total && fwrite(buf.data(), 1, buf.size(), upload.file()) == buf.size())
+                written += buf.size();
+            bool ok = written == total && upload.commit(written);
+            int64_t elapsed = esp_timer_get_time() - t0;
+            if (ok && elapsed > 0) after_mbps = (total / 1048576.0f) / (elapsed / 1e6f);
+        }
+    }
+    buf.release();
+    unlink(before_path.c_str());
+    unlink(after_path.c_str());
+
+    ESP_LOGI(TAG, "Benchmark PUT: %d Mo, carte remplie à %.0f%% -> avant %.2f Mo/s, après %.2f Mo/s (%s)", size_mb,
+             fill, before_mbps, after_mbps, preallocated ? "préalloué" : "sans préallocation");
+    return after_mbps;
+}
+
+std::shared_ptr<const uint8_t> WebDAVBox3::load_small_file(const std::string &path, const struct stat &st) {
+    const size_t file_size = (size_t)st.st_size;
+    std::shared_ptr<const uint8_t> data = this->file_cache_.lookup(path, st.st_mtime, file_size);
+    if (data) {
+        ESP_LOGD(TAG, "Cache: %s servi depuis la PSRAM", path.c_str());
+        return data;
     }
     
     // Allouer un buffer pour tout le fichier
     uint8_t *buffer = (uint8_t *)heap_caps_malloc(file_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
     if (!buffer) {
-        ESP_LOGE(TAG, "Impossible d'allouer de la mémoire pour le fichier (%zu octets)", file_size);
-        return ESP_FAIL;
+        ESP_LOGW(TAG, "Impossible d'allouer de la mémoire pour le fichier (%zu octets)", file_size);
+        return nullptr;
     }
     
     // Ouvrir et lire le fichier
     FILE *file = fopen(path.c_str(), "rb");
     if (!file) {
         heap_caps_free(buffer);
-        return ESP_FAIL;
+        return nullptr;
     }
     
     size_t bytes_read = fread(buffer, 1, file_size, file);
@@ -972,127 +2356,342 @@ esp_err_t WebDAVBox3::handle_webdav_get_small_file(httpd_req_t *req, const std::
     if (bytes_read != file_size) {
         ESP_LOGE(TAG, "Échec de lecture du fichier complet: %zu/%zu", bytes_read, file_size);
         heap_caps_free(buffer);
-        return ESP_FAIL;
+        return nullptr;
     }
     
-    // Envoyer le contenu en une seule fois
-    esp_err_t ret = httpd_resp_send(req, (const char*)buffer, bytes_read);
-    heap_caps_free(buffer);
-    
-    ESP_LOGI(TAG, "Fichier envoyé en une fois: %zu octets, résultat: %d", bytes_read, ret);
-    return ret;
+    data = std::shared_ptr<const uint8_t>(buffer, [](const uint8_t *p) { heap_caps_free((void *)p); });
+    this->file_cache_.insert(path, st.st_mtime, file_size, data);
+    return data;
 }
 
-// Corrected PUT handler with chunked transfer support
+void WebDAVBox3::invalidate_cached_path(const std::string &path) {
+    this->file_cache_.invalidate(path);
+    this->file_cache_.invalidate_prefix(path);
+    this->dir_cache_.invalidate_path(path);
+    std::string rel = this->relative_path(path);
+    if (!rel.empty()) this->probes_.invalidate("/" + rel);
+    this->partial_uploads_.forget(path);
+    if (this->precompressor_ != nullptr) this->precompressor_->forget(path);
+}
 
+// Chemin relatif à la racine WebDAV, vide hors de la racine ou pour les
+// fichiers internes du serveur
+std::string WebDAVBox3::relative_path(const std::string &path) const {
+    std::string root = this->root_path_;
+    while (!root.empty() && root.back() == '/') root.pop_back();
+    if (path.compare(0, root.size(), root) != 0 || path.size() <= root.size() + 1 || path[root.size()] != '/') {
+        return "";
+    }
+    std::string rel = path.substr(root.size() + 1);
+    while (!rel.empty() && rel.back() == '/') rel.pop_back();
+    if (rel.compare(0, sizeof(STATE_DIR) - 1, STATE_DIR) == 0 &&
+        (rel.size() == sizeof(STATE_DIR) - 1 || rel[sizeof(STATE_DIR) - 1] == '/')) {
+        return "";
+    }
+    return rel;
+}
 
-esp_err_t WebDAVBox3::handle_webdav_put(httpd_req_t *req) {
-    auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
-    std::string path = get_file_path(req, inst->root_path_);
+void WebDAVBox3::record_change(JournalOp op, const std::string &path) {
+    // Les PUT ajustent place libre et quotas eux-mêmes ; ailleurs les tailles sont inconnues
+    if (op != JOURNAL_PUT && op != JOURNAL_MKCOL) this->storage_.invalidate(path);
+    if (!this->journal_.is_open()) return;
+    std::string rel = this->relative_path(path);
+    if (!rel.empty()) this->journal_.append(op, rel);
+}
 
-    ESP_LOGI(TAG, "===== PUT REQUEST HEADERS =====");
+// ========== ADMISSION DES ENVOIS ==========
 
-    char expect_hdr[32];
-    if (httpd_req_get_hdr_value_str(req, "Expect", expect_hdr, sizeof(expect_hdr)) == ESP_OK) {
-        if (strcasecmp(expect_hdr, "100-continue") == 0) {
-            ESP_LOGI(TAG, "Client expects 100-continue");
-            httpd_resp_set_status(req, "100 Continue");
-            httpd_resp_send(req, NULL, 0);  // Send empty body
-        }
+// Refus d'un envoi avant son corps : la connexion est fermée au lieu d'être
+// vidée par httpd, aucun octet du corps ne transite ni n'atteint la carte
+static esp_err_t reject_upload(httpd_req_t *req, const char *status, const char *message) {
+    if (req->content_len > 0) httpd_resp_set_hdr(req, "Connection", "close");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_send_custom_err(req, status, message);
+    return req->content_len > 0 ? ESP_FAIL : ESP_OK;
+}
+
+// Basic : comparaison en temps constant avec base64(utilisateur:mot de passe)
+bool WebDAVBox3::authenticate(httpd_req_t *req) {
+    if (!this->auth_enabled_) return true;
+    char header[256];
+    if (httpd_req_get_hdr_value_str(req, "Authorization", header, sizeof(header)) != ESP_OK) return false;
+    if (strncasecmp(header, "Basic ", 6) != 0) return false;
+    const char *given = header + 6;
+    while (*given == ' ') given++;
+    size_t given_len = strlen(given);
+    while (given_len > 0 && given[given_len - 1] == ' ') given_len--;
+
+    const std::string credentials = this->username_ + ":" + this->password_;
+    unsigned char expected[256];
+    size_t expected_len = 0;
+    if (mbedtls_base64_encode(expected, sizeof(expected), &expected_len,
+                              reinterpret_cast<const unsigned char *>(credentials.data()), credentials.size()) != 0) {
+        return false;
     }
+    if (given_len != expected_len) return false;
+    uint8_t diff = 0;
+    for (size_t i = 0; i < expected_len; i++) diff |= (uint8_t) given[i] ^ expected[i];
+    return diff == 0;
+}
 
-    // Vérification Expect: 100-continue
-    char expect_val[64] = {0};
-    if (httpd_req_get_hdr_value_len(req, "Expect") > 0) {
-        httpd_req_get_hdr_value_str(req, "Expect", expect_val, sizeof(expect_val));
-        if (strcasecmp(expect_val, "100-continue") == 0) {
-            ESP_LOGI(TAG, "Sending 100-continue response");
-            httpd_resp_set_status(req, "100 Continue");
-            httpd_resp_send(req, "", 0);
-            // continue quand même l’exécution
-        }
+esp_err_t WebDAVBox3::send_auth_required_response(httpd_req_t *req) {
+    // Seuls les envois refusés comptent dans les statistiques d'admission ;
+    // un GET ou un PROPFIND sans identifiants est la première étape normale
+    if ((req->method == HTTP_PUT || req->method == HTTP_PATCH) && req->content_len > 0) {
+        this->storage_.note_rejected_auth(req->content_len);
     }
+    httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"WebDAVBox3\", charset=\"UTF-8\"");
+    return reject_upload(req, "401 Unauthorized", "Authentication required");
+}
 
-    // Détection du mode chunked
-    bool is_chunked = false;
-    char transfer_encoding[64] = {0};
-    if (httpd_req_get_hdr_value_len(req, "Transfer-Encoding") > 0) {
-        httpd_req_get_hdr_value_str(req, "Transfer-Encoding", transfer_encoding, sizeof(transfer_encoding));
-        if (strcasecmp(transfer_encoding, "chunked") == 0) {
-            is_chunked = true;
-        }
+// Place libre et quotas, avant tout octet du corps. false : refus déjà
+// envoyé, résultat dans result
+bool WebDAVBox3::admit_upload(httpd_req_t *req, const std::string &path, uint64_t space, int64_t quota_delta,
+                              StorageReservation &reservation, esp_err_t &result) {
+    const QuotaInfo *quota = nullptr;
+    switch (this->storage_.reserve(path, space, quota_delta, reservation, &quota)) {
+        case ADMIT_NO_SPACE:
+            ESP_LOGW(TAG, "Envoi refusé, place insuffisante: %s (%llu octets)", path.c_str(),
+                     (unsigned long long) space);
+            result = reject_upload(req, "507 Insufficient Storage", "Insufficient storage");
+            return false;
+        case ADMIT_QUOTA:
+            ESP_LOGW(TAG, "Envoi refusé, quota de %s atteint: %s", quota->path.c_str(), path.c_str());
+            result = reject_upload(req, "507 Insufficient Storage", "Quota exceeded");
+            return false;
+        default:
+            break;
     }
 
-    ESP_LOGI(TAG, "PUT %s (URI: %s)", path.c_str(), req->uri);
-    ESP_LOGI(TAG, "Content length: %d bytes", req->content_len);
+    return true;
+}
 
-    // Ne pas écraser un dossier
-    struct stat st;
-    if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
-        return httpd_resp_send_err(req, HTTPD_405_METHOD_NOT_ALLOWED, "Cannot overwrite directory");
+// Le client attend l'accord avant d'envoyer le corps : envoyé une seule fois,
+// quand fichier et buffers sont prêts
+static bool send_continue_if_expected(httpd_req_t *req) {
+    char expect[32];
+    if (httpd_req_get_hdr_value_str(req, "Expect", expect, sizeof(expect)) != ESP_OK ||
+        strcasecmp(expect, "100-continue") != 0) {
+        return true;
     }
+    // Réponse intermédiaire écrite à la main : httpd_resp_send() clôturerait la requête
+    static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    return send_raw(req, CONTINUE, sizeof(CONTINUE) - 1) == ESP_OK;
+}
 
-    // Création récursive du dossier parent
+// Création récursive du dossier parent d'un fichier à écrire
+bool WebDAVBox3::ensure_parent_directory(const std::string &path) {
     size_t last_slash = path.find_last_of('/');
-    if (last_slash != std::string::npos) {
-        std::string dir_path = path.substr(0, last_slash);
-        struct stat dir_stat;
-        if (stat(dir_path.c_str(), &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode)) {
-            if (!create_directories_util(dir_path)) {
-                return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to create parent directory");
-            }
-        }
+    if (last_slash == std::string::npos) return true;
+    std::string dir_path = path.substr(0, last_slash);
+    struct stat dir_stat;
+    if (stat(dir_path.c_str(), &dir_stat) == 0 && S_ISDIR(dir_stat.st_mode)) return true;
+    if (!create_directories_util(dir_path)) return false;
+    // Le premier ancêtre existant a gagné un enfant, sans savoir lequel
+    for (std::string p = dir_path; p.size() > this->root_path_.size(); p = p.substr(0, p.find_last_of('/'))) {
+        this->dir_cache_.invalidate_path(p);
+        this->record_change(JOURNAL_MKCOL, p);
     }
+    return true;
+}
 
-    // Ouverture du fichier en écriture
-    FILE *file = fopen(path.c_str(), "wb");
-    if (!file) {
-        ESP_LOGE(TAG, "Cannot open file: %s (errno=%d)", path.c_str(), errno);
-        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open file");
+// Corps d'un PUT ou d'un PATCH écrit dans file à sa position courante.
+// Gros corps : réception et écriture SD en parallèle, la tâche d'écriture
+// vide des buffers PSRAM pleins ; petits corps : un seul buffer. En cas
+// d'échec, le fichier contient un préfixe exact de ce qui a été reçu.
+WebDAVBox3::BodyReceipt WebDAVBox3::receive_body(httpd_req_t *req, FILE *file) {
+    BodyReceipt body;
+    const TickType_t buffer_timeout = pdMS_TO_TICKS(this->buffer_timeout_ms_);
+    const size_t chunk = this->chunk_size_ > 0 ? this->chunk_size_ : UPLOAD_CHUNK_SIZE;
+    std::unique_ptr<WriteBehindPipeline> pipeline;
+    if (this->write_behind_depth_ >= 2 && req->content_len > 2 * chunk) {
+        pipeline.reset(new WriteBehindPipeline(this->buffer_pool_, this->write_behind_depth_, chunk));
+        if (!pipeline->init(buffer_timeout) || pipeline->start(file) != ESP_OK) {
+            ESP_LOGW(TAG, "Écriture différée indisponible, réception séquentielle");
+            pipeline.reset();
+        }
+    }
+    TransferBuffer buffer;
+    if (!pipeline) {
+        buffer = this->buffer_pool_.borrow(16384, buffer_timeout);
+        if (!buffer) {
+            body.busy = true;
+            return body;
+        }
+    }
+    if (!send_continue_if_expected(req)) {
+        body.failure = "Socket error";
+        if (pipeline) pipeline->stop();
+        return body;
     }
 
-    // Lecture des données
-    char buffer[4096];
-    int total_received = 0;
+    UploadStats &stats = body.stats;
     int timeout_count = 0;
+    bool eof = false;
+    const char *&failure = body.failure;
+
+    while (!eof && failure == nullptr) {
+        char *data;
+        size_t capacity;
+        if (pipeline) {
+            // Bloque tant que la carte n'a pas rendu de buffer : contre-pression
+            if (!pipeline->acquire(&data, &capacity)) {
+                failure = "Write error";
+                break;
+            }
+        } else {
+            data = buffer.data();
+            capacity = buffer.size();
+        }
 
-    while (true) {
-        int received = httpd_req_recv(req, buffer, sizeof(buffer));
-
-        if (received < 0) {
+        // Un buffer n'est écrit qu'une fois plein, ou en fin de corps
+        size_t filled = 0;
+        while (filled < capacity) {
+            int received = recv_body(req, data + filled, capacity - filled, timeout_count);
             if (received == HTTPD_SOCK_ERR_TIMEOUT) {
-                if (++timeout_count >= 5) {
-                    ESP_LOGE(TAG, "Too many timeouts, aborting");
-                    fclose(file);
-                    return httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Timeout");
-                }
-                continue;
-            } else {
+                ESP_LOGE(TAG, "Too many timeouts, aborting");
+                body.failure_code = HTTPD_408_REQ_TIMEOUT;
+                failure = "Timeout";
+                break;
+            }
+            if (received < 0) {
                 ESP_LOGE(TAG, "Socket error: %d", received);
-                fclose(file);
-                unlink(path.c_str());
-                return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Socket error");
+                failure = "Socket error";
+                break;
+            }
+            if (received == 0) {
+                ESP_LOGD(TAG, "End of data stream");
+                eof = true;
+                break;
+            }
+            filled += received;
+        }
+        if (failure != nullptr) break;
+
+        if (pipeline) {
+            pipeline->commit(filled);
+        } else if (filled > 0) {
+            int64_t write_start = esp_timer_get_time();
+            size_t written = fwrite(data, 1, filled, file);
+            stats.write_us += esp_timer_get_time() - write_start;
+            stats.writes++;
+            if (written != filled) {
+                ESP_LOGE(TAG, "Write error: wrote %zu / %zu", written, filled);
+                failure = "Write error";
+                break;
             }
         }
+        body.received += filled;
+    }
 
-        if (received == 0) {
-            ESP_LOGI(TAG, "End of data stream");
-            break;
+    if (pipeline) {
+        if (failure != nullptr) {
+            pipeline->stop();
+        } else if (!pipeline->finish()) {
+            failure = "Write error";
         }
+        stats = pipeline->get_stats();
+    }
+    return body;
+}
 
-        size_t written = fwrite(buffer, 1, received, file);
-        if (written != received) {
-            ESP_LOGE(TAG, "Write error: wrote %zu / %d", written, received);
-            fclose(file);
-            unlink(path.c_str());
-            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Write error");
+// Corrected PUT handler with chunked transfer support
+
+
+esp_err_t WebDAVBox3::handle_webdav_put(httpd_req_t *req) {
+    auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
+    esp_err_t probe_result;
+    if (inst->probes_.is_enabled() && inst->store_probe_put(req, probe_result)) {
+        return probe_result;
+    }
+    RequestContext ctx(&inst->arenas_);
+    if (!ctx.resolve(req, inst->root_path_)) {
+        return reject_upload(req, "400 Bad Request", "Invalid path");
+    }
+    const std::string &path = ctx.path();
+
+    ESP_LOGI(TAG, "PUT %s (URI: %s)", path.c_str(), req->uri);
+    ESP_LOGI(TAG, "Content length: %d bytes", req->content_len);
+
+    // Tout refus intervient avant le corps (voir admit_upload)
+    const struct stat *existing = ctx.get_stat();
+    if (ctx.is_dir()) {
+        return reject_upload(req, "405 Method Not Allowed", "Cannot overwrite directory");
+    }
+    
+    // If-Match / If-None-Match: * : protège contre l'écrasement concurrent
+    ConditionalResult cond = evaluate_preconditions(req, existing);
+    if (cond != COND_OK) {
+        ESP_LOGW(TAG, "PUT refusé par précondition: %s", path.c_str());
+        return reject_upload(req, "412 Precondition Failed", "Precondition Failed");
+    }
+
+    // Reprise ou envoi par morceaux : écriture en place à l'offset annoncé
+    char content_range[96];
+    if (httpd_req_get_hdr_value_str(req, "Content-Range", content_range, sizeof(content_range)) == ESP_OK) {
+        UpdateRange range;
+        if (parse_content_range(content_range, req->content_len, range) != UPDATE_RANGE_OK) {
+            return reject_upload(req, "400 Bad Request", "Invalid Content-Range");
         }
+        return write_range(req, ctx, range);
+    }
 
-        total_received += received;
+    if (!inst->ensure_parent_directory(path)) {
+        return reject_upload(req, "409 Conflict", "Failed to create parent directory");
     }
 
-    fclose(file);
-    ESP_LOGI(TAG, "✅ Upload complete: %s (%d bytes)", path.c_str(), total_received);
+    // Le temporaire occupe Content-Length à côté de l'ancienne version
+    const size_t replaced = existing != nullptr ? (size_t) existing->st_size : 0;
+    StorageReservation reservation;
+    esp_err_t admission;
+    if (!inst->admit_upload(req, path, req->content_len, (int64_t) req->content_len - (int64_t) replaced, reservation,
+                            admission)) {
+        return admission;
+    }
+
+    // Corps écrit à côté, préalloué à Content-Length : la version en place
+    // reste servie (et en cache) jusqu'au renommage final
+    UploadFile upload;
+    if (!upload.open(inst->upload_dir_, inst->upload_seq_++, path, req->content_len)) {
+        return reject_upload(req, "500 Internal Server Error", "Failed to open file");
+    }
+
+    const int64_t start_us = esp_timer_get_time();
+    BodyReceipt body = inst->receive_body(req, upload.file());
+    if (body.busy) {
+        upload.abort();
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return reject_upload(req, "503 Service Unavailable", "Server busy");
+    }
+    if (body.failure == nullptr && !upload.commit(body.received)) {
+        body.failure = "Write error";
+    }
+    if (body.failure != nullptr) {
+        // Temporaire supprimé, l'ancienne version est intacte
+        upload.abort();
+        return httpd_resp_send_err(req, body.failure_code, body.failure);
+    }
+
+    const size_t total_received = body.received;
+    reservation.commit((int64_t) total_received - (int64_t) replaced);
+    UploadStats &stats = body.stats;
+    stats.bytes = total_received;
+    stats.elapsed_us = esp_timer_get_time() - start_us;
+    inst->last_upload_stats_ = stats;
+    ESP_LOGI(TAG, "✅ Upload complete: %s (%zu bytes, %.1f ms, %.0f KB/s%s)", path.c_str(), total_received,
+             stats.elapsed_us / 1000.0f, stats.throughput_kbps(), upload.is_preallocated() ? ", préalloué" : "");
+    ESP_LOGI(TAG, "   Écriture SD: %u appels, %.1f ms ; réception bloquée %u fois (%.1f ms), écrivain en attente %u fois (%.1f ms) -> goulot: %s",
+             (unsigned) stats.writes, stats.write_us / 1000.0f, (unsigned) stats.receiver_stalls,
+             stats.receiver_wait_us / 1000.0f, (unsigned) stats.writer_stalls, stats.writer_wait_us / 1000.0f,
+             stats.bottleneck());
+    
+    // Nouveau contenu en place : caches invalidés une seule fois
+    inst->invalidate_cached_path(path);
+    inst->record_change(JOURNAL_PUT, path);
+    
+    if (inst->precompressor_ != nullptr && inst->is_compressible(path)) {
+        inst->precompressor_->request_scan();
+    }
 
     // Réponse HTTP
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
@@ -1102,47 +2701,225 @@ esp_err_t WebDAVBox3::handle_webdav_put(httpd_req_t *req) {
     return httpd_resp_sendstr(req, "");
 }
 
+// Morceau d'un envoi écrit en place à range.start. Une mise à jour partielle
+// ne touche pas au reste du fichier ; un envoi par morceaux (taille annoncée)
+// coupe ce qui suit le morceau. Un envoi interrompu garde ce qui a été reçu :
+// la taille du fichier (HEAD, PROPFIND) indique où reprendre.
+esp_err_t WebDAVBox3::write_range(httpd_req_t *req, RequestContext &ctx, const UpdateRange &range) {
+    auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
+    const std::string &path = ctx.path();
+    const struct stat *existing = ctx.get_stat();
+    const size_t current_size = existing != nullptr ? (size_t) existing->st_size : 0;
+    // Envoi par morceaux : premier morceau d'une taille annoncée, ou suite d'un
+    // envoi en cours (avant invalidate_cached_path, qui l'oublie)
+    size_t session_total = 0;
+    const bool chunked = range.total >= 0 && (range.start == 0 || inst->partial_uploads_.lookup(path, session_total));
+
+    // Un trou dans le fichier ne pourrait pas être distingué de données reçues
+    if (range.start > current_size) {
+        char content_range[48];
+        snprintf(content_range, sizeof(content_range), "bytes */%zu", current_size);
+        httpd_resp_set_hdr(req, "Content-Range", content_range);
+        return reject_upload(req, "416 Range Not Satisfiable", "Range Not Satisfiable");
+    }
+    if (existing == nullptr && !inst->ensure_parent_directory(path)) {
+        return reject_upload(req, "409 Conflict", "Failed to create parent directory");
+    }
+
+    // Fin héritée coupée avant l'écriture : au point de reprise pour un envoi
+    // par morceaux, à la taille annoncée pour une nouvelle version plus courte
+    size_t truncate_to = current_size;
+    if (chunked && current_size > range.start) {
+        truncate_to = range.start;
+    } else if (range.total >= 0 && current_size > (size_t) range.total) {
+        truncate_to = (size_t) range.total;
+    }
+    // Taille finale comptée après la troncature ; seule la partie au-delà de
+    // la fin actuelle alloue des clusters
+    const size_t range_end = range.start + range.length;
+    const int64_t delta = (int64_t) std::max(range_end, truncate_to) - (int64_t) current_size;
+    StorageReservation reservation;
+    esp_err_t admission;
+    if (!inst->admit_upload(req, path, (uint64_t) std::max<int64_t>(delta, 0), delta, reservation, admission)) {
+        return admission;
+    }
+
+    FILE *file = fopen(path.c_str(), existing != nullptr ? "r+b" : "wb");
+    if (file == nullptr) {
+        ESP_LOGE(TAG, "Cannot open file: %s (errno=%d)", path.c_str(), errno);
+        return reject_upload(req, "500 Internal Server Error", "Failed to open file");
+    }
+    // Sans tampon stdio avant toute opération : l'anneau d'écriture écrit directement
+    setvbuf(file, nullptr, _IONBF, 0);
+    if (truncate_to < current_size && (fflush(file) != 0 || ftruncate(fileno(file), (off_t) truncate_to) != 0)) {
+        // Une fin restée en place fausserait le point de reprise
+        ESP_LOGE(TAG, "Troncature de %s à %zu impossible (errno: %d)", path.c_str(), truncate_to, errno);
+        fclose(file);
+        return reject_upload(req, "500 Internal Server Error", "Truncate error");
+    }
+    if (fseek(file, range.start, SEEK_SET) != 0) {
+        fclose(file);
+        return reject_upload(req, "500 Internal Server Error", "Seek error");
+    }
+
+    // Le contenu change pendant l'écriture : plus rien ne doit venir des caches
+    inst->invalidate_cached_path(path);
+    BodyReceipt body = inst->receive_body(req, file);
+    if (fclose(file) != 0 && body.failure == nullptr) {
+        body.failure = "Write error";
+    }
+    ctx.forget_stat();
+    inst->invalidate_cached_path(path);
+
+    const size_t size = ctx.exists() ? (size_t) ctx.get_stat()->st_size : 0;
+    reservation.commit((int64_t) size - (int64_t) current_size);
+    // Terminé quand le morceau qui atteint la taille annoncée est arrivé en
+    // entier ; sinon l'envoi reste dans la table (HEAD : Upload-Offset)
+    const bool complete = range.total < 0 || (body.failure == nullptr && !body.busy &&
+                                              body.received == range.length && range_end >= (size_t) range.total);
+    if (!complete) {
+        inst->partial_uploads_.update(path, (size_t) range.total);
+    }
+    if (body.received > 0 || existing == nullptr) {
+        inst->record_change(JOURNAL_PUT, path);
+    }
+    if (body.busy) {
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return reject_upload(req, "503 Service Unavailable", "Server busy");
+    }
+    if (body.failure != nullptr) {
+        ESP_LOGW(TAG, "Morceau interrompu: %s, %zu octets reçus, reprise à %zu", path.c_str(), body.received, size);
+        return httpd_resp_send_err(req, body.failure_code, body.failure);
+    }
+
+    ESP_LOGI(TAG, "Morceau écrit: %s [%zu, +%zu] -> %zu octets%s", path.c_str(), range.start, body.received, size,
+             complete ? "" : " (envoi en cours)");
+    if (complete && inst->precompressor_ != nullptr && inst->is_compressible(path)) {
+        inst->precompressor_->request_scan();
+    }
+
+    char offset[24];
+    snprintf(offset, sizeof(offset), "%zu", size);
+    httpd_resp_set_hdr(req, "Upload-Offset", offset);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_status(req, existing == nullptr ? "201 Created" : "204 No Content");
+    return httpd_resp_send(req, nullptr, 0);
+}
+
+// PATCH partiel de sabre/dav : corps application/x-sabredav-partialupdate,
+// plage dans X-Update-Range
+esp_err_t WebDAVBox3::handle_webdav_patch(httpd_req_t *req) {
+    auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
+    RequestContext ctx(&inst->arenas_);
+    if (!ctx.resolve(req, inst->root_path_)) {
+        return reject_upload(req, "400 Bad Request", "Invalid path");
+    }
+
+    char content_type[64] = {0};
+    httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type));
+    if (strncasecmp(content_type, "application/x-sabredav-partialupdate", 36) != 0) {
+        return reject_upload(req, "415 Unsupported Media Type", "Unsupported Media Type");
+    }
+    if (!ctx.exists()) {
+        return reject_upload(req, "404 Not Found", "File not found");
+    }
+    if (ctx.is_dir()) {
+        return reject_upload(req, "405 Method Not Allowed", "Cannot patch directory");
+    }
+
+    const struct stat *existing = ctx.get_stat();
+    ConditionalResult cond = evaluate_preconditions(req, existing);
+    if (cond != COND_OK) {
+        return reject_upload(req, "412 Precondition Failed", "Precondition Failed");
+    }
+
+    char update_range[64];
+    if (httpd_req_get_hdr_value_str(req, "X-Update-Range", update_range, sizeof(update_range)) != ESP_OK) {
+        return reject_upload(req, "400 Bad Request", "Missing X-Update-Range");
+    }
+    UpdateRange range;
+    switch (parse_update_range(update_range, (size_t) existing->st_size, req->content_len, range)) {
+        case UPDATE_RANGE_OK:
+            break;
+        case UPDATE_RANGE_UNSATISFIABLE:
+            return reject_upload(req, "416 Range Not Satisfiable", "Range Not Satisfiable");
+        default:
+            return reject_upload(req, "400 Bad Request", "Invalid X-Update-Range");
+    }
+    // Envoi en cours : la taille annoncée par le premier Content-Range reste valable
+    size_t total;
+    if (inst->partial_uploads_.lookup(ctx.path(), total)) {
+        range.total = (int64_t) total;
+    }
+    ESP_LOGD(TAG, "PATCH %s à %zu (%zu octets)", ctx.path().c_str(), range.start, range.length);
+    return write_range(req, ctx, range);
+}
+
 esp_err_t WebDAVBox3::handle_webdav_delete(httpd_req_t *req) {
   auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
-  std::string path = get_file_path(req, inst->root_path_);
+  RequestContext ctx(&inst->arenas_);
+  if (!ctx.resolve(req, inst->root_path_)) {
+    return send_invalid_path(req);
+  }
+  const std::string &path = ctx.path();
 
   ESP_LOGD(TAG, "DELETE %s", path.c_str());
   
-  // Vérifier si c'est un répertoire ou un fichier
-  if (is_dir(path)) {
-    // Supprimer le répertoire (doit être vide)
-    if (rmdir(path.c_str()) == 0) {
-      ESP_LOGI(TAG, "Répertoire supprimé: %s", path.c_str());
-      httpd_resp_set_status(req, "204 No Content");
-      httpd_resp_send(req, NULL, 0);
-      return ESP_OK;
-    } else {
-      ESP_LOGE(TAG, "Erreur lors de la suppression du répertoire: %s (errno: %d)", path.c_str(), errno);
-    }
-  } else {
-    // Supprimer le fichier
-    if (remove(path.c_str()) == 0) {
-      ESP_LOGI(TAG, "Fichier supprimé: %s", path.c_str());
-      httpd_resp_set_status(req, "204 No Content");
-      httpd_resp_send(req, NULL, 0);
-      return ESP_OK;
-    } else {
-      ESP_LOGE(TAG, "Erreur lors de la suppression du fichier: %s (errno: %d)", path.c_str(), errno);
-    }
+  const struct stat *existing = ctx.get_stat();
+  ConditionalResult cond = evaluate_preconditions(req, existing);
+  if (cond != COND_OK) {
+    return send_conditional_response(req, cond, existing);
+  }
+  if (existing == nullptr) {
+    return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+  }
+  // Ni la racine ni les fichiers internes du serveur
+  if (inst->relative_path(path).empty()) {
+    return httpd_resp_send_custom_err(req, "403 Forbidden", "Cannot delete this resource");
+  }
+  // Une collection est toujours supprimée avec son contenu (RFC 4918 §9.6.1)
+  char depth[16];
+  if (ctx.is_dir() && httpd_req_get_hdr_value_str(req, "Depth", depth, sizeof(depth)) == ESP_OK &&
+      strcasecmp(depth, "infinity") != 0) {
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid Depth");
+  }
+  
+  inst->invalidate_cached_path(path);
+  
+  // Renommage dans la corbeille : réponse immédiate, clusters libérés en tâche de fond
+  bool deleted = inst->trash_.discard(path);
+  if (!deleted) {
+    // Corbeille indisponible : suppression synchrone
+    deleted = remove_tree(path);
+  }
+  if (!deleted) {
+    ESP_LOGE(TAG, "Erreur lors de la suppression de %s (errno: %d)", path.c_str(), errno);
+    // Un arbre peut être à moitié supprimé
+    inst->dir_cache_.invalidate_path(path);
+    inst->record_change(JOURNAL_DELETE, path);
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Delete failed");
   }
 
-  return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+  ESP_LOGI(TAG, "%s supprimé: %s", ctx.is_dir() ? "Répertoire" : "Fichier", path.c_str());
+  inst->dir_cache_.invalidate_path(path);
+  inst->record_change(JOURNAL_DELETE, path);
+  httpd_resp_set_status(req, "204 No Content");
+  httpd_resp_send(req, NULL, 0);
+  return ESP_OK;
 }
 
 esp_err_t WebDAVBox3::handle_webdav_mkcol(httpd_req_t *req) {
     auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
-    std::string path = get_file_path(req, inst->root_path_);
+    RequestContext ctx(&inst->arenas_);
+    if (!ctx.resolve(req, inst->root_path_)) {
+        return send_invalid_path(req);
+    }
+    const std::string &path = ctx.path();
     
     ESP_LOGI(TAG, "MKCOL %s (URI: %s)", path.c_str(), req->uri);
     
     // Vérifier si le chemin existe déjà
-    struct stat st;
-    if (stat(path.c_str(), &st) == 0) {
+    if (ctx.exists()) {
         ESP_LOGE(TAG, "Le chemin existe déjà: %s", path.c_str());
         return httpd_resp_send_err(req, HTTPD_405_METHOD_NOT_ALLOWED, "Method Not Allowed");
     }
@@ -1154,6 +2931,8 @@ esp_err_t WebDAVBox3::handle_webdav_mkcol(httpd_req_t *req) {
     }
     
     ESP_LOGI(TAG, "Dossier créé avec succès: %s", path.c_str());
+    inst->dir_cache_.invalidate_path(path);
+    inst->record_change(JOURNAL_MKCOL, path);
     
     // En-têtes de réponse
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
@@ -1166,42 +2945,23 @@ esp_err_t WebDAVBox3::handle_webdav_mkcol(httpd_req_t *req) {
 
 esp_err_t WebDAVBox3::handle_webdav_move(httpd_req_t *req) {
   auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
-  std::string src = get_file_path(req, inst->root_path_);
+  RequestContext ctx(&inst->arenas_);
+  if (!ctx.resolve(req, inst->root_path_)) {
+    return send_invalid_path(req);
+  }
+  const std::string &src = ctx.path();
 
   char dest_uri[512];
   if (httpd_req_get_hdr_value_str(req, "Destination", dest_uri, sizeof(dest_uri)) == ESP_OK) {
     ESP_LOGD(TAG, "Destination brute: %s", dest_uri);
     
-    // Extraire la partie URI du chemin de destination
-    const char *uri_part = strstr(dest_uri, "//");
-    if (uri_part) {
-      // Sauter le protocole et le nom d'hôte
-      uri_part = strchr(uri_part + 2, '/');
-    } else {
-      uri_part = strchr(dest_uri, '/');
-    }
-    
-    if (!uri_part) {
+    // Même décodage et même normalisation que l'URI de la requête
+    RequestContext dst_ctx;
+    if (!dst_ctx.resolve_href(dest_uri, inst->root_path_)) {
       ESP_LOGE(TAG, "Format d'URI de destination invalide: %s", dest_uri);
       return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid destination URI");
     }
-    
-    // Construire directement le chemin de destination
-    std::string dst = inst->root_path_;
-    
-    // S'assurer que le chemin se termine par un '/'
-    if (dst.back() != '/') {
-      dst += '/';
-    }
-    
-    // Supprimer le premier '/' de l'URI si présent
-    std::string uri_str = uri_part;
-    if (!uri_str.empty() && uri_str.front() == '/') {
-      uri_str = uri_str.substr(1);
-    }
-    
-    // Ajouter l'URI décodée au chemin racine
-    dst += url_decode(uri_str);
+    const std::string &dst = dst_ctx.path();
     
     ESP_LOGD(TAG, "MOVE de %s vers %s", src.c_str(), dst.c_str());
     
@@ -1212,10 +2972,22 @@ esp_err_t WebDAVBox3::handle_webdav_move(httpd_req_t *req) {
       if (mkdir(parent_dir.c_str(), 0755) != 0) {
         ESP_LOGE(TAG, "Impossible de créer le répertoire parent: %s (errno: %d)", parent_dir.c_str(), errno);
       }
+      inst->dir_cache_.invalidate_path(parent_dir);
+      inst->record_change(JOURNAL_MKCOL, parent_dir);
     }
     
+    inst->invalidate_cached_path(src);
+    inst->invalidate_cached_path(dst);
+    
     if (rename(src.c_str(), dst.c_str()) == 0) {
       ESP_LOGI(TAG, "Déplacement réussi: %s -> %s", src.c_str(), dst.c_str());
+      inst->dir_cache_.invalidate_path(src);
+      inst->dir_cache_.invalidate_path(dst);
+      inst->record_change(JOURNAL_MOVE_FROM, src);
+      inst->record_change(JOURNAL_MOVE_TO, dst);
+      if (inst->precompressor_ != nullptr && inst->is_compressible(dst)) {
+        inst->precompressor_->request_scan();
+      }
       httpd_resp_set_status(req, "201 Created");
       httpd_resp_send(req, NULL, 0);
       return ESP_OK;
@@ -1229,53 +3001,125 @@ esp_err_t WebDAVBox3::handle_webdav_move(httpd_req_t *req) {
   return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Move failed");
 }
 
+// COPY (RFC 4918 §9.8) : fichier ou arbre, Depth 0 ou infinity, Overwrite
 esp_err_t WebDAVBox3::handle_webdav_copy(httpd_req_t *req) {
   auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
-  std::string src = get_file_path(req, inst->root_path_);
+  RequestContext ctx(&inst->arenas_);
+  if (!ctx.resolve(req, inst->root_path_)) {
+    return send_invalid_path(req);
+  }
+  const std::string &src = ctx.path();
+  if (!ctx.exists()) {
+    return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Source not found");
+  }
 
   char dest_uri[512];
-  if (httpd_req_get_hdr_value_str(req, "Destination", dest_uri, sizeof(dest_uri)) == ESP_OK) {
-    // Traitement similaire à MOVE pour obtenir le chemin de destination
-    const char *path_start = strstr(dest_uri, inst->root_path_.c_str());
-    std::string dst;
-    
-    if (path_start) {
-      dst = path_start;
-    } else {
-      dst = inst->root_path_;
-      if (dst.back() != '/' && dest_uri[0] != '/') dst += '/';
-      if (dst.back() == '/' && dest_uri[0] == '/') dst += (dest_uri + 1);
-      else dst += dest_uri;
-    }
-    
-    ESP_LOGD(TAG, "COPY de %s vers %s", src.c_str(), dst.c_str());
-    
-    // Créer le répertoire parent si nécessaire
-    std::string parent_dir = dst.substr(0, dst.find_last_of('/'));
-    if (!parent_dir.empty() && !is_dir(parent_dir)) {
-      mkdir(parent_dir.c_str(), 0777);
-    }
-    
-    // Pour les répertoires, il faudrait une copie récursive (non implémentée ici)
-    if (is_dir(src)) {
-      return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Directory copy not supported");
+  if (httpd_req_get_hdr_value_str(req, "Destination", dest_uri, sizeof(dest_uri)) != ESP_OK) {
+    ESP_LOGE(TAG, "En-tête Destination manquant pour COPY");
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing Destination");
+  }
+  // Même résolution que MOVE
+  RequestContext dst_ctx;
+  if (!dst_ctx.resolve_href(dest_uri, inst->root_path_)) {
+    ESP_LOGE(TAG, "Format d'URI de destination invalide: %s", dest_uri);
+    return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid destination URI");
+  }
+  const std::string &dst = dst_ctx.path();
+  const bool src_dir = ctx.is_dir();
+
+  // Ni la racine ni les fichiers internes du serveur, d'un côté comme de l'autre :
+  // une destination existante est supprimée avant la copie
+  if (inst->relative_path(src).empty() || inst->relative_path(dst).empty()) {
+    return httpd_resp_send_custom_err(req, "403 Forbidden", "Cannot copy this resource");
+  }
+  // Une copie dans sa propre arborescence ne se terminerait pas
+  if (dst == src || (src_dir && dst.compare(0, src.size(), src) == 0 && dst[src.size()] == '/')) {
+    return httpd_resp_send_custom_err(req, "403 Forbidden", "Destination inside source");
+  }
+
+  // Depth : 0 (le dossier seul) ou infinity (défaut) ; 1 n'a pas de sens pour COPY
+  bool recursive = true;
+  char depth[16];
+  if (httpd_req_get_hdr_value_str(req, "Depth", depth, sizeof(depth)) == ESP_OK) {
+    if (strcmp(depth, "0") == 0) {
+      recursive = false;
+    } else if (strcasecmp(depth, "infinity") != 0) {
+      return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid Depth");
     }
-    
-    // Copie de fichier
-    std::ifstream in(src, std::ios::binary);
-    std::ofstream out(dst, std::ios::binary);
+  }
 
-    if (!in || !out)
-      return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Copy failed");
+  // Overwrite: F refuse une destination existante ; T (défaut) la remplace
+  char overwrite[4] = "T";
+  httpd_req_get_hdr_value_str(req, "Overwrite", overwrite, sizeof(overwrite));
+  const struct stat *existing = dst_ctx.get_stat();
+  const bool replaced = existing != nullptr;
+  if (replaced && (overwrite[0] == 'F' || overwrite[0] == 'f')) {
+    return send_conditional_response(req, COND_PRECONDITION_FAILED, existing);
+  }
 
-    out << in.rdbuf();
-    
-    httpd_resp_set_status(req, "201 Created");
-    httpd_resp_send(req, NULL, 0);
-    return ESP_OK;
+  // Taille totale mesurée d'abord : admission et avancement en pourcentage
+  uint32_t total_files = 0;
+  uint64_t total_bytes = 0;
+  if (!src_dir || recursive) {
+    CopyEngine::measure(src, total_files, total_bytes);
+  }
+  const int64_t old_size = replaced && !S_ISDIR(existing->st_mode) ? (int64_t) existing->st_size : 0;
+  StorageReservation reservation;
+  const QuotaInfo *quota = nullptr;
+  if (inst->storage_.reserve(dst, total_bytes, (int64_t) total_bytes - old_size, reservation, &quota) != ADMIT_OK) {
+    ESP_LOGW(TAG, "COPY refusée: %llu octets vers %s", (unsigned long long) total_bytes, dst.c_str());
+    return httpd_resp_send_custom_err(req, "507 Insufficient Storage",
+                                      quota != nullptr ? "Quota exceeded" : "Insufficient storage");
   }
 
-  return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Copy failed");
+  if (!inst->ensure_parent_directory(dst)) {
+    return httpd_resp_send_custom_err(req, "409 Conflict", "Cannot create destination parent");
+  }
+  // Un fichier remplace un fichier d'un coup en fin de copie ; dès qu'un
+  // dossier est en jeu, la destination est supprimée d'abord
+  if (replaced && (src_dir || S_ISDIR(existing->st_mode))) {
+    inst->invalidate_cached_path(dst);
+    if (!remove_tree(dst)) {
+      ESP_LOGE(TAG, "Impossible de supprimer la destination %s (errno: %d)", dst.c_str(), errno);
+      inst->record_change(JOURNAL_DELETE, dst);
+      return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Cannot replace destination");
+    }
+    inst->record_change(JOURNAL_DELETE, dst);
+  }
+
+  CopyEngine engine(inst->buffer_pool_, inst->upload_dir_, inst->upload_seq_);
+  if (!engine.init(inst->write_behind_depth_, pdMS_TO_TICKS(inst->buffer_timeout_ms_))) {
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    return httpd_resp_send_custom_err(req, "503 Service Unavailable", "Server busy");
+  }
+  engine.set_totals(total_files, total_bytes);
+  ESP_LOGI(TAG, "COPY %s -> %s (%u fichiers, %llu octets, Depth: %s)", src.c_str(), dst.c_str(),
+           (unsigned) total_files, (unsigned long long) total_bytes, recursive ? "infinity" : "0");
+
+  const bool ok = src_dir ? engine.copy_tree(src, dst, recursive)
+                          : engine.copy_file(src, dst, (size_t) ctx.get_stat()->st_size);
+  const CopyStats &stats = engine.get_stats();
+  inst->last_copy_stats_ = stats;
+  reservation.commit((int64_t) stats.bytes - old_size);
+
+  // Ce qui a été copié reste en place et visible, même après un échec
+  inst->invalidate_cached_path(dst);
+  if (stats.files > 0 || stats.dirs > 0) {
+    inst->record_change(JOURNAL_COPY, dst);
+  }
+  if (inst->precompressor_ != nullptr && (src_dir || inst->is_compressible(dst))) {
+    inst->precompressor_->request_scan();
+  }
+  if (!ok) {
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Copy failed");
+  }
+
+  ESP_LOGI(TAG, "COPY terminée: %u fichiers, %u dossiers, %.1f Mo en %.1f s (%.0f Ko/s, buffers de %zu Ko%s)",
+           (unsigned) stats.files, (unsigned) stats.dirs, stats.bytes / 1048576.0f, stats.elapsed_us / 1e6f,
+           stats.throughput_kbps(), stats.chunk_size / 1024, stats.overlapped ? ", lecture et écriture en parallèle" : "");
+  httpd_resp_set_status(req, replaced ? "204 No Content" : "201 Created");
+  httpd_resp_send(req, NULL, 0);
+  return ESP_OK;
 }
 
 }  // namespace webdavbox3
@@ -2,11 +2,33 @@
 #include "esphome/core/component.h"
 #include <esp_http_server.h>
 #include "esphome/core/helpers.h"
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
+#include <cstdio>
+#include <sys/stat.h>
 #include "driver/sdmmc_host.h"
 #include "driver/sdmmc_defs.h"
 #include "../sd_mmc_card/sd_mmc_card.h"
+#include "webdavbox3_admission.h"
+#include "webdavbox3_arena.h"
+#include "webdavbox3_bandwidth.h"
+#include "webdavbox3_buffers.h"
+#include "webdavbox3_transfer.h"
+#include "webdavbox3_trash.h"
+#include "webdavbox3_cache.h"
+#include "webdavbox3_copy.h"
+#include "webdavbox3_dircache.h"
+#include "webdavbox3_journal.h"
+#include "webdavbox3_listing.h"
+#include "webdavbox3_partial.h"
+#include "webdavbox3_precompress.h"
+#include "webdavbox3_probes.h"
+#include "webdavbox3_propfind.h"
+#include "webdavbox3_request.h"
+#include "webdavbox3_upload.h"
+#include "webdavbox3_workers.h"
 
 #include "esp_vfs_fat.h"
 #include "esp_netif.h"
@@ -14,10 +36,30 @@
 namespace esphome {
 namespace webdavbox3 {
 
+// Plage d'octets demandée via l'en-tête Range (bornes incluses)
+struct ByteRange {
+  size_t start;
+  size_t end;
+  size_t length() const { return end - start + 1; }
+};
+
+enum RangeParseResult : uint8_t {
+  RANGE_NONE,           // Pas d'en-tête Range exploitable : envoi complet (200)
+  RANGE_OK,             // Au moins une plage satisfaisable (206)
+  RANGE_UNSATISFIABLE,  // Aucune plage ne recoupe le fichier (416)
+};
+
+enum ConditionalResult : uint8_t {
+  COND_OK,                   // Traitement normal
+  COND_NOT_MODIFIED,         // 304 (GET/HEAD)
+  COND_PRECONDITION_FAILED,  // 412
+};
+
 class WebDAVBox3 : public Component {
  public:
   void setup() override;
   void loop() override;
+  void dump_config() override;
   float get_setup_priority() const override { return esphome::setup_priority::AFTER_WIFI; }
   void set_root_path(const std::string &path) { root_path_ = path; }
   void set_url_prefix(const std::string &prefix) { url_prefix_ = prefix; }
@@ -25,9 +67,71 @@ class WebDAVBox3 : public Component {
   void set_username(const std::string &username) { username_ = username; }
   void set_password(const std::string &password) { password_ = password; }
   void enable_authentication(bool enabled) { auth_enabled_ = enabled; }
+  // Admission des envois : place à laisser libre et quotas par dossier (relatifs à la racine)
+  void set_min_free_space(uint64_t bytes) { min_free_space_ = bytes; }
+  void add_upload_quota(const std::string &folder, uint64_t max_bytes) { storage_.add_quota(folder, max_bytes); }
+  AdmissionStats get_admission_stats() { return storage_.get_stats(); }
+  void set_read_ahead_depth(size_t depth) { read_ahead_depth_ = depth; }
+  void set_write_behind_depth(size_t depth) { write_behind_depth_ = depth; }
+  void set_chunk_size(size_t chunk_size) { chunk_size_ = chunk_size; }
+  void add_transfer_buffers(size_t size, uint16_t count) { buffer_pool_.add_class(size, count); }
+  void set_buffer_timeout(uint32_t timeout_ms) { buffer_timeout_ms_ = timeout_ms; }
+  std::vector<BufferClassStats> get_buffer_pool_stats() { return buffer_pool_.get_stats(); }
+  const TransferStats &get_last_transfer_stats() const { return last_transfer_stats_; }
+  const UploadStats &get_last_upload_stats() const { return last_upload_stats_; }
+  const CopyStats &get_last_copy_stats() const { return last_copy_stats_; }
+  TrashStats get_trash_stats() const { return trash_.get_stats(); }
+  void set_file_cache(size_t budget, size_t max_entry_size) { file_cache_.configure(budget, max_entry_size); }
+  FileCacheStats get_file_cache_stats() { return file_cache_.get_stats(); }
+  void set_dir_cache_size(size_t budget) { dir_cache_.configure(budget); }
+  // Arène des temporaires de chaque requête (0 = tas)
+  void set_request_arena_size(size_t size) { arenas_.set_arena_size(size); }
+  ArenaStats get_arena_stats() { return arenas_.get_stats(); }
+  // Sondes des explorateurs : règles RAM à déclarer avant les autres
+  void add_probe_rule(const std::string &pattern, bool ram_store) {
+    probes_.add_rule(pattern, ram_store ? PROBE_RAM : PROBE_NEGATIVE);
+  }
+  void set_probe_cache(size_t negative_entries, size_t ram_budget, size_t ram_max_file) {
+    probes_.configure(negative_entries, ram_budget, ram_max_file);
+  }
+  ProbeStats get_probe_stats() { return probes_.get_stats(); }
+  // Journal des modifications pour sync-collection (0 = désactivé)
+  void set_sync_journal_size(uint32_t max_records) { journal_size_ = max_records; }
+  JournalStats get_sync_journal_stats() { return journal_.get_stats(); }
+  // Depth: infinity (max_depth 0 = refusé avec 403 propfind-finite-depth)
+  void set_propfind_limits(uint8_t max_depth, uint32_t max_entries) {
+    propfind_max_depth_ = max_depth;
+    propfind_max_entries_ = max_entries;
+  }
+  DirCacheStats get_dir_cache_stats() { return dir_cache_.get_stats(); }
+  void set_sd_card(sd_mmc_card::SdMmc *sd_card) { sd_card_ = sd_card; }
+  void set_compressible_extensions(const std::vector<std::string> &exts) { compressible_exts_ = exts; }
+  void set_precompress(bool enabled) { precompress_ = enabled; }
+  void set_workers(uint8_t bulk, uint8_t metadata, uint8_t queue_length) {
+    workers_.configure(bulk, metadata, queue_length);
+  }
+  WorkerPoolStats get_worker_stats() const { return workers_.get_stats(); }
+  void set_bandwidth_limits(uint32_t global_rate, uint32_t client_rate) {
+    bandwidth_.set_global_rate(global_rate);
+    bandwidth_.set_client_rate(client_rate);
+  }
+  void add_priority_class(const std::string &name, uint8_t weight, const std::string &uri_prefix) {
+    bandwidth_.add_class(name, weight, uri_prefix);
+  }
+  std::vector<ClientRateStats> get_client_rate_stats() { return bandwidth_.get_client_stats(); }
   void add_cors_headers(httpd_req_t *req);
   void register_handlers();
   float benchmark_sd_read(const std::string &filepath);
+  float benchmark_head(const std::string &filepath, int iterations = 100);
+  // Temps de listing en fonction du nombre d'entrées (crée puis supprime un répertoire de test)
+  float benchmark_listing(const std::string &dirpath, int max_entries = 1000);
+  // Coût de résolution d'une URI (décodage, chemin, stat), ancien et nouveau parcours
+  float benchmark_request(const std::string &uri, int iterations = 1000);
+  // Débit d'écriture (Mo/s) : fopen "wb" direct contre temporaire préalloué puis renommé
+  float benchmark_upload(const std::string &dirpath, int size_mb = 16);
+
+  // Type MIME d'après l'extension
+  static const char *content_type_for(const char *path);
   
   
   bool mount_sd_card();  // Ajout de ta fonction publique
@@ -41,6 +145,63 @@ class WebDAVBox3 : public Component {
   std::string password_;
   bool auth_enabled_{false};
 
+  // Transfert GET : profondeur de l'anneau de lecture anticipée (< 2 = séquentiel)
+  // et taille des chunks (0 = choisie selon la taille du fichier)
+  size_t read_ahead_depth_{3};
+  size_t chunk_size_{0};
+  TransferStats last_transfer_stats_;
+  // PUT : profondeur de l'anneau d'écriture différée (< 2 = séquentiel)
+  size_t write_behind_depth_{3};
+  UploadStats last_upload_stats_;
+  CopyStats last_copy_stats_;
+  // Temporaires des PUT en cours, renommés vers la cible en fin d'envoi
+  std::string upload_dir_;
+  std::atomic<uint32_t> upload_seq_{0};
+  // Envois par morceaux (Content-Range, PATCH) dont la taille finale est connue
+  PartialUploadTable partial_uploads_;
+  // Place libre, réservations des envois en cours et quotas, vérifiés avant le corps
+  StorageBudget storage_;
+  uint64_t min_free_space_{0};
+  TrashReclaimer trash_;
+
+  // Buffers de transfert partagés par GET, PUT, COPY et les benchmarks
+  TransferBufferPool buffer_pool_;
+  uint32_t buffer_timeout_ms_{2000};
+  // Réservés aux réponses Multi-Status (PROPFIND, REPORT, GET d'un dossier)
+  TransferBufferPool multistatus_pool_;
+
+  // Cache PSRAM des petits fichiers servis en GET
+  FileContentCache file_cache_;
+
+  // Listings de répertoires servis par PROPFIND, invalidés par les écritures
+  DirectoryCache dir_cache_;
+
+  // Bornes d'un PROPFIND Depth: infinity (niveaux sous la cible, entrées au total)
+  uint8_t propfind_max_depth_{16};
+  uint32_t propfind_max_entries_{20000};
+
+  // Temporaires des gestionnaires (hrefs, chemins, en-têtes), remis à zéro par requête
+  ArenaPool arenas_;
+
+  // desktop.ini, .DS_Store, ._* : répondues sans accès à la carte
+  ProbeFilter probes_;
+
+  // Modifications numérotées, base des jetons sync-collection
+  ChangeJournal journal_;
+  uint32_t journal_size_{4096};
+  sd_mmc_card::SdMmc *sd_card_{nullptr};
+
+  // Variantes .gz/.br servies selon Accept-Encoding, créées en tâche de fond si activé
+  std::vector<std::string> compressible_exts_{"html", "htm", "js", "css", "json", "txt", "log", "svg", "xml"};
+  bool precompress_{false};
+  AssetPrecompressor *precompressor_{nullptr};
+
+  // Workers asynchrones : la tâche httpd ne fait plus que répartir les requêtes
+  RequestWorkerPool workers_;
+
+  // Partage du débit sortant entre clients (inactif sans plafond configuré)
+  BandwidthScheduler bandwidth_;
+
   bool sdcard_mounted_ = false;  // Ajout de ta variable privée
 
   // HTTP server configuration
@@ -55,19 +216,61 @@ class WebDAVBox3 : public Component {
   // WebDAV path conversion
   std::string uri_to_filepath(const char* uri);
 
-  esp_err_t handle_webdav_get_small_file(httpd_req_t *req, const std::string &path, size_t file_size);
+  std::shared_ptr<const uint8_t> load_small_file(const std::string &path, const struct stat &st);
+  void invalidate_cached_path(const std::string &path);
+  std::string relative_path(const std::string &path) const;
+  // Inscrit une modification réussie au journal (chemin VFS absolu)
+  void record_change(JournalOp op, const std::string &path);
+  // Répond à une sonde connue sans passer par la carte ; false = traitement normal
+  bool absorb_probe(httpd_req_t *req, esp_err_t &result, bool in_worker = false);
+  // PUT d'une sonde vers le magasin RAM, depuis le worker du PUT
+  bool store_probe_put(httpd_req_t *req, esp_err_t &result);
+  // Mémorise l'absence d'une sonde après un 404 venant de la carte
+  void note_missing_probe(httpd_req_t *req);
+  static esp_err_t send_ram_file(httpd_req_t *req, const std::string &key, const RamFile &file);
   
+  // Point d'entrée enregistré auprès d'httpd : passe la requête à un worker
+  // de la classe C, ou l'exécute sur place si les workers sont désactivés
+  template<esp_err_t (*H)(httpd_req_t *), WorkClass C> static esp_err_t dispatch(httpd_req_t *req) {
+    auto *inst = static_cast<WebDAVBox3 *>(req->user_ctx);
+    // Identifiants vérifiés dans la tâche httpd, avant worker et corps ; OPTIONS
+    // reste libre pour les pré-vérifications CORS, qui n'en envoient pas
+    if (inst->auth_enabled_ && req->method != HTTP_OPTIONS && !inst->authenticate(req))
+      return inst->send_auth_required_response(req);
+    esp_err_t probe_result;
+    if (inst->probes_.is_enabled() && inst->absorb_probe(req, probe_result))
+      return probe_result;
+    if (inst->workers_.submit(req, H, C))
+      return ESP_OK;
+    if (C == WORK_BULK && inst->workers_.is_running() && inst->workers_.get_worker_count(C) > 0) {
+      // Tous les workers de transfert sont occupés et la file est pleine ; un
+      // corps en attente n'est pas lu, la connexion est fermée
+      httpd_resp_set_hdr(req, "Retry-After", "2");
+      if (req->content_len > 0)
+        httpd_resp_set_hdr(req, "Connection", "close");
+      httpd_resp_send_custom_err(req, "503 Service Unavailable", "Server busy");
+      return req->content_len > 0 ? ESP_FAIL : ESP_OK;
+    }
+    return H(req);
+  }
+
   // WebDAV handler methods
   static esp_err_t handle_root(httpd_req_t *req);
   static esp_err_t handle_webdav_list(httpd_req_t *req);
   static esp_err_t handle_webdav_options(httpd_req_t *req);
   static esp_err_t handle_webdav_propfind(httpd_req_t *req);
   static esp_err_t handle_webdav_get(httpd_req_t *req);
+  static esp_err_t handle_webdav_head(httpd_req_t *req);
   static esp_err_t handle_webdav_put(httpd_req_t *req);
+  static esp_err_t handle_webdav_patch(httpd_req_t *req);
+  static esp_err_t write_range(httpd_req_t *req, RequestContext &ctx, const UpdateRange &range);
   static esp_err_t handle_webdav_delete(httpd_req_t *req);
   static esp_err_t handle_webdav_mkcol(httpd_req_t *req);
   static esp_err_t handle_webdav_move(httpd_req_t *req);
   static esp_err_t handle_webdav_copy(httpd_req_t *req);
+  static esp_err_t handle_webdav_report(httpd_req_t *req);
+  static esp_err_t handle_propfind_resolved(httpd_req_t *req, RequestContext &ctx);
+  TransferBuffer borrow_multistatus_buffer();
   static esp_err_t handle_webdav_lock(httpd_req_t *req);
   static esp_err_t handle_webdav_unlock(httpd_req_t *req);
   static esp_err_t handle_webdav_proppatch(httpd_req_t *req);
@@ -75,10 +278,40 @@ class WebDAVBox3 : public Component {
   static bool create_directories(const std::string& path);
   
   // Helper methods
-  static std::string get_file_path(httpd_req_t *req, const std::string &root_path);
   static bool is_dir(const std::string &path);
   static std::vector<std::string> list_dir(const std::string &path);
-  static std::string generate_prop_xml(const std::string &href, bool is_directory, time_t modified, size_t size);
+
+  static size_t format_head_headers(const struct stat &st, const char *content_type, char *buf, size_t len,
+                                    const char *content_encoding = nullptr, const char *extra_headers = nullptr);
+  bool is_compressible(const std::string &path) const;
+  static const char *select_encoded_variant(httpd_req_t *req, std::string &path, struct stat &st);
+
+  // Corps d'un PUT ou d'un PATCH ; failure == nullptr si tout est sur la carte
+  struct BodyReceipt {
+    size_t received{0};
+    const char *failure{nullptr};
+    httpd_err_code_t failure_code{HTTPD_500_INTERNAL_SERVER_ERROR};
+    bool busy{false};  // Aucun buffer de transfert : 503
+    UploadStats stats;
+  };
+  BodyReceipt receive_body(httpd_req_t *req, FILE *file);
+  bool admit_upload(httpd_req_t *req, const std::string &path, uint64_t space, int64_t quota_delta,
+                    StorageReservation &reservation, esp_err_t &result);
+  bool ensure_parent_directory(const std::string &path);
+
+  // Conditional request helpers (ETag / Last-Modified)
+  static ConditionalResult evaluate_preconditions(httpd_req_t *req, const struct stat *st);
+  static esp_err_t send_conditional_response(httpd_req_t *req, ConditionalResult result, const struct stat *st);
+
+  // Range / partial content helpers
+  static RangeParseResult parse_range_header(const char *value, size_t file_size, std::vector<ByteRange> &ranges);
+  static bool if_range_matches(httpd_req_t *req, const struct stat &st);
+  static esp_err_t send_file_window(httpd_req_t *req, FILE *file, size_t offset, size_t length,
+                                    char *buffer, size_t chunk_size, size_t &total_sent,
+                                    BandwidthFlow *flow = nullptr);
+  static esp_err_t send_file_window_pipelined(httpd_req_t *req, ReadAheadPipeline &pipeline, FILE *file,
+                                              size_t offset, size_t length, size_t &total_sent,
+                                              BandwidthFlow *flow = nullptr);
 };
 
 }  // namespace webdavbox3
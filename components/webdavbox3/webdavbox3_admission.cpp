@@ -0,0 +1,223 @@
+#include "webdavbox3_admission.h"
+#include "webdavbox3_listing.h"
+#include "esphome/core/log.h"
+#include "esp_timer.h"
+
+#include <algorithm>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.admission";
+
+// Relecture de la place libre au plus une fois par seconde
+static const int64_t FREE_REFRESH_US = 1000000;
+
+void StorageReservation::commit(int64_t delta) {
+  if (this->budget_ != nullptr)
+    this->budget_->release_(*this, true, delta);
+}
+
+void StorageReservation::release() {
+  if (this->budget_ != nullptr)
+    this->budget_->release_(*this, false, 0);
+}
+
+StorageBudget::StorageBudget() { this->lock_ = xSemaphoreCreateMutex(); }
+
+StorageBudget::~StorageBudget() {
+  if (this->lock_ != nullptr)
+    vSemaphoreDelete(this->lock_);
+}
+
+void StorageBudget::configure(const std::string &root_path, uint64_t min_free) {
+  std::string ff_path;
+  if (DirectoryReader::to_fatfs_path(root_path, ff_path)) {
+    this->fatfs_drive_ = ff_path.substr(0, ff_path.find(':') + 1);
+  }
+  this->min_free_ = min_free;
+  // Quotas déclarés relativement à la racine WebDAV
+  std::string root = root_path;
+  while (!root.empty() && root.back() == '/') root.pop_back();
+  for (auto &quota : this->quotas_) {
+    std::string rel = quota.path;
+    while (!rel.empty() && rel.front() == '/') rel.erase(0, 1);
+    quota.path = rel.empty() ? root : root + "/" + rel;
+  }
+  this->quota_reserved_.assign(this->quotas_.size(), 0);
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->refresh_free_space_locked_(true);
+  xSemaphoreGive(this->lock_);
+}
+
+void StorageBudget::add_quota(const std::string &path, uint64_t limit) {
+  QuotaInfo quota;
+  quota.path = path;
+  while (quota.path.size() > 1 && quota.path.back() == '/') quota.path.pop_back();
+  quota.limit = limit;
+  this->quotas_.push_back(quota);
+  this->quota_reserved_.push_back(0);
+}
+
+bool StorageBudget::contains_(const std::string &dir, const std::string &path) {
+  return path.compare(0, dir.size(), dir) == 0 && (path.size() == dir.size() || path[dir.size()] == '/');
+}
+
+void StorageBudget::refresh_free_space_locked_(bool force) {
+  if (this->fatfs_drive_.empty())
+    return;
+  const int64_t now = esp_timer_get_time();
+  if (!force && (!this->free_stale_ || now - this->free_read_us_ < FREE_REFRESH_US))
+    return;
+  FATFS *fs;
+  DWORD free_clusters;
+  // Compte de clusters libres tenu par FatFs : pas de parcours de la FAT après le premier appel
+  if (f_getfree(this->fatfs_drive_.c_str(), &free_clusters, &fs) != FR_OK) {
+    ESP_LOGW(TAG, "Place libre illisible sur %s", this->fatfs_drive_.c_str());
+    return;
+  }
+#if FF_MAX_SS != FF_MIN_SS
+  const uint32_t sector = fs->ssize;
+#else
+  const uint32_t sector = FF_MAX_SS;
+#endif
+  this->cluster_size_ = fs->csize * sector;
+  this->free_bytes_ = (uint64_t) free_clusters * this->cluster_size_;
+  this->free_stale_ = false;
+  this->free_read_us_ = now;
+}
+
+void StorageBudget::refresh_free_space() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->refresh_free_space_locked_(true);
+  xSemaphoreGive(this->lock_);
+}
+
+uint64_t StorageBudget::count_usage_(const std::string &path) {
+  uint64_t used = 0;
+  std::vector<std::string> pending{path};
+  DirEntry entry;
+  while (!pending.empty()) {
+    std::string dir = std::move(pending.back());
+    pending.pop_back();
+    DirectoryReader reader;
+    if (!reader.open(dir))
+      continue;
+    while (reader.next(entry)) {
+      if (entry.is_dir) {
+        pending.push_back(dir + "/" + entry.name);
+      } else {
+        used += entry.size;
+      }
+    }
+  }
+  return used;
+}
+
+AdmissionResult StorageBudget::reserve(const std::string &path, uint64_t space, int64_t quota_delta,
+                                       StorageReservation &reservation, const QuotaInfo **violated) {
+  reservation.release();
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->refresh_free_space_locked_(false);
+
+  // Arrondi au cluster, plus un cluster pour l'entrée de répertoire
+  uint64_t needed = 0;
+  if (space > 0)
+    needed = (space + this->cluster_size_ - 1) / this->cluster_size_ * this->cluster_size_ + this->cluster_size_;
+  if (this->free_bytes_ != UINT64_MAX &&
+      this->free_bytes_ < this->stats_.reserved_bytes + needed + this->min_free_) {
+    this->stats_.rejected_space++;
+    this->stats_.bytes_refused += space;
+    xSemaphoreGive(this->lock_);
+    return ADMIT_NO_SPACE;
+  }
+
+  if (quota_delta > 0) {
+    for (size_t i = 0; i < this->quotas_.size(); i++) {
+      QuotaInfo &quota = this->quotas_[i];
+      if (!contains_(quota.path, path))
+        continue;
+      if (!quota.counted) {
+        int64_t start = esp_timer_get_time();
+        quota.used = this->count_usage_(quota.path);
+        quota.counted = true;
+        ESP_LOGD(TAG, "Quota %s recompté: %llu octets (%lld ms)", quota.path.c_str(), (unsigned long long) quota.used,
+                 (long long) (esp_timer_get_time() - start) / 1000);
+      }
+      if ((int64_t) quota.used + this->quota_reserved_[i] + quota_delta > (int64_t) quota.limit) {
+        this->stats_.rejected_quota++;
+        this->stats_.bytes_refused += space;
+        if (violated != nullptr)
+          *violated = &quota;
+        xSemaphoreGive(this->lock_);
+        return ADMIT_QUOTA;
+      }
+    }
+    for (size_t i = 0; i < this->quotas_.size(); i++) {
+      if (contains_(this->quotas_[i].path, path))
+        this->quota_reserved_[i] += quota_delta;
+    }
+  }
+
+  this->stats_.reserved_bytes += needed;
+  this->stats_.admitted++;
+  xSemaphoreGive(this->lock_);
+
+  reservation.budget_ = this;
+  reservation.path_ = path;
+  reservation.space_ = needed;
+  reservation.quota_delta_ = std::max<int64_t>(quota_delta, 0);
+  return ADMIT_OK;
+}
+
+void StorageBudget::release_(StorageReservation &reservation, bool committed, int64_t delta) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->stats_.reserved_bytes -= reservation.space_;
+  for (size_t i = 0; i < this->quotas_.size(); i++) {
+    if (!contains_(this->quotas_[i].path, reservation.path_))
+      continue;
+    this->quota_reserved_[i] -= reservation.quota_delta_;
+    if (committed && this->quotas_[i].counted)
+      this->quotas_[i].used = (uint64_t) std::max<int64_t>((int64_t) this->quotas_[i].used + delta, 0);
+  }
+  // Les clusters réellement alloués se lisent sur la carte
+  this->free_stale_ = true;
+  xSemaphoreGive(this->lock_);
+  reservation.budget_ = nullptr;
+}
+
+void StorageBudget::invalidate(const std::string &path) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->free_stale_ = true;
+  for (auto &quota : this->quotas_) {
+    // Dossier sous quota touché, ou déplacé/supprimé avec un ancêtre
+    if (contains_(quota.path, path) || contains_(path, quota.path))
+      quota.counted = false;
+  }
+  xSemaphoreGive(this->lock_);
+}
+
+void StorageBudget::note_rejected_auth(uint64_t content_len) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->stats_.rejected_auth++;
+  this->stats_.bytes_refused += content_len;
+  xSemaphoreGive(this->lock_);
+}
+
+AdmissionStats StorageBudget::get_stats() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  AdmissionStats stats = this->stats_;
+  stats.free_bytes = this->free_bytes_;
+  xSemaphoreGive(this->lock_);
+  return stats;
+}
+
+std::vector<QuotaInfo> StorageBudget::get_quotas() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  std::vector<QuotaInfo> quotas = this->quotas_;
+  xSemaphoreGive(this->lock_);
+  return quotas;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
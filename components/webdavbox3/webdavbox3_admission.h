@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+enum AdmissionResult : uint8_t {
+  ADMIT_OK,
+  ADMIT_NO_SPACE,  // Place libre insuffisante (réservations des envois en cours déduites)
+  ADMIT_QUOTA,     // Quota d'un dossier englobant dépassé
+};
+
+struct AdmissionStats {
+  uint32_t admitted{0};
+  uint32_t rejected_auth{0};
+  uint32_t rejected_space{0};
+  uint32_t rejected_quota{0};
+  uint64_t bytes_refused{0};  // Content-Length des envois refusés, jamais reçus
+  uint64_t free_bytes{0};
+  uint64_t reserved_bytes{0};
+};
+
+// Quota d'un dossier ; used est recompté après une modification non chiffrée
+struct QuotaInfo {
+  std::string path;
+  uint64_t limit{0};
+  uint64_t used{0};
+  bool counted{false};
+};
+
+class StorageBudget;
+
+// Place réservée pour un envoi admis ; rendue à la destruction
+class StorageReservation {
+ public:
+  StorageReservation() = default;
+  StorageReservation(const StorageReservation &) = delete;
+  StorageReservation &operator=(const StorageReservation &) = delete;
+  ~StorageReservation() { this->release(); }
+
+  // Envoi terminé : delta = variation réelle de la taille du fichier
+  void commit(int64_t delta);
+  void release();
+
+ protected:
+  friend class StorageBudget;
+
+  StorageBudget *budget_{nullptr};
+  std::string path_;
+  uint64_t space_{0};
+  int64_t quota_delta_{0};
+};
+
+/**
+ * @brief Place libre et quotas par dossier, vérifiés avant de recevoir un corps.
+ *
+ * La place libre vient de f_getfree(), qui ne parcourt la FAT qu'au premier
+ * appel (FatFs garde ensuite le compte des clusters libres) ; elle n'est
+ * relue qu'après une écriture, au plus une fois par seconde. Les envois admis
+ * réservent leur taille : deux PUT simultanés ne peuvent pas compter sur la
+ * même place. L'occupation des dossiers sous quota est comptée une fois, puis
+ * ajustée par les PUT ; les autres modifications imposent un recomptage.
+ */
+class StorageBudget {
+ public:
+  StorageBudget();
+  ~StorageBudget();
+
+  // Avant configure() : path relatif à la racine WebDAV
+  void add_quota(const std::string &path, uint64_t limit);
+  void configure(const std::string &root_path, uint64_t min_free);
+  bool has_quotas() const { return !this->quotas_.empty(); }
+  // Lecteur FatFs de la racine ("0:"), vide hors du volume FAT
+  const std::string &get_fatfs_drive() const { return this->fatfs_drive_; }
+
+  // space : octets à allouer sur la carte ; quota_delta : variation de taille du fichier
+  AdmissionResult reserve(const std::string &path, uint64_t space, int64_t quota_delta,
+                          StorageReservation &reservation, const QuotaInfo **violated = nullptr);
+  // Écriture hors envoi admis sous path : place libre et quotas à relire
+  void invalidate(const std::string &path);
+  void refresh_free_space();
+
+  void note_rejected_auth(uint64_t content_len);
+  AdmissionStats get_stats();
+  std::vector<QuotaInfo> get_quotas();
+
+ protected:
+  friend class StorageReservation;
+
+  void release_(StorageReservation &reservation, bool committed, int64_t delta);
+  void refresh_free_space_locked_(bool force);
+  uint64_t count_usage_(const std::string &path);
+  static bool contains_(const std::string &dir, const std::string &path);
+
+  std::string fatfs_drive_;
+  uint64_t min_free_{0};
+  uint32_t cluster_size_{512};
+  uint64_t free_bytes_{UINT64_MAX};  // Inconnue : pas de contrôle
+  bool free_stale_{true};
+  int64_t free_read_us_{0};
+  std::vector<QuotaInfo> quotas_;
+  std::vector<int64_t> quota_reserved_;  // Par quota, envois admis en cours
+  AdmissionStats stats_;
+  SemaphoreHandle_t lock_{nullptr};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,133 @@
+#include "webdavbox3_arena.h"
+#include "esphome/core/log.h"
+#include "esp_heap_caps.h"
+
+#include <algorithm>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.arena";
+
+void *Arena::allocate(size_t size, size_t align) {
+  size_t offset = (this->used_ + align - 1) & ~(align - 1);
+  if (offset + size > this->size_) {
+    this->overflows_++;
+    this->overflow_bytes_ += size;
+    return malloc(size);
+  }
+  this->used_ = offset + size;
+  this->peak_ = std::max(this->peak_, this->used_);
+  return this->block_ + offset;
+}
+
+void Arena::deallocate(void *p, size_t size) {
+  // Dernier bloc alloué (chaîne réallouée en grandissant) : place rendue
+  uint8_t *bytes = static_cast<uint8_t *>(p);
+  if (bytes + size == this->block_ + this->used_)
+    this->used_ = bytes - this->block_;
+}
+
+ArenaPath &ArenaPath::join(const char *name, size_t len) {
+  while (len > 0 && name[0] == '/') {
+    name++;
+    len--;
+  }
+  if (this->str_.empty() || this->str_.back() != '/')
+    this->str_ += '/';
+  this->str_.append(name, len);
+  return *this;
+}
+
+bool ArenaPath::pop() {
+  while (this->str_.size() > 1 && this->str_.back() == '/')
+    this->str_.pop_back();
+  size_t slash = this->str_.find_last_of('/');
+  if (slash == ArenaString::npos || this->str_.size() <= 1)
+    return false;
+  this->str_.resize(slash > 0 ? slash : 1);
+  return true;
+}
+
+ArenaPool::~ArenaPool() {
+  for (auto &arena : this->arenas_)
+    heap_caps_free(arena.block_);
+  if (this->lock_ != nullptr)
+    vSemaphoreDelete(this->lock_);
+}
+
+bool ArenaPool::init(uint8_t count) {
+  if (this->arena_size_ == 0 || count == 0)
+    return true;
+  if (this->lock_ == nullptr)
+    this->lock_ = xSemaphoreCreateMutex();
+
+  // Blocs permanents : alloués une fois, avant que le tas ne se morcelle
+  this->arenas_.reserve(count);
+  for (uint8_t i = 0; i < count; i++) {
+    auto *block = (uint8_t *) heap_caps_malloc(this->arena_size_, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (block == nullptr) {
+      ESP_LOGW(TAG, "Arène %u/%u non allouée (%zu octets)", i + 1, count, this->arena_size_);
+      break;
+    }
+    Arena arena;
+    arena.block_ = block;
+    arena.size_ = this->arena_size_;
+    this->arenas_.push_back(arena);
+  }
+  for (auto &arena : this->arenas_)
+    this->free_.push_back(&arena);
+  this->stats_.arena_size = this->arena_size_;
+  this->stats_.count = this->arenas_.size();
+  ESP_LOGI(TAG, "%u arènes de %zu octets en RAM interne", (unsigned) this->arenas_.size(), this->arena_size_);
+  return this->arenas_.size() == count;
+}
+
+Arena *ArenaPool::acquire() {
+  if (this->arenas_.empty())
+    return nullptr;
+  Arena *arena = nullptr;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  if (!this->free_.empty()) {
+    arena = this->free_.back();
+    this->free_.pop_back();
+    this->stats_.in_use++;
+  } else {
+    this->stats_.exhausted++;
+  }
+  xSemaphoreGive(this->lock_);
+  return arena;
+}
+
+void ArenaPool::release(Arena *arena) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->stats_.requests++;
+  this->stats_.total_used += arena->peak_;
+  this->stats_.peak = std::max(this->stats_.peak, arena->peak_);
+  this->stats_.overflows += arena->overflows_;
+  this->stats_.overflow_bytes += arena->overflow_bytes_;
+  this->stats_.in_use--;
+  if (arena->overflows_ > 0) {
+    ESP_LOGD(TAG, "Arène pleine: %u allocations (%zu octets) passées au tas", (unsigned) arena->overflows_,
+             arena->overflow_bytes_);
+  }
+  // Remise à zéro unique : tous les temporaires de la requête sont détruits
+  arena->used_ = 0;
+  arena->peak_ = 0;
+  arena->overflows_ = 0;
+  arena->overflow_bytes_ = 0;
+  this->free_.push_back(arena);
+  xSemaphoreGive(this->lock_);
+}
+
+ArenaStats ArenaPool::get_stats() {
+  if (this->lock_ == nullptr)
+    return this->stats_;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  ArenaStats stats = this->stats_;
+  xSemaphoreGive(this->lock_);
+  return stats;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+struct ArenaStats {
+  size_t arena_size{0};
+  uint8_t count{0};
+  uint8_t in_use{0};
+  uint32_t requests{0};   // Baux rendus
+  uint32_t exhausted{0};  // Requêtes servies sans arène (toutes occupées)
+  size_t peak{0};         // Occupation maximale d'une arène, débordements exclus
+  uint64_t total_used{0};
+  uint32_t overflows{0};  // Allocations passées au tas, arène pleine
+  uint64_t overflow_bytes{0};
+
+  size_t average() const { return this->requests > 0 ? this->total_used / this->requests : 0; }
+};
+
+/**
+ * @brief Allocateur par incrément sur un bloc fixe, remis à zéro d'un coup
+ * à la fin de la requête.
+ *
+ * Les libérations individuelles ne rendent de la place que pour le dernier
+ * bloc alloué (chaîne qui grandit). Arène pleine : l'allocation passe au
+ * tas et sera libérée normalement.
+ */
+class Arena {
+ public:
+  void *allocate(size_t size, size_t align);
+  void deallocate(void *p, size_t size);
+  bool owns(const void *p) const {
+    return static_cast<const uint8_t *>(p) >= this->block_ && static_cast<const uint8_t *>(p) < this->block_ + this->size_;
+  }
+  size_t used() const { return this->used_; }
+
+ protected:
+  friend class ArenaPool;
+
+  uint8_t *block_{nullptr};
+  size_t size_{0};
+  size_t used_{0};
+  size_t peak_{0};  // Depuis le dernier reset
+  uint32_t overflows_{0};
+  size_t overflow_bytes_{0};
+};
+
+// Allocateur standard adossé à une arène ; sans arène, le tas
+template<typename T> class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  ArenaAllocator(Arena *arena = nullptr) noexcept : arena_(arena) {}  // NOLINT
+  template<typename U> ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena_(other.arena()) {}  // NOLINT
+
+  T *allocate(size_t n) {
+    void *p = this->arena_ != nullptr ? this->arena_->allocate(n * sizeof(T), alignof(T)) : malloc(n * sizeof(T));
+    if (p == nullptr)
+      abort();  // Comme new sans exceptions
+    return static_cast<T *>(p);
+  }
+  void deallocate(T *p, size_t n) noexcept {
+    if (this->arena_ != nullptr && this->arena_->owns(p)) {
+      this->arena_->deallocate(p, n * sizeof(T));
+    } else {
+      free(p);
+    }
+  }
+  Arena *arena() const { return this->arena_; }
+
+  template<typename U> bool operator==(const ArenaAllocator<U> &other) const { return this->arena_ == other.arena(); }
+  template<typename U> bool operator!=(const ArenaAllocator<U> &other) const { return this->arena_ != other.arena(); }
+
+ protected:
+  Arena *arena_;
+};
+
+// Chaîne de construction (href, fragments, valeurs d'en-tête) allouée dans l'arène
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+template<typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+/**
+ * @brief Chemin construit segment par segment dans l'arène de la requête.
+ */
+class ArenaPath {
+ public:
+  explicit ArenaPath(Arena *arena) : str_(ArenaAllocator<char>(arena)) {}
+  ArenaPath(Arena *arena, const char *path) : str_(path, ArenaAllocator<char>(arena)) {}
+  ArenaPath(Arena *arena, const std::string &path) : str_(path.data(), path.size(), ArenaAllocator<char>(arena)) {}
+
+  // Ajoute un segment, séparé par un seul '/'
+  ArenaPath &join(const char *name, size_t len);
+  ArenaPath &join(const char *name) { return this->join(name, strlen(name)); }
+  ArenaPath &join(const std::string &name) { return this->join(name.data(), name.size()); }
+  ArenaPath &operator+=(char c) {
+    this->str_ += c;
+    return *this;
+  }
+  ArenaPath &operator+=(const char *text) {
+    this->str_ += text;
+    return *this;
+  }
+  ArenaPath &operator+=(const std::string &text) {
+    this->str_.append(text.data(), text.size());
+    return *this;
+  }
+  ArenaPath &assign(const char *text, size_t len) {
+    this->str_.assign(text, len);
+    return *this;
+  }
+  // Retire le dernier segment ; false à la racine
+  bool pop();
+  void truncate(size_t len) { this->str_.resize(len); }
+
+  const char *c_str() const { return this->str_.c_str(); }
+  size_t size() const { return this->str_.size(); }
+  bool empty() const { return this->str_.empty(); }
+  char back() const { return this->str_.back(); }
+  const ArenaString &str() const { return this->str_; }
+  // Pour les API qui conservent le chemin (caches, journal)
+  std::string to_string() const { return std::string(this->str_.data(), this->str_.size()); }
+
+ protected:
+  ArenaString str_;
+};
+
+/**
+ * @brief Arènes des requêtes, allouées une fois en RAM interne : une par
+ * tâche pouvant exécuter un gestionnaire (workers et tâche httpd).
+ *
+ * Les temporaires des gestionnaires ne morcellent plus le tas interne au fil
+ * des sessions ; le pic et la moyenne d'occupation permettent d'ajuster la
+ * taille.
+ */
+class ArenaPool {
+ public:
+  ~ArenaPool();
+
+  void set_arena_size(size_t size) { this->arena_size_ = size; }
+  size_t get_arena_size() const { return this->arena_size_; }
+  bool init(uint8_t count);
+  bool is_enabled() const { return !this->arenas_.empty(); }
+
+  // nullptr si toutes les arènes sont prises : la requête utilise le tas
+  Arena *acquire();
+  void release(Arena *arena);
+
+  ArenaStats get_stats();
+
+ protected:
+  size_t arena_size_{0};
+  std::vector<Arena> arenas_;
+  std::vector<Arena *> free_;
+  ArenaStats stats_;
+  SemaphoreHandle_t lock_{nullptr};
+};
+
+// Arène empruntée pour la durée d'une requête, remise à zéro au rendu
+class ArenaLease {
+ public:
+  explicit ArenaLease(ArenaPool *pool) : pool_(pool), arena_(pool != nullptr ? pool->acquire() : nullptr) {}
+  ArenaLease(const ArenaLease &) = delete;
+  ArenaLease &operator=(const ArenaLease &) = delete;
+  ~ArenaLease() {
+    if (this->arena_ != nullptr)
+      this->pool_->release(this->arena_);
+  }
+
+  Arena *get() const { return this->arena_; }
+
+ protected:
+  ArenaPool *pool_;
+  Arena *arena_;
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,191 @@
+#include "webdavbox3_bandwidth.h"
+#include "esphome/core/log.h"
+#include "esp_timer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.bandwidth";
+
+// Rafale tolérée : 100 ms de débit, pour absorber un chunk sans à-coups
+static const int64_t BURST_US = 100000;
+// Les statistiques des clients inactifs sont oubliées après 5 minutes
+static const int64_t CLIENT_EXPIRY_US = 300LL * 1000000LL;
+static const size_t MAX_CLASSES = 8;
+
+BandwidthFlow::BandwidthFlow(BandwidthScheduler *scheduler, const std::string &client, const char *uri)
+    : scheduler_(scheduler), client_(client) {
+  this->class_index_ = scheduler->classify_(uri);
+  scheduler->open_(client, this->class_index_);
+}
+
+BandwidthFlow::~BandwidthFlow() { this->scheduler_->close_(this->client_, this->class_index_); }
+
+void BandwidthFlow::consume(size_t len) {
+  uint32_t delay_us = this->scheduler_->delay_for_(this->client_, len);
+  if (delay_us >= 1000)
+    vTaskDelay(std::max<TickType_t>(1, pdMS_TO_TICKS(delay_us / 1000)));
+}
+
+BandwidthScheduler::BandwidthScheduler() {
+  this->lock_ = xSemaphoreCreateMutex();
+  // Classe par défaut, utilisée quand aucun préfixe ne correspond
+  this->classes_.push_back(PriorityClass{"default", 1, ""});
+}
+
+void BandwidthScheduler::add_class(const std::string &name, uint8_t weight, const std::string &uri_prefix) {
+  if (this->classes_.size() >= MAX_CLASSES)
+    return;
+  // Insérée avant la classe par défaut, qui reste en dernier
+  this->classes_.insert(this->classes_.end() - 1, PriorityClass{name, std::max<uint8_t>(weight, 1), uri_prefix});
+}
+
+uint8_t BandwidthScheduler::classify_(const char *uri) const {
+  for (size_t i = 0; i + 1 < this->classes_.size(); i++) {
+    const std::string &prefix = this->classes_[i].uri_prefix;
+    if (strncmp(uri, prefix.c_str(), prefix.size()) == 0)
+      return i;
+  }
+  return this->classes_.size() - 1;
+}
+
+void BandwidthScheduler::refill_(int64_t &tokens, int64_t &last_us, uint32_t rate, int64_t now) {
+  if (last_us == 0) {
+    last_us = now;
+    return;
+  }
+  int64_t burst = (int64_t) rate * BURST_US / 1000000;
+  tokens = std::min(burst, tokens + (now - last_us) * (int64_t) rate / 1000000);
+  last_us = now;
+}
+
+void BandwidthScheduler::open_(const std::string &client, uint8_t cls) {
+  int64_t now = esp_timer_get_time();
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+
+  // Purge des clients partis depuis longtemps
+  for (auto it = this->clients_.begin(); it != this->clients_.end();) {
+    if (it->second.weight == 0 && now - it->second.last_active_us > CLIENT_EXPIRY_US) {
+      it = this->clients_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  Client &c = this->clients_[client];
+  c.active[cls]++;
+  c.last_active_us = now;
+  if (c.window_start_us == 0)
+    c.window_start_us = now;
+  this->rebalance_();
+  xSemaphoreGive(this->lock_);
+}
+
+void BandwidthScheduler::close_(const std::string &client, uint8_t cls) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto it = this->clients_.find(client);
+  if (it != this->clients_.end()) {
+    if (it->second.active[cls] > 0)
+      it->second.active[cls]--;
+    it->second.last_active_us = esp_timer_get_time();
+    this->rebalance_();
+  }
+  xSemaphoreGive(this->lock_);
+}
+
+// Appelé avec le verrou pris
+void BandwidthScheduler::rebalance_() {
+  uint32_t total_weight = 0;
+  for (auto &entry : this->clients_) {
+    Client &c = entry.second;
+    c.weight = 0;
+    for (size_t i = 0; i < this->classes_.size(); i++) {
+      if (c.active[i] > 0)
+        c.weight = std::max(c.weight, this->classes_[i].weight);
+    }
+    total_weight += c.weight;
+  }
+
+  for (auto &entry : this->clients_) {
+    Client &c = entry.second;
+    if (c.weight == 0) {
+      c.rate = 0;
+      continue;
+    }
+    uint32_t rate = 0;
+    if (this->global_rate_ > 0)
+      rate = (uint64_t) this->global_rate_ * c.weight / total_weight;
+    if (this->client_rate_ > 0)
+      rate = rate == 0 ? this->client_rate_ : std::min(rate, this->client_rate_);
+    c.rate = rate;
+  }
+  ESP_LOGV(TAG, "Répartition recalculée: %u clients actifs, poids total %u", (unsigned) this->clients_.size(),
+           (unsigned) total_weight);
+}
+
+uint32_t BandwidthScheduler::delay_for_(const std::string &client, size_t len) {
+  int64_t now = esp_timer_get_time();
+  int64_t delay_us = 0;
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto it = this->clients_.find(client);
+  if (it == this->clients_.end()) {
+    xSemaphoreGive(this->lock_);
+    return 0;
+  }
+  Client &c = it->second;
+
+  // Jetons consommés d'avance : le solde négatif se traduit en attente
+  if (c.rate > 0) {
+    refill_(c.tokens, c.last_refill_us, c.rate, now);
+    c.tokens -= len;
+    if (c.tokens < 0)
+      delay_us = -c.tokens * 1000000 / c.rate;
+  }
+  if (this->global_rate_ > 0) {
+    refill_(this->global_tokens_, this->global_last_refill_us_, this->global_rate_, now);
+    this->global_tokens_ -= len;
+    if (this->global_tokens_ < 0)
+      delay_us = std::max(delay_us, -this->global_tokens_ * 1000000 / this->global_rate_);
+  }
+
+  c.bytes_sent += len;
+  c.window_bytes += len;
+  c.last_active_us = now;
+  if (now - c.window_start_us >= 1000000) {
+    c.achieved_rate = c.window_bytes * 1000000 / (now - c.window_start_us);
+    c.window_bytes = 0;
+    c.window_start_us = now;
+  }
+  xSemaphoreGive(this->lock_);
+  return (uint32_t) delay_us;
+}
+
+std::vector<ClientRateStats> BandwidthScheduler::get_client_stats() {
+  std::vector<ClientRateStats> stats;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  for (auto &entry : this->clients_) {
+    const Client &c = entry.second;
+    ClientRateStats s;
+    s.client = entry.first;
+    s.priority_class = "-";
+    s.active_transfers = 0;
+    for (size_t i = 0; i < this->classes_.size(); i++) {
+      s.active_transfers += c.active[i];
+      if (c.active[i] > 0 && this->classes_[i].weight == c.weight)
+        s.priority_class = this->classes_[i].name.c_str();
+    }
+    s.bytes_sent = c.bytes_sent;
+    s.allowed_rate = c.rate;
+    s.achieved_rate = s.active_transfers > 0 ? c.achieved_rate : 0;
+    stats.push_back(s);
+  }
+  xSemaphoreGive(this->lock_);
+  return stats;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
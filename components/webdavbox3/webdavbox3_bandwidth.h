@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+// Débit obtenu par un client, pour le diagnostic
+struct ClientRateStats {
+  std::string client;
+  const char *priority_class;
+  uint8_t active_transfers;
+  uint64_t bytes_sent;
+  uint32_t allowed_rate;   // Part équitable courante (octets/s, 0 = illimité)
+  uint32_t achieved_rate;  // Débit mesuré sur la dernière seconde (octets/s)
+};
+
+class BandwidthScheduler;
+
+/**
+ * @brief Transfert en cours d'un client ; ouvert pour la durée d'une réponse GET.
+ */
+class BandwidthFlow {
+ public:
+  BandwidthFlow(BandwidthScheduler *scheduler, const std::string &client, const char *uri);
+  ~BandwidthFlow();
+  BandwidthFlow(const BandwidthFlow &) = delete;
+  BandwidthFlow &operator=(const BandwidthFlow &) = delete;
+
+  // À appeler avant d'envoyer len octets : bloque le temps nécessaire pour
+  // rester dans la part allouée au client et sous le plafond global
+  void consume(size_t len);
+
+ protected:
+  BandwidthScheduler *scheduler_;
+  std::string client_;
+  uint8_t class_index_;
+};
+
+/**
+ * @brief Partage équitable et pondéré du débit sortant entre clients.
+ *
+ * Chaque client (adresse IP) a un seau à jetons dont le débit est sa part du
+ * plafond global, au prorata du poids de sa classe de priorité parmi les
+ * clients actifs, bornée par le plafond par client. Un seau global garantit
+ * le plafond total. Les parts sont recalculées à chaque arrivée ou départ.
+ */
+class BandwidthScheduler {
+ public:
+  BandwidthScheduler();
+
+  void set_global_rate(uint32_t bytes_per_sec) { this->global_rate_ = bytes_per_sec; }
+  void set_client_rate(uint32_t bytes_per_sec) { this->client_rate_ = bytes_per_sec; }
+  // Classe de priorité sélectionnée par préfixe d'URI (le premier qui correspond)
+  void add_class(const std::string &name, uint8_t weight, const std::string &uri_prefix);
+
+  bool is_enabled() const { return this->global_rate_ > 0 || this->client_rate_ > 0; }
+  uint32_t get_global_rate() const { return this->global_rate_; }
+  uint32_t get_client_rate() const { return this->client_rate_; }
+
+  std::vector<ClientRateStats> get_client_stats();
+
+ protected:
+  friend class BandwidthFlow;
+
+  struct PriorityClass {
+    std::string name;
+    uint8_t weight;
+    std::string uri_prefix;
+  };
+  struct Client {
+    uint8_t active[8]{};  // Transferts actifs par classe
+    uint8_t weight{0};    // Poids de la meilleure classe active
+    uint32_t rate{0};
+    int64_t tokens{0};
+    int64_t last_refill_us{0};
+    uint64_t bytes_sent{0};
+    uint64_t window_bytes{0};
+    int64_t window_start_us{0};
+    uint32_t achieved_rate{0};
+    int64_t last_active_us{0};
+  };
+
+  uint8_t classify_(const char *uri) const;
+  void open_(const std::string &client, uint8_t cls);
+  void close_(const std::string &client, uint8_t cls);
+  uint32_t delay_for_(const std::string &client, size_t len);
+  void rebalance_();
+  static void refill_(int64_t &tokens, int64_t &last_us, uint32_t rate, int64_t now);
+
+  uint32_t global_rate_{0};
+  uint32_t client_rate_{0};
+  std::vector<PriorityClass> classes_;
+  std::map<std::string, Client> clients_;
+  int64_t global_tokens_{0};
+  int64_t global_last_refill_us_{0};
+  SemaphoreHandle_t lock_{nullptr};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,176 @@
+#include "webdavbox3_buffers.h"
+#include "esphome/core/log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+#include <algorithm>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.buffers";
+
+// Ligne de cache L2 de l'ESP32-P4 : évite le partage de ligne avec d'autres données
+static const size_t BUFFER_ALIGNMENT = 64;
+
+TransferBuffer &TransferBuffer::operator=(TransferBuffer &&other) noexcept {
+  if (this != &other) {
+    this->release();
+    this->pool_ = other.pool_;
+    this->cls_ = other.cls_;
+    this->data_ = other.data_;
+    this->size_ = other.size_;
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+void TransferBuffer::release() {
+  if (this->pool_ != nullptr && this->data_ != nullptr)
+    this->pool_->give_back_(this->cls_, this->data_);
+  this->pool_ = nullptr;
+  this->data_ = nullptr;
+  this->size_ = 0;
+}
+
+TransferBufferPool::~TransferBufferPool() {
+  for (auto &c : this->classes_) {
+    for (char *buf : c.storage)
+      heap_caps_free(buf);
+    if (c.free != nullptr)
+      vQueueDelete(c.free);
+  }
+  if (this->lock_ != nullptr)
+    vSemaphoreDelete(this->lock_);
+}
+
+void TransferBufferPool::add_class(size_t size, uint16_t count) {
+  if (size == 0 || count == 0)
+    return;
+  SizeClass c;
+  c.stats.size = (size + BUFFER_ALIGNMENT - 1) & ~(BUFFER_ALIGNMENT - 1);
+  c.stats.count = count;
+  auto pos = std::find_if(this->classes_.begin(), this->classes_.end(),
+                          [&](const SizeClass &other) { return other.stats.size > c.stats.size; });
+  this->classes_.insert(pos, std::move(c));
+}
+
+bool TransferBufferPool::init() {
+  this->lock_ = xSemaphoreCreateMutex();
+  if (this->lock_ == nullptr)
+    return false;
+
+  bool ok = true;
+  for (auto &c : this->classes_) {
+    c.free = xQueueCreate(c.stats.count, sizeof(char *));
+    if (c.free == nullptr)
+      return false;
+
+    for (uint16_t i = 0; i < c.stats.count; i++) {
+      // PSRAM accessible en DMA d'abord, puis PSRAM simple, puis RAM interne DMA
+      char *buf = (char *) heap_caps_aligned_alloc(BUFFER_ALIGNMENT, c.stats.size, MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+      if (buf == nullptr)
+        buf = (char *) heap_caps_aligned_alloc(BUFFER_ALIGNMENT, c.stats.size, MALLOC_CAP_SPIRAM);
+      if (buf == nullptr)
+        buf = (char *) heap_caps_aligned_alloc(BUFFER_ALIGNMENT, c.stats.size, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+      if (buf == nullptr) {
+        ESP_LOGE(TAG, "Impossible d'allouer le buffer %u/%u de %zu octets", i + 1, c.stats.count, c.stats.size);
+        ok = false;
+        break;
+      }
+      c.storage.push_back(buf);
+      xQueueSend(c.free, &buf, 0);
+    }
+    // Le pool fonctionne avec ce qui a pu être alloué
+    c.stats.count = c.storage.size();
+  }
+
+  size_t total = 0;
+  for (auto &c : this->classes_)
+    total += c.stats.size * c.stats.count;
+  ESP_LOGI(TAG, "Pool de transfert: %zu classes, %zu octets préalloués", this->classes_.size(), total);
+  return ok;
+}
+
+bool TransferBufferPool::try_take_(uint8_t cls, TickType_t timeout, char **data) {
+  SizeClass &c = this->classes_[cls];
+  if (c.storage.empty())
+    return false;
+  return xQueueReceive(c.free, data, timeout) == pdTRUE;
+}
+
+TransferBuffer TransferBufferPool::borrow(size_t min_size, TickType_t timeout) {
+  if (!this->is_ready())
+    return TransferBuffer();
+
+  // Plus petite classe suffisante, ou la plus grande à défaut
+  uint8_t first = this->classes_.size() - 1;
+  for (uint8_t i = 0; i < this->classes_.size(); i++) {
+    if (this->classes_[i].stats.size >= min_size) {
+      first = i;
+      break;
+    }
+  }
+
+  char *data = nullptr;
+  uint8_t cls = first;
+  bool waited = false;
+  int64_t wait_start = 0;
+  for (; cls < this->classes_.size(); cls++) {
+    if (this->try_take_(cls, 0, &data))
+      break;
+  }
+  if (data == nullptr) {
+    // Tout est emprunté : attendre que la classe demandée se libère
+    cls = first;
+    waited = true;
+    wait_start = esp_timer_get_time();
+    this->try_take_(cls, timeout, &data);
+  }
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  BufferClassStats &s = this->classes_[cls].stats;
+  if (waited) {
+    uint32_t wait_us = esp_timer_get_time() - wait_start;
+    s.waits++;
+    s.wait_us += wait_us;
+    s.max_wait_us = std::max(s.max_wait_us, wait_us);
+  }
+  if (data == nullptr) {
+    s.timeouts++;
+  } else {
+    s.borrows++;
+    s.in_use++;
+    s.high_water = std::max(s.high_water, s.in_use);
+  }
+  xSemaphoreGive(this->lock_);
+
+  if (data == nullptr) {
+    ESP_LOGW(TAG, "Aucun buffer de %zu octets libre après %u ms", s.size, (unsigned) pdTICKS_TO_MS(timeout));
+    return TransferBuffer();
+  }
+  return TransferBuffer(this, cls, data, s.size);
+}
+
+void TransferBufferPool::give_back_(uint8_t cls, char *data) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->classes_[cls].stats.in_use--;
+  xSemaphoreGive(this->lock_);
+  xQueueSend(this->classes_[cls].free, &data, 0);
+}
+
+std::vector<BufferClassStats> TransferBufferPool::get_stats() {
+  std::vector<BufferClassStats> stats;
+  if (this->lock_ == nullptr)
+    return stats;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  for (auto &c : this->classes_)
+    stats.push_back(c.stats);
+  xSemaphoreGive(this->lock_);
+  return stats;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+class TransferBufferPool;
+
+// Télémétrie d'une classe de taille du pool
+struct BufferClassStats {
+  size_t size{0};
+  uint16_t count{0};
+  uint16_t in_use{0};
+  uint16_t high_water{0};  // Nombre max de buffers empruntés simultanément
+  uint32_t borrows{0};
+  uint32_t waits{0};       // Emprunts qui ont dû attendre un buffer libre
+  uint32_t timeouts{0};
+  uint64_t wait_us{0};
+  uint32_t max_wait_us{0};
+};
+
+/**
+ * @brief Buffer emprunté au pool, rendu automatiquement à la destruction.
+ */
+class TransferBuffer {
+ public:
+  TransferBuffer() = default;
+  TransferBuffer(TransferBuffer &&other) noexcept { *this = std::move(other); }
+  TransferBuffer &operator=(TransferBuffer &&other) noexcept;
+  TransferBuffer(const TransferBuffer &) = delete;
+  TransferBuffer &operator=(const TransferBuffer &) = delete;
+  ~TransferBuffer() { this->release(); }
+
+  char *data() const { return this->data_; }
+  size_t size() const { return this->size_; }
+  explicit operator bool() const { return this->data_ != nullptr; }
+  void release();
+
+ protected:
+  friend class TransferBufferPool;
+  TransferBuffer(TransferBufferPool *pool, uint8_t cls, char *data, size_t size)
+      : pool_(pool), cls_(cls), data_(data), size_(size) {}
+
+  TransferBufferPool *pool_{nullptr};
+  uint8_t cls_{0};
+  char *data_{nullptr};
+  size_t size_{0};
+};
+
+/**
+ * @brief Pool de buffers de transfert préalloués au démarrage, alignés sur une
+ * ligne de cache et accessibles en DMA, répartis en classes de taille.
+ *
+ * Les buffers ne sont jamais libérés : la PSRAM ne se fragmente plus au fil
+ * des requêtes et un transfert ne bascule plus en RAM interne en cours de route.
+ */
+class TransferBufferPool {
+ public:
+  ~TransferBufferPool();
+
+  // À appeler avant init() ; les classes sont triées par taille croissante
+  void add_class(size_t size, uint16_t count);
+  bool init();
+  bool is_ready() const { return !this->classes_.empty() && this->classes_[0].free != nullptr; }
+
+  // Emprunte le plus petit buffer d'au moins min_size octets (ou le plus grand
+  // disponible si aucune classe n'est assez grande). Se rabat sur une classe
+  // plus grande si la sienne est épuisée, sinon attend jusqu'à timeout.
+  // Le buffer retourné est vide si le délai expire.
+  TransferBuffer borrow(size_t min_size, TickType_t timeout);
+
+  size_t largest_size() const { return this->classes_.empty() ? 0 : this->classes_.back().stats.size; }
+  std::vector<BufferClassStats> get_stats();
+
+ protected:
+  friend class TransferBuffer;
+
+  struct SizeClass {
+    std::vector<char *> storage;
+    QueueHandle_t free{nullptr};
+    BufferClassStats stats;
+  };
+
+  bool try_take_(uint8_t cls, TickType_t timeout, char **data);
+  void give_back_(uint8_t cls, char *data);
+
+  std::vector<SizeClass> classes_;
+  SemaphoreHandle_t lock_{nullptr};  // Protège les compteurs
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,126 @@
+#include "webdavbox3_cache.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.cache";
+
+FileContentCache::FileContentCache() { this->lock_ = xSemaphoreCreateMutex(); }
+
+FileContentCache::~FileContentCache() {
+  this->clear();
+  if (this->lock_ != nullptr)
+    vSemaphoreDelete(this->lock_);
+}
+
+void FileContentCache::configure(size_t budget, size_t max_entry_size) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->budget_ = budget;
+  this->max_entry_size_ = max_entry_size < budget ? max_entry_size : budget;
+  xSemaphoreGive(this->lock_);
+  if (budget == 0)
+    this->clear();
+}
+
+std::shared_ptr<const uint8_t> FileContentCache::lookup(const std::string &path, time_t mtime, size_t size) {
+  std::shared_ptr<const uint8_t> data;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto found = this->index_.find(path);
+  if (found != this->index_.end()) {
+    auto it = found->second;
+    if (it->mtime == mtime && it->size == size) {
+      this->lru_.splice(this->lru_.begin(), this->lru_, it);
+      data = it->data;
+    } else {
+      // Fichier modifié hors du serveur : entrée périmée
+      this->erase_(it);
+      this->stats_.invalidations++;
+    }
+  }
+  if (data) {
+    this->stats_.hits++;
+  } else {
+    this->stats_.misses++;
+  }
+  xSemaphoreGive(this->lock_);
+  return data;
+}
+
+void FileContentCache::insert(const std::string &path, time_t mtime, size_t size,
+                              std::shared_ptr<const uint8_t> data) {
+  if (!this->accepts(size) || !data)
+    return;
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto found = this->index_.find(path);
+  if (found != this->index_.end())
+    this->erase_(found->second);
+
+  while (!this->lru_.empty() && this->stats_.bytes_used + size > this->budget_) {
+    ESP_LOGV(TAG, "Éviction: %s (%zu octets)", this->lru_.back().path.c_str(), this->lru_.back().size);
+    this->erase_(std::prev(this->lru_.end()));
+    this->stats_.evictions++;
+  }
+
+  this->lru_.push_front(Entry{path, mtime, size, std::move(data)});
+  this->index_[path] = this->lru_.begin();
+  this->stats_.bytes_used += size;
+  this->stats_.entries = this->lru_.size();
+  xSemaphoreGive(this->lock_);
+}
+
+void FileContentCache::invalidate(const std::string &path) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto found = this->index_.find(path);
+  if (found != this->index_.end()) {
+    this->erase_(found->second);
+    this->stats_.invalidations++;
+  }
+  xSemaphoreGive(this->lock_);
+}
+
+void FileContentCache::invalidate_prefix(const std::string &dir) {
+  std::string prefix = dir;
+  if (prefix.empty() || prefix.back() != '/')
+    prefix += '/';
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  for (auto it = this->lru_.begin(); it != this->lru_.end();) {
+    auto next = std::next(it);
+    if (it->path.compare(0, prefix.size(), prefix) == 0) {
+      this->erase_(it);
+      this->stats_.invalidations++;
+    }
+    it = next;
+  }
+  xSemaphoreGive(this->lock_);
+}
+
+void FileContentCache::clear() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->index_.clear();
+  this->lru_.clear();
+  this->stats_.bytes_used = 0;
+  this->stats_.entries = 0;
+  xSemaphoreGive(this->lock_);
+}
+
+FileCacheStats FileContentCache::get_stats() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  FileCacheStats stats = this->stats_;
+  xSemaphoreGive(this->lock_);
+  return stats;
+}
+
+// Appelé avec le verrou pris ; les données restent valides tant qu'une
+// réponse en cours détient encore une référence
+void FileContentCache::erase_(EntryList::iterator it) {
+  this->stats_.bytes_used -= it->size;
+  this->index_.erase(it->path);
+  this->lru_.erase(it);
+  this->stats_.entries = this->lru_.size();
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+struct FileCacheStats {
+  uint32_t hits{0};
+  uint32_t misses{0};
+  uint32_t evictions{0};
+  uint32_t invalidations{0};
+  size_t bytes_used{0};
+  size_t entries{0};
+};
+
+/**
+ * @brief Cache LRU en PSRAM du contenu des petits fichiers servis en GET.
+ *
+ * Une entrée n'est valide que si la taille et la date de modification du
+ * fichier sont inchangées ; les handlers qui modifient la carte invalident
+ * explicitement les chemins touchés.
+ */
+class FileContentCache {
+ public:
+  FileContentCache();
+  ~FileContentCache();
+
+  void configure(size_t budget, size_t max_entry_size);
+  bool accepts(size_t size) const { return this->budget_ > 0 && size > 0 && size <= this->max_entry_size_; }
+  size_t get_budget() const { return this->budget_; }
+  size_t get_max_entry_size() const { return this->max_entry_size_; }
+
+  // Retourne le contenu en cache si la clé (chemin, mtime, taille) correspond
+  std::shared_ptr<const uint8_t> lookup(const std::string &path, time_t mtime, size_t size);
+  // Ajoute une entrée en évinçant les moins récemment utilisées si nécessaire
+  void insert(const std::string &path, time_t mtime, size_t size, std::shared_ptr<const uint8_t> data);
+
+  void invalidate(const std::string &path);
+  // Invalide toutes les entrées situées sous un répertoire
+  void invalidate_prefix(const std::string &dir);
+  void clear();
+
+  FileCacheStats get_stats();
+
+ protected:
+  struct Entry {
+    std::string path;
+    time_t mtime;
+    size_t size;
+    std::shared_ptr<const uint8_t> data;
+  };
+  using EntryList = std::list<Entry>;
+
+  void erase_(EntryList::iterator it);
+
+  size_t budget_{0};
+  size_t max_entry_size_{0};
+  EntryList lru_;  // Tête = entrée la plus récemment utilisée
+  std::unordered_map<std::string, EntryList::iterator> index_;
+  FileCacheStats stats_;
+  SemaphoreHandle_t lock_{nullptr};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,247 @@
+#include "webdavbox3_copy.h"
+#include "webdavbox3_listing.h"
+#include "webdavbox3_upload.h"
+#include "esphome/core/log.h"
+#include "esp_timer.h"
+
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.copy";
+
+// Buffer du repli séquentiel, et taille minimale de l'anneau
+static const size_t COPY_FALLBACK_CHUNK = 65536;
+// Avancement dans les logs au plus toutes les deux secondes
+static const int64_t PROGRESS_INTERVAL_US = 2000000;
+
+CopyEngine::CopyEngine(TransferBufferPool &pool, const std::string &tmp_dir, std::atomic<uint32_t> &seq)
+    : pool_(pool), tmp_dir_(tmp_dir), seq_(seq) {}
+
+bool CopyEngine::init(size_t depth, TickType_t timeout) {
+  this->start_us_ = esp_timer_get_time();
+  this->last_report_us_ = this->start_us_;
+  if (depth >= 2) {
+    // Plus grands buffers d'abord, sans attendre qu'un GET les rende
+    const size_t largest = this->pool_.largest_size();
+    if (largest > COPY_FALLBACK_CHUNK) {
+      this->pipeline_.reset(new WriteBehindPipeline(this->pool_, depth, largest));
+      if (!this->pipeline_->init(0))
+        this->pipeline_.reset();
+    }
+    if (!this->pipeline_) {
+      this->pipeline_.reset(new WriteBehindPipeline(this->pool_, depth, COPY_FALLBACK_CHUNK));
+      if (!this->pipeline_->init(timeout))
+        this->pipeline_.reset();
+    }
+  }
+  if (this->pipeline_) {
+    this->stats_.chunk_size = this->pipeline_->get_chunk_size();
+    this->stats_.overlapped = true;
+    return true;
+  }
+  this->buffer_ = this->pool_.borrow(COPY_FALLBACK_CHUNK, timeout);
+  this->stats_.chunk_size = this->buffer_.size();
+  return (bool) this->buffer_;
+}
+
+void CopyEngine::measure(const std::string &path, uint32_t &files, uint64_t &bytes) {
+  files = 0;
+  bytes = 0;
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return;
+  if (!S_ISDIR(st.st_mode)) {
+    files = 1;
+    bytes = (size_t) st.st_size;
+    return;
+  }
+  std::vector<std::string> pending{path};
+  DirEntry entry;
+  while (!pending.empty()) {
+    std::string dir = std::move(pending.back());
+    pending.pop_back();
+    DirectoryReader reader;
+    if (!reader.open(dir))
+      continue;
+    while (reader.next(entry)) {
+      if (entry.is_dir) {
+        pending.push_back(dir + "/" + entry.name);
+      } else {
+        files++;
+        bytes += entry.size;
+      }
+    }
+  }
+}
+
+bool CopyEngine::fail_(const std::string &path) {
+  if (this->failed_path_.empty()) {
+    this->failed_path_ = path;
+    ESP_LOGE(TAG, "Copie interrompue sur %s (errno: %d)", path.c_str(), errno);
+  }
+  this->report_progress_(true);
+  return false;
+}
+
+void CopyEngine::report_progress_(bool force) {
+  const int64_t now = esp_timer_get_time();
+  this->stats_.elapsed_us = now - this->start_us_;
+  if (!force && now - this->last_report_us_ < PROGRESS_INTERVAL_US)
+    return;
+  this->last_report_us_ = now;
+  const CopyStats &s = this->stats_;
+  ESP_LOGI(TAG, "Copie: %u/%u fichiers, %.1f/%.1f Mo, %.0f Ko/s", (unsigned) s.files, (unsigned) s.total_files,
+           s.bytes / 1048576.0f, s.total_bytes / 1048576.0f, s.throughput_kbps());
+}
+
+bool CopyEngine::copy_file(const std::string &src, const std::string &dst, size_t size) {
+  FILE *in = fopen(src.c_str(), "rb");
+  if (in == nullptr)
+    return this->fail_(src);
+  // Lectures directes dans les buffers du pool, sans tampon stdio
+  setvbuf(in, nullptr, _IONBF, 0);
+
+  UploadFile out;
+  if (!out.open(this->tmp_dir_, this->seq_++, dst, size)) {
+    fclose(in);
+    return this->fail_(dst);
+  }
+
+  size_t copied = 0;
+  bool ok = true;
+  if (this->pipeline_) {
+    // La source est lue pendant que l'écrivain vide les buffers précédents
+    ok = this->pipeline_->start(out.file()) == ESP_OK;
+    while (ok) {
+      char *data;
+      size_t capacity;
+      if (!this->pipeline_->acquire(&data, &capacity)) {
+        ok = false;
+        break;
+      }
+      int64_t read_start = esp_timer_get_time();
+      size_t r = fread(data, 1, capacity, in);
+      this->stats_.read_us += esp_timer_get_time() - read_start;
+      this->pipeline_->commit(r);
+      copied += r;
+      this->stats_.bytes += r;
+      if (r < capacity) {
+        ok = !ferror(in);
+        break;
+      }
+      this->report_progress_(false);
+    }
+    if (ok) {
+      ok = this->pipeline_->finish();
+    } else {
+      this->pipeline_->stop();
+    }
+    this->stats_.write_wait_us += this->pipeline_->get_stats().receiver_wait_us;
+  } else {
+    while (true) {
+      int64_t read_start = esp_timer_get_time();
+      size_t r = fread(this->buffer_.data(), 1, this->buffer_.size(), in);
+      this->stats_.read_us += esp_timer_get_time() - read_start;
+      if (r > 0 && fwrite(this->buffer_.data(), 1, r, out.file()) != r) {
+        ok = false;
+        break;
+      }
+      copied += r;
+      this->stats_.bytes += r;
+      if (r < this->buffer_.size()) {
+        ok = !ferror(in);
+        break;
+      }
+      this->report_progress_(false);
+    }
+  }
+  fclose(in);
+
+  if (!ok || !out.commit(copied)) {
+    out.abort();
+    return this->fail_(dst);
+  }
+  this->stats_.files++;
+  return true;
+}
+
+bool CopyEngine::copy_tree(const std::string &src, const std::string &dst, bool recursive) {
+  if (mkdir(dst.c_str(), 0755) != 0)
+    return this->fail_(dst);
+  this->stats_.dirs++;
+
+  struct Pending {
+    std::string src;
+    std::string dst;
+  };
+  std::vector<Pending> pending;
+  if (recursive)
+    pending.push_back({src, dst});
+  DirEntry entry;
+  while (!pending.empty()) {
+    Pending dir = std::move(pending.back());
+    pending.pop_back();
+    DirectoryReader reader;
+    if (!reader.open(dir.src))
+      return this->fail_(dir.src);
+    while (reader.next(entry)) {
+      std::string from = dir.src + "/" + entry.name;
+      std::string to = dir.dst + "/" + entry.name;
+      if (entry.is_dir) {
+        if (mkdir(to.c_str(), 0755) != 0)
+          return this->fail_(to);
+        this->stats_.dirs++;
+        pending.push_back({std::move(from), std::move(to)});
+      } else if (!this->copy_file(from, to, entry.size)) {
+        return false;
+      }
+    }
+  }
+  this->report_progress_(true);
+  return true;
+}
+
+bool remove_tree(const std::string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return errno == ENOENT;
+  if (!S_ISDIR(st.st_mode))
+    return unlink(path.c_str()) == 0;
+
+  // Fichiers supprimés dossier par dossier, dossiers ensuite du plus profond au plus haut
+  std::vector<std::string> dirs{path};
+  std::vector<std::string> files;
+  DirEntry entry;
+  for (size_t i = 0; i < dirs.size(); i++) {
+    files.clear();
+    {
+      DirectoryReader reader;
+      if (!reader.open(dirs[i]))
+        return false;
+      while (reader.next(entry)) {
+        if (entry.is_dir) {
+          dirs.push_back(dirs[i] + "/" + entry.name);
+        } else {
+          files.push_back(entry.name);
+        }
+      }
+    }
+    for (const auto &name : files) {
+      if (unlink((dirs[i] + "/" + name).c_str()) != 0)
+        return false;
+    }
+  }
+  for (auto it = dirs.rbegin(); it != dirs.rend(); ++it) {
+    if (rmdir(it->c_str()) != 0)
+      return false;
+  }
+  return true;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
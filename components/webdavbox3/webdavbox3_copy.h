@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "webdavbox3_buffers.h"
+#include "webdavbox3_transfer.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+struct CopyStats {
+  uint32_t files{0};
+  uint32_t dirs{0};
+  uint64_t bytes{0};
+  uint32_t total_files{0};  // Mesurés avant la copie
+  uint64_t total_bytes{0};
+  int64_t read_us{0};       // Lecture de la source, écritures en parallèle
+  int64_t write_wait_us{0};  // Lecteur bloqué, tous les buffers attendent la carte
+  int64_t elapsed_us{0};
+  size_t chunk_size{0};
+  bool overlapped{false};
+
+  float throughput_kbps() const { return this->elapsed_us > 0 ? this->bytes * 1000.0f / this->elapsed_us : 0.0f; }
+};
+
+/**
+ * @brief Copie côté serveur de fichiers et d'arbres.
+ *
+ * Parcours itératif (pile explicite, DirectoryReader en une passe). Chaque
+ * fichier passe par un temporaire préalloué (UploadFile) renommé en fin de
+ * copie ; la lecture de la source remplit des buffers PSRAM du pool pendant
+ * que l'anneau d'écriture différée vide les précédents sur la carte. Les
+ * buffers et l'anneau sont obtenus une fois pour toute la copie.
+ */
+class CopyEngine {
+ public:
+  CopyEngine(TransferBufferPool &pool, const std::string &tmp_dir, std::atomic<uint32_t> &seq);
+
+  // Anneau de depth buffers de la plus grande taille disponible ; repli sur
+  // un buffer unique (lecture et écriture en alternance)
+  bool init(size_t depth, TickType_t timeout);
+
+  // Fichiers et octets à copier sous path (lui compris s'il s'agit d'un fichier)
+  static void measure(const std::string &path, uint32_t &files, uint64_t &bytes);
+
+  void set_totals(uint32_t files, uint64_t bytes) {
+    this->stats_.total_files = files;
+    this->stats_.total_bytes = bytes;
+  }
+  // src dossier : dst créé, puis son contenu si recursive ; dst ne doit pas exister
+  bool copy_tree(const std::string &src, const std::string &dst, bool recursive);
+  // dst éventuel remplacé d'un coup en fin de copie
+  bool copy_file(const std::string &src, const std::string &dst, size_t size);
+
+  const CopyStats &get_stats() const { return this->stats_; }
+  // Premier chemin en échec, vide si la copie a réussi
+  const std::string &get_failed_path() const { return this->failed_path_; }
+
+ protected:
+  bool fail_(const std::string &path);
+  void report_progress_(bool force);
+
+  TransferBufferPool &pool_;
+  std::string tmp_dir_;
+  std::atomic<uint32_t> &seq_;
+  std::unique_ptr<WriteBehindPipeline> pipeline_;
+  TransferBuffer buffer_;  // Sans anneau
+  CopyStats stats_;
+  int64_t start_us_{0};
+  int64_t last_report_us_{0};
+  std::string failed_path_;
+};
+
+// Supprime un fichier ou un arbre, fichiers d'abord, sans récursion ; false au premier échec
+bool remove_tree(const std::string &path);
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,147 @@
+#include "webdavbox3_dircache.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.dircache";
+
+DirectoryCache::DirectoryCache() { this->lock_ = xSemaphoreCreateMutex(); }
+
+DirectoryCache::~DirectoryCache() {
+  this->clear();
+  if (this->lock_ != nullptr)
+    vSemaphoreDelete(this->lock_);
+}
+
+void DirectoryCache::configure(size_t budget) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->budget_ = budget;
+  xSemaphoreGive(this->lock_);
+  if (budget == 0)
+    this->clear();
+}
+
+std::string DirectoryCache::normalize(const std::string &path) {
+  std::string key = path;
+  while (key.size() > 1 && key.back() == '/')
+    key.pop_back();
+  return key;
+}
+
+size_t DirectoryCache::estimate_size(const DirListing &listing) {
+  size_t size = sizeof(DirListing) + listing.entries.capacity() * sizeof(DirEntry);
+  for (const auto &e : listing.entries)
+    size += e.name.capacity() + 1;
+  return size;
+}
+
+std::shared_ptr<const DirListing> DirectoryCache::lookup(const std::string &dir) {
+  if (!this->is_enabled())
+    return nullptr;
+
+  std::shared_ptr<const DirListing> listing;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto found = this->index_.find(normalize(dir));
+  if (found != this->index_.end()) {
+    this->lru_.splice(this->lru_.begin(), this->lru_, found->second);
+    listing = found->second->listing;
+    this->stats_.hits++;
+  } else {
+    this->stats_.misses++;
+  }
+  xSemaphoreGive(this->lock_);
+  return listing;
+}
+
+void DirectoryCache::insert(const std::string &dir, std::shared_ptr<const DirListing> listing, uint32_t generation) {
+  if (!this->is_enabled() || !listing)
+    return;
+  size_t size = estimate_size(*listing) + dir.size();
+  if (size > this->budget_ / 2)
+    return;  // Un répertoire géant ne doit pas vider tout le cache
+
+  std::string key = normalize(dir);
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  if (generation != this->generation_) {
+    xSemaphoreGive(this->lock_);
+    return;
+  }
+  this->erase_key_(key);
+  while (!this->lru_.empty() && this->stats_.bytes_used + size > this->budget_) {
+    ESP_LOGV(TAG, "Éviction: %s", this->lru_.back().dir.c_str());
+    this->erase_(std::prev(this->lru_.end()));
+    this->stats_.evictions++;
+  }
+  this->lru_.push_front(Entry{key, size, std::move(listing)});
+  this->index_[key] = this->lru_.begin();
+  this->stats_.bytes_used += size;
+  this->stats_.listings = this->lru_.size();
+  xSemaphoreGive(this->lock_);
+}
+
+void DirectoryCache::invalidate_path(const std::string &path) {
+  if (!this->is_enabled())
+    return;
+
+  std::string key = normalize(path);
+  std::string parent = key.substr(0, key.find_last_of('/'));
+  std::string prefix = key + "/";
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->generation_++;
+  uint32_t count = 0;
+  if (!parent.empty() && this->erase_key_(parent))
+    count++;
+  if (this->erase_key_(key))
+    count++;
+  // Descendants : seulement utile pour un répertoire supprimé ou déplacé
+  for (auto it = this->lru_.begin(); it != this->lru_.end();) {
+    auto next = std::next(it);
+    if (it->dir.compare(0, prefix.size(), prefix) == 0) {
+      this->erase_(it);
+      count++;
+    }
+    it = next;
+  }
+  this->stats_.invalidations += count;
+  xSemaphoreGive(this->lock_);
+
+  if (count > 0)
+    ESP_LOGD(TAG, "%s: %u listing(s) invalidé(s)", key.c_str(), (unsigned) count);
+}
+
+void DirectoryCache::clear() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->index_.clear();
+  this->lru_.clear();
+  this->stats_.bytes_used = 0;
+  this->stats_.listings = 0;
+  xSemaphoreGive(this->lock_);
+}
+
+DirCacheStats DirectoryCache::get_stats() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  DirCacheStats stats = this->stats_;
+  xSemaphoreGive(this->lock_);
+  return stats;
+}
+
+// Appelé avec le verrou pris
+bool DirectoryCache::erase_key_(const std::string &dir) {
+  auto found = this->index_.find(dir);
+  if (found == this->index_.end())
+    return false;
+  this->erase_(found->second);
+  return true;
+}
+
+void DirectoryCache::erase_(EntryList::iterator it) {
+  this->stats_.bytes_used -= it->size;
+  this->index_.erase(it->dir);
+  this->lru_.erase(it);
+  this->stats_.listings = this->lru_.size();
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
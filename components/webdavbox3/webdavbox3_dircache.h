@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "webdavbox3_listing.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+// Contenu d'un répertoire tel que lu sur la carte
+struct DirListing {
+  time_t mtime{0};  // Date du répertoire lui-même
+  std::vector<DirEntry> entries;
+};
+
+struct DirCacheStats {
+  uint32_t hits{0};
+  uint32_t misses{0};
+  uint32_t evictions{0};
+  uint32_t invalidations{0};
+  size_t bytes_used{0};
+  size_t listings{0};
+};
+
+/**
+ * @brief Cache LRU des listings de répertoires servis par PROPFIND.
+ *
+ * FAT ne met pas à jour la date d'un répertoire quand ses enfants changent :
+ * aucune validation n'est possible à la lecture, ce sont les opérations
+ * d'écriture (handlers WebDAV, API SdMmc, pré-compression) qui invalident
+ * précisément les répertoires touchés.
+ */
+class DirectoryCache {
+ public:
+  DirectoryCache();
+  ~DirectoryCache();
+
+  void configure(size_t budget);
+  bool is_enabled() const { return this->budget_ > 0; }
+  size_t get_budget() const { return this->budget_; }
+
+  // Les clés sont des chemins VFS sans '/' final
+  std::shared_ptr<const DirListing> lookup(const std::string &dir);
+  // Relevée avant de lire un répertoire : insert() ignore un listing lu
+  // pendant qu'une écriture invalidait le cache
+  uint32_t get_generation() const { return this->generation_; }
+  void insert(const std::string &dir, std::shared_ptr<const DirListing> listing, uint32_t generation);
+
+  // Après création, suppression ou modification de path : le listing du
+  // parent est périmé, ainsi que ceux de path et de ses descendants
+  void invalidate_path(const std::string &path);
+  void clear();
+
+  DirCacheStats get_stats();
+
+  static std::string normalize(const std::string &path);
+  static size_t estimate_size(const DirListing &listing);
+
+ protected:
+  struct Entry {
+    std::string dir;
+    size_t size;
+    std::shared_ptr<const DirListing> listing;
+  };
+  using EntryList = std::list<Entry>;
+
+  bool erase_key_(const std::string &dir);
+  void erase_(EntryList::iterator it);
+
+  size_t budget_{0};
+  EntryList lru_;  // Tête = listing le plus récemment utilisé
+  std::unordered_map<std::string, EntryList::iterator> index_;
+  DirCacheStats stats_;
+  volatile uint32_t generation_{0};
+  SemaphoreHandle_t lock_{nullptr};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,312 @@
+#include "webdavbox3_journal.h"
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_random.h"
+#include "esp_timer.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.journal";
+
+static const uint32_t INDEX_STRIDE = 64;
+static const size_t MAX_LINE = 512;
+
+// Lit une ligne sans le '\n' : 1 = complète, 0 = fin du fichier,
+// -1 = ligne trop longue ou interrompue (consommée, à ignorer)
+static int read_line(FILE *f, char *line, size_t size) {
+  if (fgets(line, size, f) == nullptr)
+    return 0;
+  size_t len = strlen(line);
+  if (len > 0 && line[len - 1] == '\n') {
+    line[len - 1] = '\0';
+    return 1;
+  }
+  int c;
+  while ((c = fgetc(f)) != EOF && c != '\n') {
+  }
+  return -1;
+}
+
+ChangeJournal::ChangeJournal() { this->lock_ = xSemaphoreCreateMutex(); }
+
+ChangeJournal::~ChangeJournal() {
+  if (this->file_ != nullptr)
+    fclose(this->file_);
+  if (this->lock_ != nullptr)
+    vSemaphoreDelete(this->lock_);
+}
+
+void ChangeJournal::configure(const std::string &dir, uint32_t max_records) {
+  std::string base = dir;
+  while (!base.empty() && base.back() == '/')
+    base.pop_back();
+  this->path_ = base + "/journal.log";
+  this->tmp_path_ = base + "/journal.tmp";
+  this->max_records_ = max_records;
+}
+
+bool ChangeJournal::open() {
+  if (!this->is_enabled())
+    return false;
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  std::string dir = this->path_.substr(0, this->path_.find_last_of('/'));
+  if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+    ESP_LOGE(TAG, "Impossible de créer %s (errno: %d)", dir.c_str(), errno);
+  }
+  // Compactage interrompu entre la suppression et le renommage
+  struct stat st;
+  if (stat(this->path_.c_str(), &st) != 0 && stat(this->tmp_path_.c_str(), &st) == 0) {
+    rename(this->tmp_path_.c_str(), this->path_.c_str());
+  }
+  bool ok = this->load_() || this->create_();
+  xSemaphoreGive(this->lock_);
+
+  if (ok) {
+    ESP_LOGI(TAG, "Journal %s: époque %08x, jetons %u..%u (%u enregistrements)", this->path_.c_str(),
+             (unsigned) this->epoch_, (unsigned) this->min_seq_, (unsigned) this->last_seq_,
+             (unsigned) this->records_);
+  }
+  return ok;
+}
+
+bool ChangeJournal::parse_record_(const char *line, uint32_t &seq, char &op, const char *&path) {
+  char *end;
+  unsigned long value = strtoul(line, &end, 10);
+  if (end == line || end[0] != ' ' || end[1] == '\0' || end[2] != ' ')
+    return false;
+  seq = value;
+  op = end[1];
+  path = end + 3;
+  return true;
+}
+
+// Appelé avec le verrou pris
+bool ChangeJournal::load_() {
+  FILE *f = fopen(this->path_.c_str(), "r");
+  if (f == nullptr)
+    return false;
+
+  char line[MAX_LINE];
+  unsigned epoch, min_seq;
+  if (read_line(f, line, sizeof(line)) != 1 || sscanf(line, "WDJ1 %x %u", &epoch, &min_seq) != 2) {
+    ESP_LOGW(TAG, "En-tête de journal invalide, nouveau journal");
+    fclose(f);
+    return false;
+  }
+  this->epoch_ = epoch;
+  this->min_seq_ = min_seq;
+  this->last_seq_ = min_seq;
+  this->records_ = 0;
+  this->index_.clear();
+
+  bool dirty = false;
+  while (true) {
+    long offset = ftell(f);
+    int status = read_line(f, line, sizeof(line));
+    if (status == 0)
+      break;
+    uint32_t seq;
+    char op;
+    const char *path;
+    if (status < 0 || !parse_record_(line, seq, op, path) || seq <= this->last_seq_) {
+      dirty = true;  // Écriture interrompue par une coupure
+      continue;
+    }
+    if (this->records_ % INDEX_STRIDE == 0)
+      this->index_.emplace_back(seq, offset);
+    this->records_++;
+    this->last_seq_ = seq;
+  }
+  fclose(f);
+
+  this->file_ = fopen(this->path_.c_str(), "a");
+  if (this->file_ == nullptr) {
+    ESP_LOGE(TAG, "Impossible d'ouvrir %s en écriture (errno: %d)", this->path_.c_str(), errno);
+    return false;
+  }
+  if (dirty) {
+    ESP_LOGW(TAG, "Lignes invalides dans le journal, réécriture");
+    this->compact_(this->records_);
+  }
+  return true;
+}
+
+// Appelé avec le verrou pris
+bool ChangeJournal::create_() {
+  if (this->file_ != nullptr) {
+    fclose(this->file_);
+    this->file_ = nullptr;
+  }
+  this->epoch_ = esp_random();
+  if (this->epoch_ == 0)
+    this->epoch_ = 1;
+  this->min_seq_ = 0;
+  this->last_seq_ = 0;
+  this->records_ = 0;
+  this->index_.clear();
+
+  FILE *f = fopen(this->path_.c_str(), "w");
+  if (f == nullptr) {
+    ESP_LOGE(TAG, "Impossible de créer %s (errno: %d)", this->path_.c_str(), errno);
+    return false;
+  }
+  fprintf(f, "WDJ1 %08x %u\n", (unsigned) this->epoch_, (unsigned) this->min_seq_);
+  fclose(f);
+  this->file_ = fopen(this->path_.c_str(), "a");
+  return this->file_ != nullptr;
+}
+
+uint32_t ChangeJournal::append(JournalOp op, const std::string &path) {
+  if (path.size() + 16 > MAX_LINE) {
+    ESP_LOGW(TAG, "Chemin trop long pour le journal: %s", path.c_str());
+    return 0;
+  }
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  if (this->file_ == nullptr) {
+    xSemaphoreGive(this->lock_);
+    return 0;
+  }
+  fseek(this->file_, 0, SEEK_END);
+  long offset = ftell(this->file_);
+  uint32_t seq = this->last_seq_ + 1;
+  // fsync : la taille du fichier dans l'entrée FAT n'est mise à jour qu'à la synchronisation
+  if (fprintf(this->file_, "%u %c %s\n", (unsigned) seq, (char) op, path.c_str()) < 0 || fflush(this->file_) != 0 ||
+      fsync(fileno(this->file_)) != 0) {
+    ESP_LOGE(TAG, "Écriture du journal impossible (errno: %d)", errno);
+    xSemaphoreGive(this->lock_);
+    return 0;
+  }
+  if (this->records_ % INDEX_STRIDE == 0)
+    this->index_.emplace_back(seq, offset);
+  this->records_++;
+  this->last_seq_ = seq;
+  ESP_LOGV(TAG, "%u %c %s", (unsigned) seq, (char) op, path.c_str());
+
+  if (this->records_ > this->max_records_)
+    this->compact_(this->max_records_ / 2);
+  xSemaphoreGive(this->lock_);
+  return seq;
+}
+
+bool ChangeJournal::read_since(uint32_t since, const Visitor &visitor) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  FILE *f = this->file_ != nullptr ? fopen(this->path_.c_str(), "r") : nullptr;
+  if (f == nullptr) {
+    xSemaphoreGive(this->lock_);
+    return false;
+  }
+
+  char line[MAX_LINE];
+  // Dernier point d'index qui précède le premier enregistrement voulu
+  auto it = std::upper_bound(this->index_.begin(), this->index_.end(), since + 1,
+                             [](uint32_t seq, const std::pair<uint32_t, long> &entry) { return seq < entry.first; });
+  if (it != this->index_.begin()) {
+    fseek(f, std::prev(it)->second, SEEK_SET);
+  } else {
+    read_line(f, line, sizeof(line));  // En-tête
+  }
+
+  int status;
+  while ((status = read_line(f, line, sizeof(line))) != 0) {
+    uint32_t seq;
+    char op;
+    const char *path;
+    if (status < 0 || !parse_record_(line, seq, op, path) || seq <= since)
+      continue;
+    if (!visitor(seq, op, path))
+      break;
+  }
+  fclose(f);
+  xSemaphoreGive(this->lock_);
+  return true;
+}
+
+// Appelé avec le verrou pris : conserve les keep derniers enregistrements
+// valides et relève le plus petit jeton valide d'autant
+bool ChangeJournal::compact_(uint32_t keep) {
+  const uint32_t drop = this->records_ > keep ? this->records_ - keep : 0;
+  int64_t start_us = esp_timer_get_time();
+
+  if (this->file_ != nullptr) {
+    fclose(this->file_);
+    this->file_ = nullptr;
+  }
+  FILE *src = fopen(this->path_.c_str(), "r");
+  FILE *dst = src != nullptr ? fopen(this->tmp_path_.c_str(), "w") : nullptr;
+  if (dst == nullptr) {
+    ESP_LOGE(TAG, "Compactage impossible (errno: %d)", errno);
+    if (src != nullptr)
+      fclose(src);
+    this->file_ = fopen(this->path_.c_str(), "a");
+    return false;
+  }
+
+  char line[MAX_LINE];
+  read_line(src, line, sizeof(line));  // En-tête, réécrit avec le nouveau minimum
+  uint32_t min_seq = this->min_seq_;
+  uint32_t skipped = 0;
+  bool header_written = false;
+  uint32_t last_seq = min_seq;
+  int status;
+  while ((status = read_line(src, line, sizeof(line))) != 0) {
+    uint32_t seq;
+    char op;
+    const char *path;
+    if (status < 0 || !parse_record_(line, seq, op, path) || seq <= last_seq)
+      continue;
+    last_seq = seq;
+    if (skipped < drop) {
+      min_seq = seq;
+      skipped++;
+      continue;
+    }
+    if (!header_written) {
+      fprintf(dst, "WDJ1 %08x %u\n", (unsigned) this->epoch_, (unsigned) min_seq);
+      header_written = true;
+    }
+    fputs(line, dst);
+    fputc('\n', dst);
+  }
+  if (!header_written)
+    fprintf(dst, "WDJ1 %08x %u\n", (unsigned) this->epoch_, (unsigned) min_seq);
+  fclose(src);
+  fflush(dst);
+  fsync(fileno(dst));
+  fclose(dst);
+
+  // FAT : rename() n'écrase pas la destination
+  remove(this->path_.c_str());
+  if (rename(this->tmp_path_.c_str(), this->path_.c_str()) != 0) {
+    ESP_LOGE(TAG, "Renommage du journal compacté impossible (errno: %d)", errno);
+    return false;
+  }
+  this->compactions_++;
+  ESP_LOGI(TAG, "Journal compacté: %u enregistrements abandonnés, jetons valides depuis %u (%.1f ms)",
+           (unsigned) skipped, (unsigned) min_seq, (esp_timer_get_time() - start_us) / 1000.0f);
+  return this->load_();
+}
+
+JournalStats ChangeJournal::get_stats() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  JournalStats stats;
+  stats.epoch = this->epoch_;
+  stats.min_seq = this->min_seq_;
+  stats.last_seq = this->last_seq_;
+  stats.records = this->records_;
+  stats.compactions = this->compactions_;
+  xSemaphoreGive(this->lock_);
+  return stats;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+// Nature d'une modification, conservée pour le diagnostic : le REPORT
+// relit l'état réel du chemin sur la carte
+enum JournalOp : char {
+  JOURNAL_PUT = 'P',
+  JOURNAL_DELETE = 'D',
+  JOURNAL_MKCOL = 'M',
+  JOURNAL_MOVE_FROM = 'F',
+  JOURNAL_MOVE_TO = 'T',
+  JOURNAL_COPY = 'C',
+  JOURNAL_EXTERNAL = 'X',  // Écriture hors WebDAV (API SdMmc, pré-compression)
+};
+
+struct JournalStats {
+  uint32_t epoch{0};
+  uint32_t min_seq{0};
+  uint32_t last_seq{0};
+  uint32_t records{0};
+  uint32_t compactions{0};
+};
+
+/**
+ * @brief Journal des modifications en ajout seul, sur la carte SD.
+ *
+ * Une ligne "seq op chemin" par modification, chemin relatif à la racine
+ * WebDAV. L'en-tête porte l'époque (tirée à la création : un jeton d'un
+ * autre journal est refusé) et le plus petit jeton encore valide. Au-delà
+ * de max_records, la moitié la plus ancienne est abandonnée : le compactage
+ * recopie au plus max_records / 2 lignes.
+ */
+class ChangeJournal {
+ public:
+  using Visitor = std::function<bool(uint32_t seq, char op, const char *path)>;
+
+  ChangeJournal();
+  ~ChangeJournal();
+
+  void configure(const std::string &dir, uint32_t max_records);
+  bool is_enabled() const { return this->max_records_ > 0; }
+  // Relit le journal existant ou en crée un nouveau
+  bool open();
+  bool is_open() const { return this->file_ != nullptr; }
+
+  // Retourne le numéro attribué, 0 si le journal est indisponible
+  uint32_t append(JournalOp op, const std::string &path);
+  // Enregistrements de numéro > since, dans l'ordre ; visitor false = arrêt
+  bool read_since(uint32_t since, const Visitor &visitor);
+
+  uint32_t get_epoch() const { return this->epoch_; }
+  uint32_t get_last_seq() const { return this->last_seq_; }
+  // Un jeton est utilisable si min_seq <= seq <= last_seq
+  bool is_valid_token(uint32_t epoch, uint32_t seq) const {
+    return epoch == this->epoch_ && seq >= this->min_seq_ && seq <= this->last_seq_;
+  }
+  JournalStats get_stats();
+
+ protected:
+  bool load_();
+  bool create_();
+  bool compact_(uint32_t keep);
+  static bool parse_record_(const char *line, uint32_t &seq, char &op, const char *&path);
+
+  std::string path_;
+  std::string tmp_path_;
+  uint32_t max_records_{0};
+  FILE *file_{nullptr};
+  uint32_t epoch_{0};
+  uint32_t min_seq_{0};
+  uint32_t last_seq_{0};
+  uint32_t records_{0};
+  uint32_t compactions_{0};
+  // Index clairsemé (numéro, position) pour ne pas relire tout le fichier
+  std::vector<std::pair<uint32_t, long>> index_;
+  SemaphoreHandle_t lock_{nullptr};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
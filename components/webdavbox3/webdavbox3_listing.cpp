@@ -0,0 +1,120 @@
+#include "webdavbox3_listing.h"
+#include "esphome/core/log.h"
+
+#include <cstring>
+#include <sys/stat.h>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.listing";
+
+// Point de montage de la carte et lecteur FatFs ("N:") attribué au montage ;
+// vides tant que set_fatfs_volume() n'a pas été appelé
+static std::string vfs_mount_point;
+static std::string fatfs_drive;
+
+void DirectoryReader::set_fatfs_volume(const std::string &mount_point, uint8_t pdrv) {
+  vfs_mount_point = mount_point;
+  while (!vfs_mount_point.empty() && vfs_mount_point.back() == '/') vfs_mount_point.pop_back();
+  fatfs_drive.clear();
+  if (vfs_mount_point.empty() || pdrv >= FF_VOLUMES)
+    return;
+  fatfs_drive = std::to_string((unsigned) pdrv) + ":";
+  ESP_LOGD(TAG, "Volume FatFs: %s -> %s", vfs_mount_point.c_str(), fatfs_drive.c_str());
+}
+
+bool DirectoryReader::to_fatfs_path(const std::string &path, std::string &out) {
+  if (fatfs_drive.empty())
+    return false;
+  const size_t mount_len = vfs_mount_point.size();
+  if (path.compare(0, mount_len, vfs_mount_point) != 0 || (path.size() > mount_len && path[mount_len] != '/'))
+    return false;
+  out = fatfs_drive;
+  out.append(path, mount_len, std::string::npos);
+  if (out.size() == fatfs_drive.size())
+    out += '/';
+  return true;
+}
+
+// Même conversion que le VFS FAT d'ESP-IDF (heure locale, mktime)
+time_t DirectoryReader::fat_time_to_unix(uint16_t fdate, uint16_t ftime) {
+  struct tm tm = {};
+  tm.tm_mday = fdate & 0x1f;
+  tm.tm_mon = ((fdate >> 5) & 0x0f) - 1;
+  tm.tm_year = (fdate >> 9) + 80;
+  tm.tm_sec = (ftime & 0x1f) * 2;
+  tm.tm_min = (ftime >> 5) & 0x3f;
+  tm.tm_hour = ftime >> 11;
+  return mktime(&tm);
+}
+
+bool DirectoryReader::open(const std::string &path) {
+  this->close();
+
+  std::string ff_path;
+  if (to_fatfs_path(path, ff_path)) {
+    if (f_opendir(&this->ff_dir_, ff_path.c_str()) == FR_OK) {
+      this->fatfs_open_ = true;
+      return true;
+    }
+    ESP_LOGD(TAG, "f_opendir(%s) a échoué, repli sur readdir", ff_path.c_str());
+  }
+
+  this->dir_ = opendir(path.c_str());
+  if (this->dir_ == nullptr)
+    return false;
+  this->path_ = path;
+  if (this->path_.back() != '/')
+    this->path_ += '/';
+  return true;
+}
+
+bool DirectoryReader::next(DirEntry &entry) {
+  if (this->fatfs_open_) {
+    FILINFO info;
+    while (f_readdir(&this->ff_dir_, &info) == FR_OK && info.fname[0] != '\0') {
+      if (info.fname[0] == '.' && (info.fname[1] == '\0' || (info.fname[1] == '.' && info.fname[2] == '\0')))
+        continue;
+      entry.name = info.fname;
+      entry.is_dir = (info.fattrib & AM_DIR) != 0;
+      entry.size = entry.is_dir ? 0 : (size_t) info.fsize;
+      entry.mtime = fat_time_to_unix(info.fdate, info.ftime);
+      return true;
+    }
+    return false;
+  }
+
+  if (this->dir_ == nullptr)
+    return false;
+  struct dirent *de;
+  while ((de = readdir(this->dir_)) != nullptr) {
+    if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+      continue;
+    struct stat st;
+    if (stat((this->path_ + de->d_name).c_str(), &st) != 0) {
+      ESP_LOGW(TAG, "stat impossible pour %s%s", this->path_.c_str(), de->d_name);
+      continue;
+    }
+    entry.name = de->d_name;
+    entry.is_dir = S_ISDIR(st.st_mode);
+    entry.size = entry.is_dir ? 0 : (size_t) st.st_size;
+    entry.mtime = st.st_mtime;
+    return true;
+  }
+  return false;
+}
+
+void DirectoryReader::close() {
+  if (this->fatfs_open_) {
+    f_closedir(&this->ff_dir_);
+    this->fatfs_open_ = false;
+  }
+  if (this->dir_ != nullptr) {
+    closedir(this->dir_);
+    this->dir_ = nullptr;
+  }
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <dirent.h>
+#include <string>
+
+#include "ff.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+// Entrée de répertoire avec les attributs utiles à PROPFIND
+struct DirEntry {
+  std::string name;
+  bool is_dir{false};
+  size_t size{0};
+  time_t mtime{0};
+};
+
+/**
+ * @brief Parcours d'un répertoire en une seule passe.
+ *
+ * Sur la carte SD, f_readdir() lit type, taille et date directement dans
+ * l'entrée FAT : pas de stat() par enfant, qui rescannerait le répertoire
+ * (coût O(n²) en lectures de secteurs). Hors du volume FAT, repli sur
+ * readdir() + stat().
+ */
+class DirectoryReader {
+ public:
+  DirectoryReader() = default;
+  ~DirectoryReader() { this->close(); }
+  DirectoryReader(const DirectoryReader &) = delete;
+  DirectoryReader &operator=(const DirectoryReader &) = delete;
+
+  bool open(const std::string &path);
+  // Entrée suivante, "." et ".." exclus ; false en fin de répertoire
+  bool next(DirEntry &entry);
+  void close();
+
+  bool is_fatfs() const { return this->fatfs_open_; }
+  bool is_open() const { return this->fatfs_open_ || this->dir_ != nullptr; }
+
+  // Volume de la carte, à fixer avant tout parcours : point de montage VFS et
+  // lecteur FatFs rendus par le composant sd_mmc_card
+  static void set_fatfs_volume(const std::string &mount_point, uint8_t pdrv);
+  // Chemin VFS ("/sdcard/a/b") -> chemin FatFs ("N:/a/b") ; false hors du
+  // volume ou tant qu'il n'est pas connu
+  static bool to_fatfs_path(const std::string &path, std::string &out);
+  static time_t fat_time_to_unix(uint16_t fdate, uint16_t ftime);
+
+ protected:
+  FF_DIR ff_dir_;
+  bool fatfs_open_{false};
+  DIR *dir_{nullptr};
+  std::string path_;  // Pour le repli stat()
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
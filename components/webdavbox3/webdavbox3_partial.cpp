@@ -0,0 +1,134 @@
+#include "webdavbox3_partial.h"
+
+#include <algorithm>
+#include <strings.h>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const size_t MAX_ENTRIES = 16;
+
+// Entier décimal borné ; false si aucun chiffre
+static bool parse_number(const char *&p, uint64_t &value) {
+  const char *begin = p;
+  value = 0;
+  while (*p >= '0' && *p <= '9') {
+    if (value < (1ULL << 48)) value = value * 10 + (*p - '0');
+    p++;
+  }
+  return p != begin;
+}
+
+static void skip_spaces(const char *&p) {
+  while (*p == ' ' || *p == '\t') p++;
+}
+
+UpdateRangeResult parse_content_range(const char *value, size_t body_len, UpdateRange &out) {
+  const char *p = value;
+  skip_spaces(p);
+  if (strncasecmp(p, "bytes", 5) != 0) return UPDATE_RANGE_INVALID;
+  p += 5;
+  skip_spaces(p);
+
+  uint64_t first, last;
+  if (!parse_number(p, first) || *p++ != '-' || !parse_number(p, last) || last < first) return UPDATE_RANGE_INVALID;
+  if (*p++ != '/') return UPDATE_RANGE_INVALID;
+
+  out.total = -1;
+  if (*p == '*') {
+    p++;
+  } else {
+    uint64_t total;
+    if (!parse_number(p, total) || total <= last) return UPDATE_RANGE_INVALID;
+    out.total = (int64_t) total;
+  }
+  skip_spaces(p);
+  if (*p != '\0') return UPDATE_RANGE_INVALID;
+  if (last - first + 1 != body_len || last >= SIZE_MAX) return UPDATE_RANGE_INVALID;
+
+  out.start = (size_t) first;
+  out.length = body_len;
+  return UPDATE_RANGE_OK;
+}
+
+UpdateRangeResult parse_update_range(const char *value, size_t file_size, size_t body_len, UpdateRange &out) {
+  const char *p = value;
+  skip_spaces(p);
+  out.total = -1;
+  out.length = body_len;
+
+  if (strncasecmp(p, "append", 6) == 0) {
+    p += 6;
+    skip_spaces(p);
+    if (*p != '\0') return UPDATE_RANGE_INVALID;
+    out.start = file_size;
+    return UPDATE_RANGE_OK;
+  }
+
+  if (strncasecmp(p, "bytes=", 6) != 0) return UPDATE_RANGE_INVALID;
+  p += 6;
+  uint64_t first = 0, last = 0;
+  const bool has_first = parse_number(p, first);
+  if (*p++ != '-') return UPDATE_RANGE_INVALID;
+  const bool has_last = parse_number(p, last);
+  skip_spaces(p);
+  if (*p != '\0' || (!has_first && !has_last)) return UPDATE_RANGE_INVALID;
+
+  if (!has_first) {
+    // Les N derniers octets du fichier sont remplacés par le corps
+    if (last > file_size) return UPDATE_RANGE_UNSATISFIABLE;
+    out.start = file_size - (size_t) last;
+    return UPDATE_RANGE_OK;
+  }
+  if (has_last && (last < first || last - first + 1 != body_len)) return UPDATE_RANGE_INVALID;
+  if (first > file_size) return UPDATE_RANGE_UNSATISFIABLE;
+  out.start = (size_t) first;
+  return UPDATE_RANGE_OK;
+}
+
+PartialUploadTable::PartialUploadTable() { this->lock_ = xSemaphoreCreateMutex(); }
+
+PartialUploadTable::~PartialUploadTable() {
+  if (this->lock_ != nullptr)
+    vSemaphoreDelete(this->lock_);
+}
+
+void PartialUploadTable::update(const std::string &path, size_t total) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto it = std::find_if(this->entries_.begin(), this->entries_.end(),
+                         [&path](const Entry &e) { return e.path == path; });
+  if (it != this->entries_.end())
+    this->entries_.erase(it);
+  if (this->entries_.size() >= MAX_ENTRIES)
+    this->entries_.erase(this->entries_.begin());
+  this->entries_.push_back(Entry{path, total});
+  xSemaphoreGive(this->lock_);
+}
+
+bool PartialUploadTable::lookup(const std::string &path, size_t &total) {
+  bool found = false;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  for (const auto &e : this->entries_) {
+    if (e.path == path) {
+      total = e.total;
+      found = true;
+      break;
+    }
+  }
+  xSemaphoreGive(this->lock_);
+  return found;
+}
+
+void PartialUploadTable::forget(const std::string &path) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->entries_.erase(std::remove_if(this->entries_.begin(), this->entries_.end(),
+                                      [&path](const Entry &e) {
+                                        return e.path.compare(0, path.size(), path) == 0 &&
+                                               (e.path.size() == path.size() || e.path[path.size()] == '/');
+                                      }),
+                       this->entries_.end());
+  xSemaphoreGive(this->lock_);
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
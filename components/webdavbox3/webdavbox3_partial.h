@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+// Plage écrite par un PUT partiel ou un PATCH
+struct UpdateRange {
+  size_t start{0};
+  size_t length{0};   // Octets attendus dans le corps
+  int64_t total{-1};  // Taille finale annoncée, -1 si inconnue
+};
+
+enum UpdateRangeResult : uint8_t {
+  UPDATE_RANGE_OK,
+  UPDATE_RANGE_INVALID,         // En-tête mal formé ou incohérent avec le corps : 400
+  UPDATE_RANGE_UNSATISFIABLE,   // Début au-delà de la fin du fichier : 416
+};
+
+// Content-Range d'un PUT : "bytes first-last/total" ou "bytes first-last/*"
+UpdateRangeResult parse_content_range(const char *value, size_t body_len, UpdateRange &out);
+// X-Update-Range d'un PATCH (sabre/dav) : "bytes=first-last", "bytes=first-",
+// "bytes=-N" (les N derniers octets) ou "append"
+UpdateRangeResult parse_update_range(const char *value, size_t file_size, size_t body_len, UpdateRange &out);
+
+/**
+ * @brief Envois en plusieurs morceaux dont la taille finale est connue.
+ *
+ * Les morceaux sont écrits en place dans la cible ; sa taille sur la carte est
+ * donc la quantité déjà reçue, que HEAD et PROPFIND exposent. La table garde
+ * la taille annoncée pour que HEAD indique aussi ce qui reste à envoyer.
+ * Perdue au redémarrage : la taille du fichier suffit à reprendre.
+ */
+class PartialUploadTable {
+ public:
+  PartialUploadTable();
+  ~PartialUploadTable();
+
+  void update(const std::string &path, size_t total);
+  // false si le chemin n'a pas d'envoi en cours
+  bool lookup(const std::string &path, size_t &total);
+  // Oublie le chemin et, pour un dossier, tout ce qu'il contient
+  void forget(const std::string &path);
+
+ protected:
+  struct Entry {
+    std::string path;
+    size_t total;
+  };
+
+  // Plus ancien en tête, évincé au-delà de MAX_ENTRIES
+  std::vector<Entry> entries_;
+  SemaphoreHandle_t lock_{nullptr};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
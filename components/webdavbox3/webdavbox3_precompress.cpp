@@ -0,0 +1,239 @@
+#include "webdavbox3_precompress.h"
+#include "esphome/core/log.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "miniz.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.precompress";
+
+static const UBaseType_t PRECOMPRESS_TASK_PRIORITY = tskIDLE_PRIORITY + 1;
+static const uint32_t PRECOMPRESS_TASK_STACK = 6144;
+static const size_t PRECOMPRESS_MIN_SIZE = 512;   // En dessous, le gain ne couvre pas l'en-tête gzip
+static const size_t PRECOMPRESS_IN_CHUNK = 16384;
+// Niveau ~6 de zlib, sans en-tête zlib (flux deflate brut pour gzip)
+static const int PRECOMPRESS_FLAGS = 128;
+
+AssetPrecompressor::AssetPrecompressor(const std::string &root_path, const std::vector<std::string> &extensions)
+    : root_path_(root_path), extensions_(extensions) {
+  if (!this->root_path_.empty() && this->root_path_.back() == '/')
+    this->root_path_.pop_back();
+  this->lock_ = xSemaphoreCreateMutex();
+}
+
+AssetPrecompressor::~AssetPrecompressor() {
+  if (this->lock_ != nullptr)
+    vSemaphoreDelete(this->lock_);
+}
+
+bool AssetPrecompressor::start() {
+  if (this->task_handle_ != nullptr)
+    return true;
+  if (xTaskCreate(task_, "webdav_gzip", PRECOMPRESS_TASK_STACK, this, PRECOMPRESS_TASK_PRIORITY,
+                  &this->task_handle_) != pdPASS) {
+    ESP_LOGE(TAG, "Impossible de créer la tâche de compression");
+    return false;
+  }
+  this->request_scan();
+  return true;
+}
+
+void AssetPrecompressor::request_scan() {
+  if (this->task_handle_ != nullptr)
+    xTaskNotifyGive(this->task_handle_);
+}
+
+void AssetPrecompressor::forget(const std::string &path) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto it = this->incompressible_.lower_bound(path);
+  while (it != this->incompressible_.end() && it->first.compare(0, path.size(), path) == 0) {
+    if (it->first.size() == path.size() || it->first[path.size()] == '/') {
+      it = this->incompressible_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  xSemaphoreGive(this->lock_);
+}
+
+void AssetPrecompressor::task_(void *arg) {
+  auto *self = static_cast<AssetPrecompressor *>(arg);
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    self->scan_();
+  }
+}
+
+bool AssetPrecompressor::matches_(const char *name) const {
+  const char *ext = strrchr(name, '.');
+  if (ext == nullptr)
+    return false;
+  ext++;
+  for (const auto &e : this->extensions_) {
+    if (strcasecmp(ext, e.c_str()) == 0)
+      return true;
+  }
+  return false;
+}
+
+void AssetPrecompressor::scan_() {
+  uint32_t compressed = 0;
+  int64_t start = esp_timer_get_time();
+
+  // Parcours itératif : pas de récursion sur la pile de la tâche
+  std::vector<std::string> pending{this->root_path_};
+  while (!pending.empty()) {
+    std::string dir_path = std::move(pending.back());
+    pending.pop_back();
+
+    DIR *dir = opendir(dir_path.c_str());
+    if (dir == nullptr)
+      continue;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      if (entry->d_name[0] == '.')
+        continue;  // ".", ".." et fichiers cachés (corbeille, temporaires)
+      std::string child = dir_path + "/" + entry->d_name;
+      if (entry->d_type == DT_DIR) {
+        pending.push_back(child);
+        continue;
+      }
+      if (!this->matches_(entry->d_name))
+        continue;
+
+      struct stat st, gz_st;
+      if (stat(child.c_str(), &st) != 0 || (size_t) st.st_size < PRECOMPRESS_MIN_SIZE)
+        continue;
+      xSemaphoreTake(this->lock_, portMAX_DELAY);
+      auto verdict = this->incompressible_.find(child);
+      const bool skip = verdict != this->incompressible_.end() && verdict->second.size == (size_t) st.st_size &&
+                        verdict->second.mtime == st.st_mtime;
+      xSemaphoreGive(this->lock_);
+      if (skip)
+        continue;  // Même contenu que lors de l'essai sans gain
+      std::string gz_path = child + ".gz";
+      if (stat(gz_path.c_str(), &gz_st) == 0 && gz_st.st_mtime == st.st_mtime)
+        continue;  // Variante déjà à jour
+
+      if (this->compress_file_(child, st)) {
+        struct utimbuf times = {st.st_atime, st.st_mtime};
+        utime(gz_path.c_str(), &times);
+        compressed++;
+      }
+      vTaskDelay(1);  // Laisser la main aux transferts en cours
+    }
+    closedir(dir);
+  }
+
+  this->compressed_count_ += compressed;
+  if (compressed > 0) {
+    ESP_LOGI(TAG, "%u fichier(s) compressé(s) en %.1f s", (unsigned) compressed,
+             (esp_timer_get_time() - start) / 1e6f);
+  }
+}
+
+struct GzipSink {
+  FILE *out;
+  size_t written;
+  bool ok;
+};
+
+static mz_bool gzip_put_buf(const void *buf, int len, void *user) {
+  auto *sink = static_cast<GzipSink *>(user);
+  if (fwrite(buf, 1, len, sink->out) != (size_t) len) {
+    sink->ok = false;
+    return MZ_FALSE;
+  }
+  sink->written += len;
+  return MZ_TRUE;
+}
+
+bool AssetPrecompressor::compress_file_(const std::string &path, const struct stat &st) {
+  const size_t size = st.st_size;
+  std::string gz_path = path + ".gz";
+  std::string tmp_path = gz_path + ".tmp";
+
+  FILE *in = fopen(path.c_str(), "rb");
+  if (in == nullptr)
+    return false;
+  FILE *out = fopen(tmp_path.c_str(), "wb");
+  if (out == nullptr) {
+    fclose(in);
+    return false;
+  }
+
+  // L'état du compresseur (~300 KB) et le buffer d'entrée vont en PSRAM
+  auto *comp = (tdefl_compressor *) heap_caps_malloc(sizeof(tdefl_compressor), MALLOC_CAP_SPIRAM);
+  auto *buf = (uint8_t *) heap_caps_malloc(PRECOMPRESS_IN_CHUNK, MALLOC_CAP_SPIRAM);
+  GzipSink sink{out, 0, true};
+  bool ok = comp != nullptr && buf != nullptr;
+
+  // En-tête gzip minimal (RFC 1952) : deflate, sans nom ni date
+  static const uint8_t GZIP_HEADER[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+  ok = ok && fwrite(GZIP_HEADER, 1, sizeof(GZIP_HEADER), out) == sizeof(GZIP_HEADER);
+  ok = ok && tdefl_init(comp, gzip_put_buf, &sink, PRECOMPRESS_FLAGS) == TDEFL_STATUS_OKAY;
+
+  uint32_t crc = 0;
+  size_t total = 0;
+  while (ok) {
+    size_t r = fread(buf, 1, PRECOMPRESS_IN_CHUNK, in);
+    total += r;
+    crc = esp_rom_crc32_le(crc, buf, r);
+    tdefl_flush flush = (r < PRECOMPRESS_IN_CHUNK) ? TDEFL_FINISH : TDEFL_NO_FLUSH;
+    tdefl_status status = tdefl_compress_buffer(comp, buf, r, flush);
+    if (status == TDEFL_STATUS_DONE)
+      break;
+    ok = status == TDEFL_STATUS_OKAY && sink.ok;
+  }
+
+  // Pied de page : CRC32 puis taille d'origine, en little-endian
+  uint8_t trailer[8];
+  for (int i = 0; i < 4; i++) {
+    trailer[i] = (crc >> (8 * i)) & 0xff;
+    trailer[4 + i] = (total >> (8 * i)) & 0xff;
+  }
+  ok = ok && sink.ok && total == size && fwrite(trailer, 1, sizeof(trailer), out) == sizeof(trailer);
+
+  heap_caps_free(comp);
+  heap_caps_free(buf);
+  fclose(in);
+  fclose(out);
+
+  // Une variante qui ne gagne pas au moins 10 % n'est pas conservée
+  size_t gz_size = sink.written + sizeof(GZIP_HEADER) + sizeof(trailer);
+  if (ok && gz_size > size - size / 10) {
+    ESP_LOGD(TAG, "%s: compression sans intérêt (%zu -> %zu)", path.c_str(), size, gz_size);
+    xSemaphoreTake(this->lock_, portMAX_DELAY);
+    this->incompressible_[path] = Verdict{size, st.st_mtime};
+    xSemaphoreGive(this->lock_);
+    ok = false;
+  }
+
+  if (ok) {
+    unlink(gz_path.c_str());  // FAT: rename() échoue si la destination existe
+    ok = rename(tmp_path.c_str(), gz_path.c_str()) == 0;
+  }
+  if (!ok) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  ESP_LOGD(TAG, "%s: %zu -> %zu octets", gz_path.c_str(), size, gz_size);
+  if (this->on_change_)
+    this->on_change_(gz_path);
+  return true;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
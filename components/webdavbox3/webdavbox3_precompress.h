@@ -0,0 +1,61 @@
+#pragma once
+
+#include <ctime>
+#include <functional>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+/**
+ * @brief Tâche de fond qui crée les variantes "fichier.gz" des ressources
+ * texte, pour que la compression soit payée une seule fois et non à chaque GET.
+ *
+ * Le .gz reçoit la date de modification de l'original : il n'est servi que
+ * tant que les deux dates sont identiques.
+ */
+class AssetPrecompressor {
+ public:
+  AssetPrecompressor(const std::string &root_path, const std::vector<std::string> &extensions);
+  ~AssetPrecompressor();
+
+  bool start();
+  // Demande un nouveau parcours (après un PUT, MOVE ou COPY)
+  void request_scan();
+  // Fichier ou dossier modifié, déplacé ou supprimé : verdicts "incompressible" oubliés
+  void forget(const std::string &path);
+
+  uint32_t get_compressed_count() const { return this->compressed_count_; }
+  // Appelé pour chaque variante .gz créée ou remplacée
+  void set_on_change(std::function<void(const std::string &)> &&callback) { this->on_change_ = std::move(callback); }
+
+ protected:
+  static void task_(void *arg);
+  void scan_();
+  bool matches_(const char *name) const;
+  bool compress_file_(const std::string &path, const struct stat &st);
+
+  std::string root_path_;
+  std::vector<std::string> extensions_;
+  // Fichiers pour lesquels la compression n'apporte rien : pas de nouvel
+  // essai tant que taille et date n'ont pas changé
+  struct Verdict {
+    size_t size;
+    time_t mtime;
+  };
+  std::map<std::string, Verdict> incompressible_;
+  SemaphoreHandle_t lock_{nullptr};  // incompressible_ : tâche de fond et gestionnaires
+  std::function<void(const std::string &)> on_change_;
+  TaskHandle_t task_handle_{nullptr};
+  uint32_t compressed_count_{0};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
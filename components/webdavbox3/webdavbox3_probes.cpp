@@ -0,0 +1,215 @@
+#include "webdavbox3_probes.h"
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.probes";
+
+ProbeFilter::ProbeFilter() { this->lock_ = xSemaphoreCreateMutex(); }
+
+ProbeFilter::~ProbeFilter() {
+  if (this->lock_ != nullptr)
+    vSemaphoreDelete(this->lock_);
+}
+
+void ProbeFilter::add_rule(const std::string &pattern, ProbeAction action) {
+  this->rules_.push_back(Rule{pattern, action});
+}
+
+void ProbeFilter::configure(size_t negative_entries, size_t ram_budget, size_t ram_max_file) {
+  this->max_negative_ = negative_entries;
+  this->ram_budget_ = ram_budget;
+  this->ram_max_file_ = std::min(ram_max_file, ram_budget);
+}
+
+// Motif glob sans casse : '*' = suite quelconque, '?' = un caractère
+bool ProbeFilter::glob_match(const char *pattern, const char *text, size_t text_len) {
+  const char *star = nullptr;
+  size_t star_pos = 0;
+  size_t i = 0;
+  while (i < text_len) {
+    if (*pattern == '*') {
+      star = pattern++;
+      star_pos = i;
+    } else if (*pattern != '\0' && (*pattern == '?' || tolower((unsigned char) *pattern) ==
+                                                           tolower((unsigned char) text[i]))) {
+      pattern++;
+      i++;
+    } else if (star != nullptr) {
+      pattern = star + 1;
+      i = ++star_pos;
+    } else {
+      return false;
+    }
+  }
+  while (*pattern == '*')
+    pattern++;
+  return *pattern == '\0';
+}
+
+const ProbeAction *ProbeFilter::match(const char *uri) const {
+  size_t len = strcspn(uri, "?");
+  while (len > 0 && uri[len - 1] == '/')
+    len--;
+  size_t start = len;
+  while (start > 0 && uri[start - 1] != '/')
+    start--;
+  if (start == len)
+    return nullptr;
+  // Première règle correspondante : les règles RAM sont déclarées en premier
+  for (const auto &rule : this->rules_) {
+    if (glob_match(rule.pattern.c_str(), uri + start, len - start))
+      return &rule.action;
+  }
+  return nullptr;
+}
+
+bool ProbeFilter::is_known_missing(const std::string &key) {
+  if (this->max_negative_ == 0)
+    return false;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto found = this->negative_.find(key);
+  bool missing = found != this->negative_.end();
+  if (missing) {
+    this->negative_lru_.splice(this->negative_lru_.begin(), this->negative_lru_, found->second);
+    this->stats_.negative_hits++;
+  }
+  xSemaphoreGive(this->lock_);
+  return missing;
+}
+
+void ProbeFilter::note_missing(const std::string &key) {
+  if (this->max_negative_ == 0)
+    return;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  if (this->negative_.find(key) == this->negative_.end()) {
+    if (this->negative_.size() >= this->max_negative_) {
+      this->negative_.erase(this->negative_lru_.back());
+      this->negative_lru_.pop_back();
+    }
+    this->negative_lru_.push_front(key);
+    this->negative_[key] = this->negative_lru_.begin();
+    this->stats_.negative_inserts++;
+  }
+  xSemaphoreGive(this->lock_);
+}
+
+void ProbeFilter::note_passed() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->stats_.passed++;
+  xSemaphoreGive(this->lock_);
+}
+
+void ProbeFilter::note_absorbed() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  this->stats_.absorbed++;
+  xSemaphoreGive(this->lock_);
+}
+
+std::shared_ptr<const RamFile> ProbeFilter::ram_get(const std::string &key) {
+  if (this->ram_budget_ == 0)
+    return nullptr;
+  std::shared_ptr<const RamFile> file;
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto found = this->ram_.find(key);
+  if (found != this->ram_.end()) {
+    file = found->second.first;
+    this->stats_.ram_reads++;
+  }
+  xSemaphoreGive(this->lock_);
+  return file;
+}
+
+bool ProbeFilter::ram_put(const std::string &key, std::vector<uint8_t> &&data, bool *replaced) {
+  if (data.size() > this->ram_max_file_)
+    return false;
+  auto file = std::make_shared<RamFile>();
+  file->data = std::move(data);
+  file->mtime = time(nullptr);
+  const size_t size = file->data.size();
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto found = this->ram_.find(key);
+  if (replaced != nullptr)
+    *replaced = found != this->ram_.end();
+  if (found != this->ram_.end()) {
+    this->stats_.ram_bytes -= found->second.first->data.size();
+    this->ram_order_.erase(found->second.second);
+    this->ram_.erase(found);
+  }
+  // Magasin volatil : les métadonnées les plus anciennes cèdent la place
+  while (!this->ram_order_.empty() && this->stats_.ram_bytes + size > this->ram_budget_) {
+    auto oldest = this->ram_.find(this->ram_order_.back());
+    this->stats_.ram_bytes -= oldest->second.first->data.size();
+    ESP_LOGD(TAG, "Éviction RAM: %s", this->ram_order_.back().c_str());
+    this->ram_.erase(oldest);
+    this->ram_order_.pop_back();
+    this->stats_.ram_evictions++;
+  }
+  this->ram_order_.push_front(key);
+  this->ram_[key] = std::make_pair(std::shared_ptr<const RamFile>(std::move(file)), this->ram_order_.begin());
+  this->stats_.ram_bytes += size;
+  this->stats_.ram_writes++;
+  // Le fichier existe désormais
+  auto neg = this->negative_.find(key);
+  if (neg != this->negative_.end()) {
+    this->negative_lru_.erase(neg->second);
+    this->negative_.erase(neg);
+  }
+  xSemaphoreGive(this->lock_);
+  return true;
+}
+
+bool ProbeFilter::ram_remove(const std::string &key) {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  auto found = this->ram_.find(key);
+  bool removed = found != this->ram_.end();
+  if (removed) {
+    this->stats_.ram_bytes -= found->second.first->data.size();
+    this->ram_order_.erase(found->second.second);
+    this->ram_.erase(found);
+  }
+  xSemaphoreGive(this->lock_);
+  return removed;
+}
+
+void ProbeFilter::invalidate(const std::string &key) {
+  std::string prefix = key;
+  if (prefix.empty() || prefix.back() != '/')
+    prefix += '/';
+
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  // Une version écrite sur la carte remplace la copie en RAM
+  auto ram = this->ram_.find(key);
+  if (ram != this->ram_.end()) {
+    this->stats_.ram_bytes -= ram->second.first->data.size();
+    this->ram_order_.erase(ram->second.second);
+    this->ram_.erase(ram);
+  }
+  for (auto it = this->negative_lru_.begin(); it != this->negative_lru_.end();) {
+    if (*it == key || it->compare(0, prefix.size(), prefix) == 0) {
+      this->negative_.erase(*it);
+      it = this->negative_lru_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  xSemaphoreGive(this->lock_);
+}
+
+ProbeStats ProbeFilter::get_stats() {
+  xSemaphoreTake(this->lock_, portMAX_DELAY);
+  ProbeStats stats = this->stats_;
+  stats.negative_entries = this->negative_.size();
+  stats.ram_files = this->ram_.size();
+  xSemaphoreGive(this->lock_);
+  return stats;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+enum ProbeAction : uint8_t {
+  PROBE_NEGATIVE,  // Absence mémorisée après un premier 404
+  PROBE_RAM,       // Écritures gardées en RAM, jamais sur la carte
+};
+
+struct ProbeStats {
+  uint32_t absorbed{0};      // Requêtes répondues sans accès à la carte
+  uint32_t negative_hits{0};
+  uint32_t negative_inserts{0};
+  uint32_t passed{0};        // Sondes transmises à la carte (première fois, fichier existant)
+  uint32_t ram_reads{0};
+  uint32_t ram_writes{0};
+  uint32_t ram_evictions{0};
+  size_t negative_entries{0};
+  size_t ram_files{0};
+  size_t ram_bytes{0};
+};
+
+// Fichier du magasin RAM (AppleDouble, .DS_Store)
+struct RamFile {
+  std::vector<uint8_t> data;
+  time_t mtime{0};
+};
+
+/**
+ * @brief Absorbe les sondes des explorateurs de fichiers (desktop.ini,
+ * Thumbs.db, .DS_Store, ._*...) répétées sur chaque dossier.
+ *
+ * Les règles portent sur le dernier segment de l'URI brute (motifs * et ?,
+ * sans casse) : pas de décodage ni de stat() pour les autres requêtes. Les
+ * clés sont les URI décodées. Une absence constatée une fois est mémorisée
+ * (LRU bornée) jusqu'à ce qu'une écriture touche le chemin ; les fichiers des
+ * règles RAM vivent dans un magasin borné, perdu au redémarrage.
+ */
+class ProbeFilter {
+ public:
+  ProbeFilter();
+  ~ProbeFilter();
+
+  void add_rule(const std::string &pattern, ProbeAction action);
+  void configure(size_t negative_entries, size_t ram_budget, size_t ram_max_file);
+  bool is_enabled() const { return !this->rules_.empty(); }
+  size_t get_ram_max_file() const { return this->ram_budget_ > 0 ? this->ram_max_file_ : 0; }
+
+  // Règle applicable à l'URI brute, nullptr si ce n'est pas une sonde
+  const ProbeAction *match(const char *uri) const;
+
+  bool is_known_missing(const std::string &key);
+  void note_missing(const std::string &key);
+  void note_passed();
+
+  std::shared_ptr<const RamFile> ram_get(const std::string &key);
+  // false si le fichier dépasse la taille maximale ; évince les plus anciens
+  bool ram_put(const std::string &key, std::vector<uint8_t> &&data, bool *replaced = nullptr);
+  bool ram_remove(const std::string &key);
+
+  // Le chemin (et tout ce qu'il contient) a pu être créé sur la carte :
+  // oublie les absences et l'éventuelle copie en RAM
+  void invalidate(const std::string &key);
+  void note_absorbed();
+
+  ProbeStats get_stats();
+
+  static bool glob_match(const char *pattern, const char *text, size_t text_len);
+
+ protected:
+  struct Rule {
+    std::string pattern;
+    ProbeAction action;
+  };
+  using KeyList = std::list<std::string>;
+
+  std::vector<Rule> rules_;
+  size_t max_negative_{0};
+  size_t ram_budget_{0};
+  size_t ram_max_file_{0};
+
+  KeyList negative_lru_;  // Tête = absence la plus récemment confirmée
+  std::unordered_map<std::string, KeyList::iterator> negative_;
+  KeyList ram_order_;  // Tête = écriture la plus récente
+  std::unordered_map<std::string, std::pair<std::shared_ptr<const RamFile>, KeyList::iterator>> ram_;
+  ProbeStats stats_;
+  SemaphoreHandle_t lock_{nullptr};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
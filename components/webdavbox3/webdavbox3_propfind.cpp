@@ -0,0 +1,514 @@
+#include "webdavbox3_propfind.h"
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.propfind";
+
+static const char MULTISTATUS_HEAD[] = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                                       "<D:multistatus xmlns:D=\"DAV:\">\n";
+static const char MULTISTATUS_TAIL[] = "</D:multistatus>";
+
+esp_err_t MultistatusWriter::begin() { return this->write_(MULTISTATUS_HEAD); }
+
+esp_err_t MultistatusWriter::add_response(const char *href, bool is_directory, time_t modified, size_t size,
+                                          const char *content_type) {
+  // Nom affiché : dernier segment de l'href, sans le '/' final
+  size_t href_len = strlen(href);
+  size_t name_end = href_len;
+  if (name_end > 0 && href[name_end - 1] == '/')
+    name_end--;
+  size_t name_start = name_end;
+  while (name_start > 0 && href[name_start - 1] != '/')
+    name_start--;
+
+  // Répartition entre propstat 200 (présentes) et 404 (demandées, absentes)
+  static const uint16_t FILE_ONLY = PROP_GETCONTENTLENGTH | PROP_GETCONTENTTYPE | PROP_GETETAG;
+  const PropfindMode mode = this->request_ != nullptr ? this->request_->mode : PROPFIND_ALLPROP;
+  const uint16_t requested = mode == PROPFIND_PROP ? this->request_->props : PROP_ALL;
+  const uint16_t found = is_directory ? (requested & ~FILE_ONLY) : requested;
+  const uint16_t missing = mode == PROPFIND_PROP ? (requested & ~found) : 0;
+  const bool has_unknown = mode == PROPFIND_PROP && this->request_->unknown_len > 0;
+
+  this->write_("  <D:response>\n    <D:href>");
+  this->write_escaped_(href, href_len);
+  this->write_("</D:href>\n");
+  if (found != 0 || (missing == 0 && !has_unknown)) {
+    this->write_("    <D:propstat>\n      <D:prop>\n");
+    this->write_props_(found, mode == PROPFIND_PROPNAME, is_directory, modified, size, content_type,
+                       href + name_start, name_end - name_start);
+    this->write_("      </D:prop>\n"
+                 "      <D:status>HTTP/1.1 200 OK</D:status>\n"
+                 "    </D:propstat>\n");
+  }
+  if (missing != 0 || has_unknown) {
+    this->write_("    <D:propstat>\n      <D:prop>\n");
+    this->write_props_(missing, true, is_directory, modified, size, content_type, nullptr, 0);
+    if (has_unknown)
+      this->write_(this->request_->unknown, this->request_->unknown_len);
+    this->write_("      </D:prop>\n"
+                 "      <D:status>HTTP/1.1 404 Not Found</D:status>\n"
+                 "    </D:propstat>\n");
+  }
+  this->entries_++;
+  return this->write_("  </D:response>\n");
+}
+
+esp_err_t MultistatusWriter::add_status(const char *href, const char *status, const char *error) {
+  this->write_("  <D:response>\n    <D:href>");
+  this->write_escaped_(href, strlen(href));
+  this->write_("</D:href>\n    <D:status>");
+  this->write_(status, strlen(status));
+  this->write_("</D:status>\n");
+  if (error != nullptr) {
+    this->write_("    <D:error><D:");
+    this->write_(error, strlen(error));
+    this->write_("/></D:error>\n");
+  }
+  this->entries_++;
+  return this->write_("  </D:response>\n");
+}
+
+esp_err_t MultistatusWriter::add_sync_token(const char *token) {
+  this->write_("  <D:sync-token>");
+  this->write_escaped_(token, strlen(token));
+  return this->write_("</D:sync-token>\n");
+}
+
+void MultistatusWriter::write_props_(uint16_t props, bool names_only, bool is_directory, time_t modified,
+                                     size_t size, const char *content_type, const char *name, size_t name_len) {
+  if (names_only) {
+    static const struct {
+      uint16_t flag;
+      const char *element;
+    } NAMES[] = {
+        {PROP_RESOURCETYPE, "        <D:resourcetype/>\n"},
+        {PROP_GETLASTMODIFIED, "        <D:getlastmodified/>\n"},
+        {PROP_CREATIONDATE, "        <D:creationdate/>\n"},
+        {PROP_DISPLAYNAME, "        <D:displayname/>\n"},
+        {PROP_GETCONTENTLENGTH, "        <D:getcontentlength/>\n"},
+        {PROP_GETCONTENTTYPE, "        <D:getcontenttype/>\n"},
+        {PROP_GETETAG, "        <D:getetag/>\n"},
+    };
+    for (const auto &n : NAMES) {
+      if (props & n.flag)
+        this->write_(n.element, strlen(n.element));
+    }
+    return;
+  }
+
+  char tmp[160];
+  int n;
+  if (props & PROP_RESOURCETYPE) {
+    if (is_directory) {
+      this->write_("        <D:resourcetype><D:collection/></D:resourcetype>\n");
+    } else {
+      this->write_("        <D:resourcetype/>\n");
+    }
+  }
+  if (props & (PROP_GETLASTMODIFIED | PROP_CREATIONDATE)) {
+    // Format RFC1123 préféré par de nombreux clients WebDAV
+    char time_buf[50];
+    struct tm gmt;
+    gmtime_r(&modified, &gmt);
+    strftime(time_buf, sizeof(time_buf), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    if (props & PROP_GETLASTMODIFIED) {
+      n = snprintf(tmp, sizeof(tmp), "        <D:getlastmodified>%s</D:getlastmodified>\n", time_buf);
+      this->write_(tmp, n);
+    }
+    if (props & PROP_CREATIONDATE) {
+      n = snprintf(tmp, sizeof(tmp), "        <D:creationdate>%s</D:creationdate>\n", time_buf);
+      this->write_(tmp, n);
+    }
+  }
+  if (props & PROP_DISPLAYNAME) {
+    this->write_("        <D:displayname>");
+    if (name_len == 0) {
+      this->write_("Root");  // Nom spécial pour la racine
+    } else {
+      this->write_escaped_(name, name_len);
+    }
+    this->write_("</D:displayname>\n");
+  }
+  if (props & PROP_GETCONTENTLENGTH) {
+    n = snprintf(tmp, sizeof(tmp), "        <D:getcontentlength>%zu</D:getcontentlength>\n", size);
+    this->write_(tmp, n);
+  }
+  if (props & PROP_GETCONTENTTYPE) {
+    n = snprintf(tmp, sizeof(tmp), "        <D:getcontenttype>%s</D:getcontenttype>\n",
+                 content_type != nullptr ? content_type : "application/octet-stream");
+    this->write_(tmp, n);
+  }
+  if (props & PROP_GETETAG) {
+    // Même ETag faible que les réponses GET/HEAD
+    n = snprintf(tmp, sizeof(tmp), "        <D:getetag>W/\"%lx-%lx\"</D:getetag>\n", (unsigned long) size,
+                 (unsigned long) modified);
+    this->write_(tmp, n);
+  }
+}
+
+esp_err_t MultistatusWriter::finish(const char *description) {
+  if (description != nullptr) {
+    this->write_("  <D:responsedescription>");
+    this->write_escaped_(description, strlen(description));
+    this->write_("</D:responsedescription>\n");
+  }
+  this->write_(MULTISTATUS_TAIL);
+  this->flush_();
+  if (this->error_ != ESP_OK)
+    return this->error_;
+  ESP_LOGD(TAG, "Multi-Status: %u entrées, %zu octets en %u chunks", (unsigned) this->entries_, this->bytes_sent_,
+           (unsigned) this->flushes_);
+  return httpd_resp_send_chunk(this->req_, nullptr, 0);
+}
+
+esp_err_t MultistatusWriter::write_(const char *data, size_t len) {
+  while (len > 0 && this->error_ == ESP_OK) {
+    if (this->used_ == this->size_)
+      this->flush_();
+    size_t n = std::min(len, this->size_ - this->used_);
+    memcpy(this->buf_ + this->used_, data, n);
+    this->used_ += n;
+    data += n;
+    len -= n;
+  }
+  return this->error_;
+}
+
+esp_err_t MultistatusWriter::write_escaped_(const char *text, size_t len) {
+  size_t start = 0;
+  for (size_t i = 0; i < len; i++) {
+    const char *entity = nullptr;
+    switch (text[i]) {
+      case '&':
+        entity = "&amp;";
+        break;
+      case '<':
+        entity = "&lt;";
+        break;
+      case '>':
+        entity = "&gt;";
+        break;
+      default:
+        continue;
+    }
+    this->write_(text + start, i - start);
+    this->write_(entity, strlen(entity));
+    start = i + 1;
+  }
+  return this->write_(text + start, len - start);
+}
+
+esp_err_t MultistatusWriter::flush_() {
+  if (this->used_ == 0 || this->error_ != ESP_OK)
+    return this->error_;
+  this->error_ = httpd_resp_send_chunk(this->req_, this->buf_, this->used_);
+  if (this->error_ != ESP_OK) {
+    ESP_LOGW(TAG, "Envoi du chunk interrompu après %zu octets: %d", this->bytes_sent_, this->error_);
+  }
+  this->bytes_sent_ += this->used_;
+  this->flushes_++;
+  this->used_ = 0;
+  return this->error_;
+}
+
+// Analyse incrémentale du corps de la requête
+
+static bool is_xml_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+static bool name_equals(const char *name, size_t len, const char *expected) {
+  return strlen(expected) == len && memcmp(name, expected, len) == 0;
+}
+
+void PropfindBodyParser::feed(const char *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    const char c = data[i];
+    switch (this->state_) {
+      case STATE_TEXT:
+        if (c == '<') {
+          this->state_ = STATE_TAG;
+          this->tag_len_ = 0;
+          this->tag_overflow_ = false;
+        } else if (this->capture_ != CAPTURE_NONE && this->text_len_ < sizeof(this->text_) - 1) {
+          this->text_[this->text_len_++] = c;
+        }
+        break;
+      case STATE_TAG:
+        if (c == '>') {
+          this->on_tag_();
+          this->state_ = STATE_TEXT;
+          break;
+        }
+        if (c == '"' || c == '\'') {
+          this->quote_ = c;
+          this->state_ = STATE_QUOTE;
+        }
+        if (this->tag_len_ < sizeof(this->tag_) - 1) {
+          this->tag_[this->tag_len_++] = c;
+        } else {
+          this->tag_overflow_ = true;
+        }
+        if (this->tag_len_ == 3 && memcmp(this->tag_, "!--", 3) == 0) {
+          this->state_ = STATE_COMMENT;
+          this->comment_dashes_ = 0;
+        }
+        break;
+      case STATE_QUOTE:
+        if (this->tag_len_ < sizeof(this->tag_) - 1) {
+          this->tag_[this->tag_len_++] = c;
+        } else {
+          this->tag_overflow_ = true;
+        }
+        if (c == this->quote_)
+          this->state_ = STATE_TAG;
+        break;
+      case STATE_COMMENT:
+        if (c == '>' && this->comment_dashes_ >= 2) {
+          this->state_ = STATE_TEXT;
+        } else if (c == '-') {
+          if (this->comment_dashes_ < 2)
+            this->comment_dashes_++;
+        } else {
+          this->comment_dashes_ = 0;
+        }
+        break;
+    }
+  }
+}
+
+bool PropfindBodyParser::finish() {
+  if (this->tag_overflow_)
+    ESP_LOGD(TAG, "Balise trop longue tronquée dans le corps PROPFIND");
+  return !this->error_ && this->depth_ == 0 && this->state_ == STATE_TEXT;
+}
+
+void PropfindBodyParser::on_tag_() {
+  this->tag_[this->tag_len_] = '\0';
+  // Prologue, DOCTYPE, CDATA : rien à en tirer
+  if (this->tag_len_ == 0 || this->tag_[0] == '?' || this->tag_[0] == '!')
+    return;
+
+  if (this->tag_[0] == '/') {
+    this->end_capture_();
+    this->depth_--;
+    if (this->depth_ < 2)
+      this->in_limit_ = false;
+    if (this->depth_ < 0)
+      this->error_ = true;
+    if (this->prop_depth_ >= 0 && this->depth_ < this->prop_depth_)
+      this->prop_depth_ = -1;
+    return;
+  }
+
+  const bool self_closing = this->tag_[this->tag_len_ - 1] == '/';
+  if (self_closing)
+    this->tag_[--this->tag_len_] = '\0';
+  size_t name_len = strcspn(this->tag_, " \t\r\n");
+  // Les déclarations de l'élément s'appliquent à son propre nom
+  this->bind_namespaces_(this->tag_ + name_len);
+  this->depth_++;
+  this->on_element_(this->tag_, name_len);
+  if (self_closing) {
+    this->depth_--;
+    if (this->prop_depth_ >= 0 && this->depth_ < this->prop_depth_)
+      this->prop_depth_ = -1;
+  }
+}
+
+void PropfindBodyParser::on_element_(const char *name, size_t name_len) {
+  const char *colon = static_cast<const char *>(memchr(name, ':', name_len));
+  const char *local = colon != nullptr ? colon + 1 : name;
+  const size_t local_len = name_len - (local - name);
+  const char *uri = this->resolve_(name, colon != nullptr ? colon - name : 0);
+  const bool dav = strcmp(uri, "DAV:") == 0;
+
+  if (this->depth_ == 1) {
+    const char *root = this->sync_ != nullptr ? "sync-collection" : "propfind";
+    if (dav && name_equals(local, local_len, root)) {
+      this->saw_propfind_ = true;
+    } else {
+      this->error_ = true;
+    }
+    return;
+  }
+  if (!this->saw_propfind_)
+    return;
+
+  if (this->depth_ == 2 && dav) {
+    if (name_equals(local, local_len, "prop")) {
+      this->out_.mode = PROPFIND_PROP;
+      this->out_.props = 0;
+      this->prop_depth_ = this->depth_;
+    } else if (name_equals(local, local_len, "allprop")) {
+      this->out_.mode = PROPFIND_ALLPROP;
+      this->out_.props = PROP_ALL;
+    } else if (name_equals(local, local_len, "propname")) {
+      this->out_.mode = PROPFIND_PROPNAME;
+      this->out_.props = PROP_ALL;
+    }
+    if (this->sync_ != nullptr) {
+      this->text_len_ = 0;
+      if (name_equals(local, local_len, "sync-token")) {
+        this->capture_ = CAPTURE_SYNC_TOKEN;
+      } else if (name_equals(local, local_len, "sync-level")) {
+        this->capture_ = CAPTURE_SYNC_LEVEL;
+      } else if (name_equals(local, local_len, "limit")) {
+        this->in_limit_ = true;
+      }
+    }
+    // <include> : rien au-delà de allprop n'est géré
+    return;
+  }
+  if (this->depth_ == 3 && this->in_limit_ && dav && name_equals(local, local_len, "nresults")) {
+    this->text_len_ = 0;
+    this->capture_ = CAPTURE_NRESULTS;
+    return;
+  }
+
+  if (this->prop_depth_ < 0 || this->depth_ != this->prop_depth_ + 1)
+    return;
+
+  static const struct {
+    const char *name;
+    uint16_t flag;
+  } KNOWN[] = {
+      {"resourcetype", PROP_RESOURCETYPE},         {"getlastmodified", PROP_GETLASTMODIFIED},
+      {"creationdate", PROP_CREATIONDATE},         {"displayname", PROP_DISPLAYNAME},
+      {"getcontentlength", PROP_GETCONTENTLENGTH}, {"getcontenttype", PROP_GETCONTENTTYPE},
+      {"getetag", PROP_GETETAG},
+  };
+  if (dav) {
+    for (const auto &k : KNOWN) {
+      if (name_equals(local, local_len, k.name)) {
+        this->out_.props |= k.flag;
+        return;
+      }
+    }
+  }
+  this->add_unknown_(local, local_len, uri);
+}
+
+void PropfindBodyParser::end_capture_() {
+  if (this->capture_ == CAPTURE_NONE)
+    return;
+  // Texte sans les blancs autour
+  size_t start = 0;
+  while (start < this->text_len_ && is_xml_space(this->text_[start]))
+    start++;
+  size_t end = this->text_len_;
+  while (end > start && is_xml_space(this->text_[end - 1]))
+    end--;
+  const char *text = this->text_ + start;
+  const size_t len = end - start;
+
+  switch (this->capture_) {
+    case CAPTURE_SYNC_TOKEN:
+      memcpy(this->sync_->token, text, std::min(len, sizeof(this->sync_->token) - 1));
+      this->sync_->token[std::min(len, sizeof(this->sync_->token) - 1)] = '\0';
+      break;
+    case CAPTURE_SYNC_LEVEL:
+      this->sync_->infinite = name_equals(text, len, "infinite") || name_equals(text, len, "infinity");
+      break;
+    case CAPTURE_NRESULTS:
+      this->text_[end] = '\0';
+      this->sync_->limit = strtoul(text, nullptr, 10);
+      break;
+    default:
+      break;
+  }
+  this->capture_ = CAPTURE_NONE;
+}
+
+void PropfindBodyParser::bind_namespaces_(const char *attrs) {
+  const char *p = attrs;
+  while ((p = strstr(p, "xmlns")) != nullptr) {
+    if (p == attrs || !is_xml_space(p[-1])) {
+      p += 5;
+      continue;
+    }
+    p += 5;
+    const char *prefix = p;
+    size_t prefix_len = 0;
+    if (*p == ':') {
+      prefix = ++p;
+      while (*p != '\0' && *p != '=' && !is_xml_space(*p))
+        p++;
+      prefix_len = p - prefix;
+    }
+    while (is_xml_space(*p))
+      p++;
+    if (*p != '=')
+      continue;
+    p++;
+    while (is_xml_space(*p))
+      p++;
+    const char quote = *p;
+    if (quote != '"' && quote != '\'')
+      continue;
+    const char *value = ++p;
+    const char *end = strchr(value, quote);
+    if (end == nullptr)
+      return;
+    p = end + 1;
+
+    char *dest = this->default_ns_;
+    if (prefix_len > 0) {
+      if (prefix_len >= sizeof(Binding::prefix))
+        continue;
+      Binding *binding = nullptr;
+      for (uint8_t i = 0; i < this->binding_count_; i++) {
+        if (name_equals(prefix, prefix_len, this->bindings_[i].prefix))
+          binding = &this->bindings_[i];
+      }
+      if (binding == nullptr) {
+        if (this->binding_count_ == sizeof(this->bindings_) / sizeof(this->bindings_[0]))
+          continue;
+        binding = &this->bindings_[this->binding_count_++];
+        memcpy(binding->prefix, prefix, prefix_len);
+        binding->prefix[prefix_len] = '\0';
+      }
+      dest = binding->uri;
+    }
+    const size_t value_len = std::min<size_t>(end - value, sizeof(Binding::uri) - 1);
+    memcpy(dest, value, value_len);
+    dest[value_len] = '\0';
+  }
+}
+
+const char *PropfindBodyParser::resolve_(const char *prefix, size_t prefix_len) const {
+  if (prefix_len == 0)
+    return this->default_ns_;
+  for (uint8_t i = 0; i < this->binding_count_; i++) {
+    if (name_equals(prefix, prefix_len, this->bindings_[i].prefix))
+      return this->bindings_[i].uri;
+  }
+  return "";
+}
+
+void PropfindBodyParser::add_unknown_(const char *local, size_t local_len, const char *uri) {
+  char *dest = this->out_.unknown + this->out_.unknown_len;
+  const size_t room = sizeof(this->out_.unknown) - this->out_.unknown_len;
+  int n;
+  if (strcmp(uri, "DAV:") == 0) {
+    n = snprintf(dest, room, "        <D:%.*s/>\n", (int) local_len, local);
+  } else if (uri[0] == '\0') {
+    n = snprintf(dest, room, "        <%.*s xmlns=\"\"/>\n", (int) local_len, local);
+  } else {
+    n = snprintf(dest, room, "        <X:%.*s xmlns:X=\"%s\"/>\n", (int) local_len, local, uri);
+  }
+  if (n < 0 || (size_t) n >= room) {
+    dest[0] = '\0';  // Pas de place : propriété omise plutôt que XML tronqué
+    ESP_LOGD(TAG, "Propriété inconnue ignorée: %.*s", (int) local_len, local);
+    return;
+  }
+  this->out_.unknown_len += n;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include <esp_http_server.h>
+
+namespace esphome {
+namespace webdavbox3 {
+
+enum PropfindMode : uint8_t {
+  PROPFIND_ALLPROP,   // Corps vide ou <allprop/>
+  PROPFIND_PROP,      // <prop> : seulement les propriétés listées
+  PROPFIND_PROPNAME,  // <propname/> : noms des propriétés, sans valeur
+};
+
+// Propriétés DAV: connues du serveur
+enum PropFlag : uint16_t {
+  PROP_RESOURCETYPE = 1 << 0,
+  PROP_GETLASTMODIFIED = 1 << 1,
+  PROP_CREATIONDATE = 1 << 2,
+  PROP_DISPLAYNAME = 1 << 3,
+  PROP_GETCONTENTLENGTH = 1 << 4,
+  PROP_GETCONTENTTYPE = 1 << 5,
+  PROP_GETETAG = 1 << 6,
+  PROP_ALL = 0x7f,
+};
+
+// Ce que demande le corps d'un PROPFIND
+struct PropRequest {
+  PropfindMode mode{PROPFIND_ALLPROP};
+  uint16_t props{PROP_ALL};
+  // Propriétés demandées mais inconnues, déjà sérialisées pour le propstat 404
+  // (<x:nom xmlns:x="..."/>) ; tronqué si le client en demande beaucoup
+  char unknown[384];
+  size_t unknown_len{0};
+
+  bool wants(uint16_t prop) const { return (this->props & prop) != 0; }
+};
+
+// Paramètres d'un REPORT sync-collection (RFC 6578)
+struct SyncRequest {
+  char token[96]{};  // Vide : synchronisation initiale
+  bool infinite{false};
+  uint32_t limit{0};  // <limit><nresults>, 0 = non demandé
+};
+
+/**
+ * @brief Analyseur XML incrémental du corps d'un PROPFIND ou d'un REPORT
+ * sync-collection (même élément <prop>).
+ *
+ * Alimenté morceau par morceau pendant la lecture du corps, sans allocation :
+ * seules les balises sont examinées, et le texte des quelques éléments
+ * sync-collection. Les déclarations xmlns sont retenues globalement, sans
+ * portée, ce qui suffit aux clients WebDAV réels.
+ */
+class PropfindBodyParser {
+ public:
+  // Avec sync non nul, l'élément racine attendu est <sync-collection>
+  explicit PropfindBodyParser(PropRequest &out, SyncRequest *sync = nullptr) : out_(out), sync_(sync) {}
+
+  void feed(const char *data, size_t len);
+  // false si le corps n'est pas un <propfind> (ou <sync-collection>) exploitable
+  bool finish();
+
+ protected:
+  enum State : uint8_t { STATE_TEXT, STATE_TAG, STATE_QUOTE, STATE_COMMENT };
+  enum Capture : uint8_t { CAPTURE_NONE, CAPTURE_SYNC_TOKEN, CAPTURE_SYNC_LEVEL, CAPTURE_NRESULTS };
+  struct Binding {
+    char prefix[16];
+    char uri[64];
+  };
+
+  void on_tag_();
+  void on_element_(const char *name, size_t name_len);
+  void bind_namespaces_(const char *attrs);
+  // URI du préfixe (chaîne vide si inconnu), prefix_len 0 = espace par défaut
+  const char *resolve_(const char *prefix, size_t prefix_len) const;
+  void add_unknown_(const char *local, size_t local_len, const char *uri);
+  void end_capture_();
+
+  PropRequest &out_;
+  SyncRequest *sync_;
+  State state_{STATE_TEXT};
+  char quote_{0};
+  char tag_[192];
+  size_t tag_len_{0};
+  bool tag_overflow_{false};
+  uint8_t comment_dashes_{0};
+
+  int depth_{0};
+  int prop_depth_{-1};  // Profondeur de <prop>, -1 hors de <prop>
+  bool saw_propfind_{false};
+  bool in_limit_{false};
+  Capture capture_{CAPTURE_NONE};
+  char text_[96];
+  size_t text_len_{0};
+  bool error_{false};
+
+  char default_ns_[64]{};
+  Binding bindings_[6];
+  uint8_t binding_count_{0};
+};
+
+/**
+ * @brief Sérialiseur XML en flux pour les réponses 207 Multi-Status.
+ *
+ * Chaque <D:response> est écrite dans un buffer de taille fixe, envoyé en
+ * chunk HTTP dès qu'il est plein : la mémoire utilisée ne dépend plus du
+ * nombre d'entrées et le premier octet part avant la fin du parcours.
+ */
+class MultistatusWriter {
+ public:
+  MultistatusWriter(httpd_req_t *req, char *buffer, size_t size) : req_(req), buf_(buffer), size_(size) {}
+
+  // Propriétés à produire (par défaut : allprop)
+  void set_request(const PropRequest *request) { this->request_ = request; }
+  // Évite de calculer une valeur que le client n'a pas demandée
+  bool wants(uint16_t prop) const {
+    return this->request_ == nullptr || this->request_->mode != PROPFIND_PROP || this->request_->wants(prop);
+  }
+
+  esp_err_t begin();
+  // href doit déjà être encodé pour une URL ; content_type ignoré pour un
+  // répertoire et peut être nul si getcontenttype n'est pas demandé
+  esp_err_t add_response(const char *href, bool is_directory, time_t modified, size_t size,
+                         const char *content_type);
+  // <D:response> sans propriétés : membre supprimé (404), résultat tronqué (507)...
+  // error est un élément DAV: optionnel placé dans <D:error>
+  esp_err_t add_status(const char *href, const char *status, const char *error = nullptr);
+  // <D:sync-token> d'un REPORT sync-collection, juste avant finish()
+  esp_err_t add_sync_token(const char *token);
+  // Ferme le document et termine la réponse chunked ; description optionnelle
+  // (<D:responsedescription>, par exemple pour signaler un résultat tronqué)
+  esp_err_t finish(const char *description = nullptr);
+  // Rien n'est encore parti sur le réseau : le statut peut encore changer
+  bool has_sent() const { return this->flushes_ > 0; }
+  // Abandonne le contenu bufferisé (seulement si !has_sent())
+  void discard() {
+    this->used_ = 0;
+    this->entries_ = 0;
+  }
+
+  uint32_t get_entries() const { return this->entries_; }
+  size_t get_bytes_sent() const { return this->bytes_sent_; }
+  uint32_t get_flushes() const { return this->flushes_; }
+
+ protected:
+  void write_props_(uint16_t props, bool names_only, bool is_directory, time_t modified, size_t size,
+                    const char *content_type, const char *name, size_t name_len);
+  esp_err_t write_(const char *data, size_t len);
+  template<size_t N> esp_err_t write_(const char (&literal)[N]) { return this->write_(literal, N - 1); }
+  // Copie le texte en échappant &, < et >
+  esp_err_t write_escaped_(const char *text, size_t len);
+  esp_err_t flush_();
+
+  httpd_req_t *req_;
+  char *buf_;
+  size_t size_;
+  const PropRequest *request_{nullptr};
+  size_t used_{0};
+  size_t bytes_sent_{0};
+  uint32_t entries_{0};
+  uint32_t flushes_{0};
+  esp_err_t error_{ESP_OK};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
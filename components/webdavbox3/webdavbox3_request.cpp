@@ -0,0 +1,133 @@
+#include "webdavbox3_request.h"
+#include "esphome/core/log.h"
+
+#include <cerrno>
+#include <cstring>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.request";
+
+// Valeur d'un chiffre hexadécimal, -1 pour les autres octets
+struct HexTable {
+  int8_t value[256];
+  constexpr HexTable() : value() {
+    for (int i = 0; i < 256; i++)
+      value[i] = -1;
+    for (int i = 0; i < 10; i++)
+      value['0' + i] = i;
+    for (int i = 0; i < 6; i++) {
+      value['a' + i] = 10 + i;
+      value['A' + i] = 10 + i;
+    }
+  }
+};
+static constexpr HexTable HEX_TABLE{};
+
+bool normalize_uri_path(const char *uri, size_t len, std::string &out) {
+  out.clear();
+  out.reserve(len + 1);
+  out += '/';
+  size_t segment = 1;  // Début du segment courant dans out
+  for (size_t i = 0; i <= len; i++) {
+    char c = '/';  // Fin de l'URI : clôt le dernier segment
+    if (i < len) {
+      c = uri[i];
+      if (c == '%' && i + 2 < len) {
+        int hi = HEX_TABLE.value[(uint8_t) uri[i + 1]];
+        int lo = HEX_TABLE.value[(uint8_t) uri[i + 2]];
+        if (hi >= 0 && lo >= 0) {
+          c = (char) ((hi << 4) | lo);
+          if (c == '\0')
+            return false;
+          i += 2;
+        }
+      }
+      if (c != '/') {
+        out += c;
+        continue;
+      }
+    }
+    // Séparateur, y compris %2F : ".." est refusé après décodage
+    const size_t segment_len = out.size() - segment;
+    if (segment_len == 0 || (segment_len == 1 && out[segment] == '.')) {
+      out.resize(segment);
+      continue;
+    }
+    if (segment_len == 2 && out[segment] == '.' && out[segment + 1] == '.')
+      return false;
+    out += '/';
+    segment = out.size();
+  }
+  if (out.size() > 1)
+    out.pop_back();
+  return true;
+}
+
+bool is_state_uri(const std::string &uri_path) {
+  const size_t len = sizeof(STATE_DIR) - 1;
+  return uri_path.size() > len && uri_path[0] == '/' && uri_path.compare(1, len, STATE_DIR) == 0 &&
+         (uri_path.size() == len + 1 || uri_path[len + 1] == '/');
+}
+
+bool RequestContext::resolve(httpd_req_t *req, const std::string &root_path) {
+  return this->resolve_uri(req->uri, strcspn(req->uri, "?"), root_path);
+}
+
+bool RequestContext::resolve_uri(const char *uri, size_t len, const std::string &root_path) {
+  this->stat_state_ = STAT_UNKNOWN;
+  if (!normalize_uri_path(uri, len, this->uri_path_)) {
+    ESP_LOGW(TAG, "URI refusée: %.*s", (int) len, uri);
+    this->path_.clear();
+    return false;
+  }
+  if (is_state_uri(this->uri_path_)) {
+    ESP_LOGW(TAG, "Accès au répertoire interne refusé: %.*s", (int) len, uri);
+    this->path_.clear();
+    return false;
+  }
+  size_t root_len = root_path.size();
+  while (root_len > 0 && root_path[root_len - 1] == '/')
+    root_len--;
+  this->path_.reserve(root_len + this->uri_path_.size());
+  this->path_.assign(root_path, 0, root_len);
+  if (!this->is_root())
+    this->path_ += this->uri_path_;
+  ESP_LOGV(TAG, "%.*s -> %s", (int) len, uri, this->path_.c_str());
+  return true;
+}
+
+bool RequestContext::resolve_href(const char *href, const std::string &root_path) {
+  const char *path = href;
+  const char *scheme = strstr(href, "://");
+  if (scheme != nullptr) {
+    // Sauter le protocole et l'hôte
+    path = strchr(scheme + 3, '/');
+    if (path == nullptr)
+      path = "/";
+  }
+  if (path[0] != '/')
+    return false;
+  return this->resolve_uri(path, strcspn(path, "?#"), root_path);
+}
+
+const struct stat *RequestContext::get_stat() {
+  if (this->stat_state_ == STAT_UNKNOWN) {
+    if (::stat(this->path_.c_str(), &this->st_) == 0) {
+      this->stat_state_ = STAT_PRESENT;
+    } else {
+      this->stat_state_ = STAT_MISSING;
+      this->stat_errno_ = errno;
+    }
+  }
+  return this->stat_state_ == STAT_PRESENT ? &this->st_ : nullptr;
+}
+
+void RequestContext::set_stat(const struct stat &st) {
+  this->st_ = st;
+  this->stat_state_ = STAT_PRESENT;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/stat.h>
+
+#include <esp_http_server.h>
+
+#include "webdavbox3_arena.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+// Répertoire des fichiers internes du serveur (journal, envois, corbeille),
+// à la racine seulement ; inaccessible par URL
+constexpr char STATE_DIR[] = ".webdavbox3";
+
+// uri_path normalisée désignant le répertoire interne ou son contenu
+bool is_state_uri(const std::string &uri_path);
+
+// Décode les %XX (table de correspondance, '+' reste littéral dans un chemin)
+// et normalise : segments vides et "." supprimés, ".." et %00 refusés.
+// out commence par '/' et ne se termine par '/' que pour la racine.
+bool normalize_uri_path(const char *uri, size_t len, std::string &out);
+
+/**
+ * @brief Chemin d'une requête, résolu une seule fois.
+ *
+ * L'URI est décodée et normalisée à la construction du contexte, puis le
+ * résultat de stat() est conservé : les gestionnaires qui s'appellent entre
+ * eux (GET d'un dossier -> PROPFIND) se passent le contexte au lieu de
+ * refaire décodage et stat(). Vit sur la pile du gestionnaire et porte
+ * l'arène de la requête, rendue (et remise à zéro) à sa destruction.
+ */
+class RequestContext {
+ public:
+  // Sans pool, les temporaires de la requête vont sur le tas
+  explicit RequestContext(ArenaPool *arenas = nullptr) : lease_(arenas) {}
+
+  // false si l'URI est refusée (remontée hors de la racine, octet nul,
+  // répertoire interne)
+  bool resolve(httpd_req_t *req, const std::string &root_path);
+  bool resolve_uri(const char *uri, size_t len, const std::string &root_path);
+  // En-tête Destination : URL absolue ou chemin absolu
+  bool resolve_href(const char *href, const std::string &root_path);
+
+  // URI décodée et normalisée ("/" pour la racine)
+  const std::string &uri_path() const { return this->uri_path_; }
+  // Chemin sur la carte
+  const std::string &path() const { return this->path_; }
+  bool is_root() const { return this->uri_path_.size() == 1; }
+
+  // Un seul stat() par requête ; nullptr si le chemin n'existe pas
+  const struct stat *get_stat();
+  bool exists() { return this->get_stat() != nullptr; }
+  bool is_dir() {
+    const struct stat *st = this->get_stat();
+    return st != nullptr && S_ISDIR(st->st_mode);
+  }
+  int get_stat_errno() const { return this->stat_errno_; }
+  // Attributs connus sans accès à la carte (listing en cache)
+  void set_stat(const struct stat &st);
+  // Après une écriture sur le chemin
+  void forget_stat() { this->stat_state_ = STAT_UNKNOWN; }
+
+  // Arène des temporaires de la requête, nullptr = tas
+  Arena *arena() const { return this->lease_.get(); }
+
+ protected:
+  enum StatState : uint8_t { STAT_UNKNOWN, STAT_MISSING, STAT_PRESENT };
+
+  // Premier membre : rendu après la destruction de tout le reste
+  ArenaLease lease_;
+  // Chemins gardés en std::string : clés des caches et du journal
+  std::string uri_path_;
+  std::string path_;
+  struct stat st_;
+  StatState stat_state_{STAT_UNKNOWN};
+  int stat_errno_{0};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,347 @@
+#include "webdavbox3_transfer.h"
+#include "webdavbox3_workers.h"
+#include "esphome/core/log.h"
+#include "esp_timer.h"
+#include <errno.h>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.transfer";
+
+// Au niveau du worker de transfert qui envoie ce que le lecteur remplit :
+// au-dessus, la lecture SD le préempterait au milieu des envois socket
+static const UBaseType_t READER_TASK_PRIORITY = BULK_TASK_PRIORITY;
+static const uint32_t READER_TASK_STACK = 4096;
+// Idem pour l'écriture : le worker qui reçoit le corps n'est pas préempté
+static const UBaseType_t WRITER_TASK_PRIORITY = BULK_TASK_PRIORITY;
+static const uint32_t WRITER_TASK_STACK = 4096;
+static const TickType_t ABORT_POLL_TICKS = pdMS_TO_TICKS(100);
+
+ReadAheadPipeline::ReadAheadPipeline(TransferBufferPool &pool, size_t depth, size_t chunk_size)
+    : pool_(pool), depth_(depth < 2 ? 2 : depth), chunk_size_(chunk_size) {}
+
+ReadAheadPipeline::~ReadAheadPipeline() {
+  this->stop();
+  if (this->free_queue_ != nullptr)
+    vQueueDelete(this->free_queue_);
+  if (this->filled_queue_ != nullptr)
+    vQueueDelete(this->filled_queue_);
+  if (this->done_ != nullptr)
+    vSemaphoreDelete(this->done_);
+}
+
+bool ReadAheadPipeline::init(TickType_t timeout) {
+  for (size_t i = 0; i < this->depth_; i++) {
+    // Seul le premier emprunt attend : un anneau réduit vaut mieux qu'une file d'attente
+    TransferBuffer buf = this->pool_.borrow(this->chunk_size_, i == 0 ? timeout : 0);
+    if (!buf)
+      break;
+    // L'anneau fonctionne à la taille du plus petit buffer obtenu
+    if (buf.size() < this->chunk_size_)
+      this->chunk_size_ = buf.size();
+    this->buffers_.push_back(std::move(buf));
+  }
+  if (this->buffers_.size() < 2) {
+    ESP_LOGW(TAG, "Seulement %zu/%zu buffers disponibles dans le pool", this->buffers_.size(), this->depth_);
+    this->buffers_.clear();
+    return false;
+  }
+  this->depth_ = this->buffers_.size();
+
+  // Un emplacement de plus pour le marqueur de fin
+  this->free_queue_ = xQueueCreate(this->depth_, sizeof(int16_t));
+  this->filled_queue_ = xQueueCreate(this->depth_ + 1, sizeof(Slot));
+  this->done_ = xSemaphoreCreateBinary();
+  return this->free_queue_ != nullptr && this->filled_queue_ != nullptr && this->done_ != nullptr;
+}
+
+esp_err_t ReadAheadPipeline::start(FILE *file, size_t offset, size_t length) {
+  if (this->running_)
+    return ESP_ERR_INVALID_STATE;
+
+  this->file_ = file;
+  this->offset_ = offset;
+  this->length_ = length;
+  this->abort_ = false;
+  this->error_ = false;
+  this->current_ = -1;
+
+  xQueueReset(this->free_queue_);
+  xQueueReset(this->filled_queue_);
+  for (int16_t i = 0; i < (int16_t) this->depth_; i++) {
+    xQueueSend(this->free_queue_, &i, 0);
+  }
+
+  if (xTaskCreate(reader_task_, "webdav_reader", READER_TASK_STACK, this, READER_TASK_PRIORITY, nullptr) != pdPASS) {
+    ESP_LOGE(TAG, "Impossible de créer la tâche de lecture");
+    return ESP_ERR_NO_MEM;
+  }
+  this->running_ = true;
+  return ESP_OK;
+}
+
+bool ReadAheadPipeline::acquire(const char **data, size_t *len) {
+  if (!this->running_)
+    return false;
+
+  Slot slot;
+  if (uxQueueMessagesWaiting(this->filled_queue_) == 0) {
+    // Aucun buffer prêt : la carte SD ne suit pas le réseau
+    this->stats_.sender_stalls++;
+    int64_t wait_start = esp_timer_get_time();
+    xQueueReceive(this->filled_queue_, &slot, portMAX_DELAY);
+    this->stats_.sender_wait_us += esp_timer_get_time() - wait_start;
+  } else {
+    xQueueReceive(this->filled_queue_, &slot, 0);
+  }
+
+  if (slot.index < 0) {
+    this->error_ = slot.index == SLOT_ERROR;
+    xSemaphoreTake(this->done_, portMAX_DELAY);
+    this->running_ = false;
+    return false;
+  }
+
+  this->current_ = slot.index;
+  *data = this->buffers_[slot.index].data();
+  *len = slot.len;
+  return true;
+}
+
+void ReadAheadPipeline::release() {
+  if (this->current_ < 0)
+    return;
+  xQueueSend(this->free_queue_, &this->current_, 0);
+  this->current_ = -1;
+}
+
+void ReadAheadPipeline::stop() {
+  if (!this->running_)
+    return;
+
+  this->abort_ = true;
+  this->release();
+  // Continuer à recycler les buffers pour que le lecteur ne reste pas bloqué
+  while (xSemaphoreTake(this->done_, pdMS_TO_TICKS(10)) != pdTRUE) {
+    Slot slot;
+    while (xQueueReceive(this->filled_queue_, &slot, 0) == pdTRUE) {
+      if (slot.index >= 0)
+        xQueueSend(this->free_queue_, &slot.index, 0);
+    }
+  }
+  this->running_ = false;
+}
+
+void ReadAheadPipeline::reader_task_(void *arg) {
+  auto *self = static_cast<ReadAheadPipeline *>(arg);
+  self->reader_loop_();
+  xSemaphoreGive(self->done_);
+  vTaskDelete(nullptr);
+}
+
+void ReadAheadPipeline::reader_loop_() {
+  Slot end{SLOT_EOF, 0};
+
+  if (fseek(this->file_, this->offset_, SEEK_SET) != 0) {
+    ESP_LOGE(TAG, "Échec du positionnement à l'offset %zu (errno: %d)", this->offset_, errno);
+    end.index = SLOT_ERROR;
+    xQueueSend(this->filled_queue_, &end, portMAX_DELAY);
+    return;
+  }
+
+  size_t remaining = this->length_;
+  while (remaining > 0 && !this->abort_) {
+    int16_t index;
+    if (uxQueueMessagesWaiting(this->free_queue_) == 0) {
+      // Tous les buffers sont pleins : le réseau ne suit pas la carte SD
+      this->stats_.reader_stalls++;
+      int64_t wait_start = esp_timer_get_time();
+      while (xQueueReceive(this->free_queue_, &index, ABORT_POLL_TICKS) != pdTRUE) {
+        if (this->abort_)
+          return;
+      }
+      this->stats_.reader_wait_us += esp_timer_get_time() - wait_start;
+    } else {
+      xQueueReceive(this->free_queue_, &index, 0);
+    }
+
+    size_t to_read = remaining < this->chunk_size_ ? remaining : this->chunk_size_;
+    size_t read_bytes = fread(this->buffers_[index].data(), 1, to_read, this->file_);
+    if (read_bytes == 0) {
+      ESP_LOGE(TAG, "Lecture interrompue à %zu/%zu octets", this->length_ - remaining, this->length_);
+      end.index = SLOT_ERROR;
+      break;
+    }
+
+    Slot slot{index, (uint32_t) read_bytes};
+    xQueueSend(this->filled_queue_, &slot, portMAX_DELAY);
+    remaining -= read_bytes;
+    this->stats_.bytes += read_bytes;
+  }
+
+  if (!this->abort_)
+    xQueueSend(this->filled_queue_, &end, portMAX_DELAY);
+}
+
+WriteBehindPipeline::WriteBehindPipeline(TransferBufferPool &pool, size_t depth, size_t chunk_size)
+    : pool_(pool), depth_(depth < 2 ? 2 : depth), chunk_size_(chunk_size) {}
+
+WriteBehindPipeline::~WriteBehindPipeline() {
+  this->stop();
+  if (this->free_queue_ != nullptr)
+    vQueueDelete(this->free_queue_);
+  if (this->filled_queue_ != nullptr)
+    vQueueDelete(this->filled_queue_);
+  if (this->done_ != nullptr)
+    vSemaphoreDelete(this->done_);
+}
+
+bool WriteBehindPipeline::init(TickType_t timeout) {
+  for (size_t i = 0; i < this->depth_; i++) {
+    TransferBuffer buf = this->pool_.borrow(this->chunk_size_, i == 0 ? timeout : 0);
+    if (!buf)
+      break;
+    if (buf.size() < this->chunk_size_)
+      this->chunk_size_ = buf.size();
+    this->buffers_.push_back(std::move(buf));
+  }
+  if (this->buffers_.size() < 2) {
+    ESP_LOGW(TAG, "Seulement %zu/%zu buffers disponibles dans le pool", this->buffers_.size(), this->depth_);
+    this->buffers_.clear();
+    return false;
+  }
+  this->depth_ = this->buffers_.size();
+
+  this->free_queue_ = xQueueCreate(this->depth_, sizeof(int16_t));
+  this->filled_queue_ = xQueueCreate(this->depth_ + 1, sizeof(Slot));
+  this->done_ = xSemaphoreCreateBinary();
+  return this->free_queue_ != nullptr && this->filled_queue_ != nullptr && this->done_ != nullptr;
+}
+
+esp_err_t WriteBehindPipeline::start(FILE *file) {
+  if (this->running_)
+    return ESP_ERR_INVALID_STATE;
+
+  this->file_ = file;
+  this->abort_ = false;
+  this->error_ = false;
+  this->current_ = -1;
+  this->stats_ = UploadStats();
+  this->start_us_ = esp_timer_get_time();
+
+  xQueueReset(this->free_queue_);
+  xQueueReset(this->filled_queue_);
+  for (int16_t i = 0; i < (int16_t) this->depth_; i++) {
+    xQueueSend(this->free_queue_, &i, 0);
+  }
+
+  if (xTaskCreate(writer_task_, "webdav_writer", WRITER_TASK_STACK, this, WRITER_TASK_PRIORITY, nullptr) != pdPASS) {
+    ESP_LOGE(TAG, "Impossible de créer la tâche d'écriture");
+    return ESP_ERR_NO_MEM;
+  }
+  this->running_ = true;
+  return ESP_OK;
+}
+
+bool WriteBehindPipeline::acquire(char **data, size_t *capacity) {
+  if (!this->running_ || this->error_)
+    return false;
+
+  int16_t index;
+  if (uxQueueMessagesWaiting(this->free_queue_) == 0) {
+    // Tous les buffers attendent la carte : contre-pression sur la réception
+    this->stats_.receiver_stalls++;
+    int64_t wait_start = esp_timer_get_time();
+    xQueueReceive(this->free_queue_, &index, portMAX_DELAY);
+    this->stats_.receiver_wait_us += esp_timer_get_time() - wait_start;
+  } else {
+    xQueueReceive(this->free_queue_, &index, 0);
+  }
+  if (this->error_) {
+    xQueueSend(this->free_queue_, &index, 0);
+    return false;
+  }
+
+  this->current_ = index;
+  *data = this->buffers_[index].data();
+  *capacity = this->chunk_size_;
+  return true;
+}
+
+void WriteBehindPipeline::commit(size_t len) {
+  if (this->current_ < 0)
+    return;
+  if (len == 0) {
+    xQueueSend(this->free_queue_, &this->current_, 0);
+  } else {
+    Slot slot{this->current_, (uint32_t) len};
+    xQueueSend(this->filled_queue_, &slot, portMAX_DELAY);
+    this->stats_.bytes += len;
+  }
+  this->current_ = -1;
+}
+
+bool WriteBehindPipeline::finish() {
+  if (!this->running_)
+    return !this->error_;
+  this->commit(0);
+  Slot end{SLOT_EOF, 0};
+  xQueueSend(this->filled_queue_, &end, portMAX_DELAY);
+  xSemaphoreTake(this->done_, portMAX_DELAY);
+  this->running_ = false;
+  this->stats_.elapsed_us = esp_timer_get_time() - this->start_us_;
+  return !this->error_;
+}
+
+void WriteBehindPipeline::stop() {
+  if (!this->running_)
+    return;
+  this->abort_ = true;
+  this->commit(0);
+  Slot end{SLOT_EOF, 0};
+  xQueueSend(this->filled_queue_, &end, portMAX_DELAY);
+  xSemaphoreTake(this->done_, portMAX_DELAY);
+  this->running_ = false;
+  this->stats_.elapsed_us = esp_timer_get_time() - this->start_us_;
+}
+
+void WriteBehindPipeline::writer_task_(void *arg) {
+  auto *self = static_cast<WriteBehindPipeline *>(arg);
+  self->writer_loop_();
+  xSemaphoreGive(self->done_);
+  vTaskDelete(nullptr);
+}
+
+void WriteBehindPipeline::writer_loop_() {
+  while (true) {
+    Slot slot;
+    if (uxQueueMessagesWaiting(this->filled_queue_) == 0) {
+      // Aucun buffer plein : le réseau ne suit pas la carte
+      this->stats_.writer_stalls++;
+      int64_t wait_start = esp_timer_get_time();
+      xQueueReceive(this->filled_queue_, &slot, portMAX_DELAY);
+      this->stats_.writer_wait_us += esp_timer_get_time() - wait_start;
+    } else {
+      xQueueReceive(this->filled_queue_, &slot, 0);
+    }
+    if (slot.index < 0)
+      break;
+
+    // Après une erreur ou un abandon, les buffers sont seulement recyclés
+    if (!this->error_ && !this->abort_) {
+      int64_t write_start = esp_timer_get_time();
+      size_t written = fwrite(this->buffers_[slot.index].data(), 1, slot.len, this->file_);
+      this->stats_.write_us += esp_timer_get_time() - write_start;
+      this->stats_.writes++;
+      if (written != slot.len) {
+        ESP_LOGE(TAG, "Écriture interrompue: %zu/%u octets (errno: %d)", written, (unsigned) slot.len, errno);
+        this->error_ = true;
+      }
+    }
+    xQueueSend(this->free_queue_, &slot.index, 0);
+  }
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "webdavbox3_buffers.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+// Compteurs d'un transfert : indiquent quel côté limite le débit
+struct TransferStats {
+  uint32_t reader_stalls{0};    // Le lecteur SD attend un buffer libre -> réseau plus lent
+  uint32_t sender_stalls{0};    // L'émetteur attend un buffer plein -> carte SD plus lente
+  uint64_t reader_wait_us{0};
+  uint64_t sender_wait_us{0};
+  uint64_t bytes{0};
+
+  const char *bottleneck() const {
+    if (reader_wait_us == sender_wait_us) return "équilibré";
+    return reader_wait_us > sender_wait_us ? "réseau" : "carte SD";
+  }
+};
+
+// Compteurs d'un PUT : réception réseau d'un côté, écriture SD de l'autre
+struct UploadStats {
+  uint32_t receiver_stalls{0};  // La réception attend un buffer libre -> carte SD plus lente
+  uint32_t writer_stalls{0};    // L'écrivain attend un buffer plein -> réseau plus lent
+  uint64_t receiver_wait_us{0};
+  uint64_t writer_wait_us{0};
+  uint64_t write_us{0};  // Temps passé dans fwrite()
+  uint32_t writes{0};
+  uint64_t bytes{0};
+  uint64_t elapsed_us{0};
+
+  float throughput_kbps() const { return elapsed_us > 0 ? bytes * 1000000.0f / elapsed_us / 1024.0f : 0.0f; }
+  const char *bottleneck() const {
+    if (receiver_wait_us == writer_wait_us) return "équilibré";
+    return receiver_wait_us > writer_wait_us ? "carte SD" : "réseau";
+  }
+};
+
+/**
+ * @brief Anneau de N buffers PSRAM rempli par une tâche de lecture SD pendant
+ * que la tâche httpd vide les buffers pleins sur la socket.
+ *
+ * Les buffers sont empruntés au pool de transfert pour la durée de la réponse.
+ */
+class ReadAheadPipeline {
+ public:
+  ReadAheadPipeline(TransferBufferPool &pool, size_t depth, size_t chunk_size);
+  ~ReadAheadPipeline();
+
+  // Emprunte les buffers ; false si moins de deux ont pu être obtenus
+  bool init(TickType_t timeout);
+
+  // Démarre la lecture de la fenêtre [offset, offset + length) de file
+  esp_err_t start(FILE *file, size_t offset, size_t length);
+  // Bloque jusqu'au prochain buffer plein ; false en fin de fenêtre ou sur erreur
+  bool acquire(const char **data, size_t *len);
+  // Rend le buffer obtenu par acquire() au lecteur
+  void release();
+  // Interrompt la lecture en cours et attend la fin de la tâche
+  void stop();
+
+  bool has_error() const { return this->error_; }
+  size_t get_chunk_size() const { return this->chunk_size_; }
+  const TransferStats &get_stats() const { return this->stats_; }
+
+ protected:
+  struct Slot {
+    int16_t index;  // >= 0 : buffer plein, SLOT_EOF / SLOT_ERROR : fin de fenêtre
+    uint32_t len;
+  };
+  static const int16_t SLOT_EOF = -1;
+  static const int16_t SLOT_ERROR = -2;
+
+  static void reader_task_(void *arg);
+  void reader_loop_();
+
+  TransferBufferPool &pool_;
+  size_t depth_;
+  size_t chunk_size_;
+  std::vector<TransferBuffer> buffers_;
+  QueueHandle_t free_queue_{nullptr};
+  QueueHandle_t filled_queue_{nullptr};
+  SemaphoreHandle_t done_{nullptr};
+
+  FILE *file_{nullptr};
+  size_t offset_{0};
+  size_t length_{0};
+  int16_t current_{-1};
+  volatile bool abort_{false};
+  bool running_{false};
+  bool error_{false};
+  TransferStats stats_;
+};
+
+/**
+ * @brief Pendant d'écriture de ReadAheadPipeline : la tâche httpd remplit des
+ * buffers PSRAM avec le corps reçu, une tâche d'écriture les vide sur la carte.
+ *
+ * Chaque buffer n'est confié qu'une fois plein : les écritures font chunk_size
+ * octets (un multiple de la taille de cluster) et vont directement à FatFs :
+ * le flux confié à start() doit être ouvert sans tampon stdio. Quand la carte ne suit plus, acquire() bloque et la
+ * réception s'arrête : la fenêtre TCP fait le reste.
+ */
+class WriteBehindPipeline {
+ public:
+  WriteBehindPipeline(TransferBufferPool &pool, size_t depth, size_t chunk_size);
+  ~WriteBehindPipeline();
+
+  // Emprunte les buffers ; false si moins de deux ont pu être obtenus
+  bool init(TickType_t timeout);
+
+  // Démarre la tâche d'écriture vers file, ouvert et encore jamais écrit
+  esp_err_t start(FILE *file);
+  // Bloque jusqu'à un buffer libre ; false si une écriture a échoué
+  bool acquire(char **data, size_t *capacity);
+  // Confie les len premiers octets du buffer obtenu par acquire() à l'écrivain
+  void commit(size_t len);
+  // Attend l'écriture de tous les buffers confiés ; false sur erreur d'écriture
+  bool finish();
+  // Abandonne les buffers en attente et attend la fin de la tâche
+  void stop();
+
+  bool has_error() const { return this->error_; }
+  size_t get_chunk_size() const { return this->chunk_size_; }
+  size_t get_depth() const { return this->depth_; }
+  const UploadStats &get_stats() const { return this->stats_; }
+
+ protected:
+  struct Slot {
+    int16_t index;  // >= 0 : buffer plein, SLOT_EOF : plus rien à écrire
+    uint32_t len;
+  };
+  static const int16_t SLOT_EOF = -1;
+
+  static void writer_task_(void *arg);
+  void writer_loop_();
+
+  TransferBufferPool &pool_;
+  size_t depth_;
+  size_t chunk_size_;
+  std::vector<TransferBuffer> buffers_;
+  QueueHandle_t free_queue_{nullptr};
+  QueueHandle_t filled_queue_{nullptr};
+  SemaphoreHandle_t done_{nullptr};
+
+  FILE *file_{nullptr};
+  int16_t current_{-1};
+  int64_t start_us_{0};
+  volatile bool abort_{false};
+  volatile bool error_{false};
+  bool running_{false};
+  UploadStats stats_;
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
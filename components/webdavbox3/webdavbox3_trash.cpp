@@ -0,0 +1,174 @@
+#include "webdavbox3_trash.h"
+#include "webdavbox3_listing.h"
+#include "esphome/core/log.h"
+#include "esp_timer.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.trash";
+
+static const UBaseType_t TRASH_TASK_PRIORITY = tskIDLE_PRIORITY + 1;
+static const uint32_t TRASH_TASK_STACK = 4096;
+// Entrées supprimées par lecture de dossier avant de rendre la main
+static const size_t TRASH_BATCH = 16;
+// Clusters libérés par appel : un gros fichier est raccourci par tranches
+static const size_t TRASH_TRUNCATE_STEP = 32 * 1024 * 1024;
+// Noms déjà pris (reste d'une session précédente) : quelques essais
+static const int TRASH_NAME_ATTEMPTS = 8;
+
+bool TrashReclaimer::start(const std::string &trash_dir) {
+  if (this->task_handle_ != nullptr)
+    return true;
+  this->trash_dir_ = trash_dir;
+  if (xTaskCreate(task_, "webdav_trash", TRASH_TASK_STACK, this, TRASH_TASK_PRIORITY, &this->task_handle_) !=
+      pdPASS) {
+    ESP_LOGE(TAG, "Impossible de créer la tâche de la corbeille");
+    this->task_handle_ = nullptr;
+    return false;
+  }
+  // Purge interrompue par une coupure : reprise dès le démarrage
+  xTaskNotifyGive(this->task_handle_);
+  return true;
+}
+
+bool TrashReclaimer::discard(const std::string &path) {
+  if (this->task_handle_ == nullptr)
+    return false;
+  char name[16];
+  for (int attempt = 0; attempt < TRASH_NAME_ATTEMPTS; attempt++) {
+    snprintf(name, sizeof(name), "/%08x", (unsigned) this->seq_++);
+    // Une seule entrée de répertoire déplacée, quelle que soit la taille
+    if (rename(path.c_str(), (this->trash_dir_ + name).c_str()) == 0) {
+      this->stats_.discarded++;
+      xTaskNotifyGive(this->task_handle_);
+      return true;
+    }
+    if (errno != EEXIST)
+      break;
+  }
+  ESP_LOGW(TAG, "Renommage de %s vers la corbeille impossible (errno: %d)", path.c_str(), errno);
+  return false;
+}
+
+void TrashReclaimer::task_(void *arg) {
+  auto *self = static_cast<TrashReclaimer *>(arg);
+  bool boot = true;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (boot) {
+      DirectoryReader reader;
+      DirEntry entry;
+      if (reader.open(self->trash_dir_)) {
+        while (reader.next(entry)) self->stats_.recovered++;
+      }
+      if (self->stats_.recovered > 0)
+        ESP_LOGI(TAG, "Reprise de la purge: %u entrée(s) dans la corbeille", (unsigned) self->stats_.recovered);
+      boot = false;
+    }
+    self->reclaim_all_();
+  }
+}
+
+void TrashReclaimer::reclaim_all_() {
+  const int64_t start = esp_timer_get_time();
+  const uint64_t bytes_before = this->stats_.reclaimed_bytes;
+  uint32_t entries = 0;
+  DirEntry entry;
+  while (true) {
+    // Première entrée seulement : le dossier change à chaque suppression
+    bool found;
+    {
+      DirectoryReader reader;
+      found = reader.open(this->trash_dir_) && reader.next(entry);
+    }
+    if (!found)
+      break;
+    if (!this->reclaim_entry_(this->trash_dir_ + "/" + entry.name)) {
+      // Pas de boucle sur une entrée récalcitrante : nouvel essai au prochain DELETE
+      this->stats_.failures++;
+      ESP_LOGW(TAG, "Purge de %s interrompue (errno: %d)", entry.name.c_str(), errno);
+      break;
+    }
+    entries++;
+    if (this->on_reclaimed_)
+      this->on_reclaimed_();
+  }
+  if (entries > 0) {
+    ESP_LOGI(TAG, "%u entrée(s) purgée(s), %.1f Mo libérés en %.1f s", (unsigned) entries,
+             (this->stats_.reclaimed_bytes - bytes_before) / 1048576.0f, (esp_timer_get_time() - start) / 1e6f);
+  }
+}
+
+bool TrashReclaimer::reclaim_entry_(const std::string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return errno == ENOENT;
+  if (!S_ISDIR(st.st_mode))
+    return this->remove_file_(path, st.st_size);
+
+  // Profondeur d'abord, sans récursion : un dossier n'est relu qu'une fois
+  // ses sous-dossiers vidés, et supprimé dès qu'il est vide
+  std::vector<std::string> pending{path};
+  std::vector<DirEntry> batch;
+  batch.reserve(TRASH_BATCH);
+  DirEntry entry;
+  while (!pending.empty()) {
+    const std::string dir = pending.back();
+    batch.clear();
+    {
+      DirectoryReader reader;
+      if (!reader.open(dir))
+        return false;
+      while (batch.size() < TRASH_BATCH && reader.next(entry)) batch.push_back(entry);
+    }
+    if (batch.empty()) {
+      if (rmdir(dir.c_str()) != 0 && errno != ENOENT)
+        return false;
+      this->stats_.reclaimed_dirs++;
+      pending.pop_back();
+      continue;
+    }
+    for (const auto &child : batch) {
+      if (child.is_dir) {
+        pending.push_back(dir + "/" + child.name);
+        break;
+      }
+      if (!this->remove_file_(dir + "/" + child.name, child.size))
+        return false;
+    }
+    vTaskDelay(1);  // Laisser la main aux transferts en cours
+  }
+  return true;
+}
+
+bool TrashReclaimer::remove_file_(const std::string &path, size_t size) {
+  if (size > TRASH_TRUNCATE_STEP) {
+    FILE *f = fopen(path.c_str(), "r+b");
+    if (f != nullptr) {
+      // Libération par la fin, une tranche de clusters par appel
+      size_t remaining = size;
+      while (remaining > TRASH_TRUNCATE_STEP) {
+        remaining -= TRASH_TRUNCATE_STEP;
+        if (ftruncate(fileno(f), remaining) != 0)
+          break;
+        vTaskDelay(1);
+      }
+      fclose(f);
+    }
+  }
+  if (unlink(path.c_str()) != 0 && errno != ENOENT)
+    return false;
+  this->stats_.reclaimed_files++;
+  this->stats_.reclaimed_bytes += size;
+  return true;
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+struct TrashStats {
+  uint32_t discarded{0};        // DELETE servis par un renommage
+  uint32_t reclaimed_files{0};
+  uint32_t reclaimed_dirs{0};
+  uint64_t reclaimed_bytes{0};
+  uint32_t recovered{0};        // Entrées laissées par une purge interrompue, reprises au démarrage
+  uint32_t failures{0};
+};
+
+/**
+ * @brief Corbeille interne : DELETE en O(1), libération des clusters en tâche de fond.
+ *
+ * La cible est renommée dans le dossier caché, ce qui ne touche qu'une entrée
+ * de répertoire. Une tâche de basse priorité vide ensuite la corbeille par
+ * petites tranches : quelques entrées par lecture de dossier, et les gros
+ * fichiers raccourcis pas à pas avant unlink(), pour que FatFs ne parcoure
+ * jamais d'un coup toute une chaîne de clusters en tenant le verrou du volume.
+ * Ce qui reste dans la corbeille au démarrage est purgé de la même façon.
+ */
+class TrashReclaimer {
+ public:
+  // trash_dir doit exister, sur le même volume que les fichiers supprimés
+  bool start(const std::string &trash_dir);
+  bool is_enabled() const { return this->task_handle_ != nullptr; }
+
+  // Renomme path dans la corbeille ; false si le renommage est impossible
+  bool discard(const std::string &path);
+
+  TrashStats get_stats() const { return this->stats_; }
+  // Appelé après chaque entrée libérée (place libre à relire)
+  void set_on_reclaimed(std::function<void()> &&callback) { this->on_reclaimed_ = std::move(callback); }
+
+ protected:
+  static void task_(void *arg);
+  void reclaim_all_();
+  bool reclaim_entry_(const std::string &path);
+  bool remove_file_(const std::string &path, size_t size);
+
+  std::string trash_dir_;
+  std::atomic<uint32_t> seq_{0};
+  std::function<void()> on_reclaimed_;
+  TaskHandle_t task_handle_{nullptr};
+  TrashStats stats_;
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,146 @@
+#include "webdavbox3_upload.h"
+#include "webdavbox3_listing.h"
+#include "esphome/core/log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.upload";
+
+static const char TEMP_SUFFIX[] = ".part";
+static const char BACKUP_SUFFIX[] = ".old";
+
+static bool ends_with(const char *name, size_t len, const char *suffix, size_t suffix_len) {
+  return len > suffix_len && memcmp(name + len - suffix_len, suffix, suffix_len) == 0;
+}
+
+bool UploadFile::open(const std::string &tmp_dir, uint32_t id, const std::string &target, size_t expected_size) {
+  this->abort();
+  this->done_ = false;
+  this->target_ = target;
+  this->expected_size_ = expected_size;
+
+  char name[24];
+  snprintf(name, sizeof(name), "/%08x", (unsigned) id);
+  this->temp_path_ = tmp_dir + name + TEMP_SUFFIX;
+  this->backup_path_ = tmp_dir + name + BACKUP_SUFFIX;
+
+  this->preallocated_ = expected_size > 0 && this->preallocate_(expected_size);
+  // Préalloué : écriture sur place dans l'extension, sans allocation de cluster
+  this->file_ = fopen(this->temp_path_.c_str(), this->preallocated_ ? "r+b" : "wb");
+  if (this->file_ == nullptr) {
+    ESP_LOGE(TAG, "Impossible de créer %s (errno: %d)", this->temp_path_.c_str(), errno);
+    unlink(this->temp_path_.c_str());
+    this->done_ = true;
+    return false;
+  }
+  // Sans tampon stdio, fixé avant toute opération sur le flux : chaque
+  // fwrite() devient un f_write() direct (anneau d'écriture, copies)
+  setvbuf(this->file_, nullptr, _IONBF, 0);
+  return true;
+}
+
+bool UploadFile::preallocate_(size_t size) {
+#if FF_USE_EXPAND
+  std::string ff_path;
+  if (!DirectoryReader::to_fatfs_path(this->temp_path_, ff_path))
+    return false;
+  FIL fil;
+  if (f_open(&fil, ff_path.c_str(), FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+    return false;
+  // opt = 1 : allocation immédiate d'une suite de clusters contigus
+  FRESULT res = f_expand(&fil, size, 1);
+  f_close(&fil);
+  if (res != FR_OK) {
+    ESP_LOGD(TAG, "Pas d'extension contiguë de %zu octets (%d), écriture sans préallocation", size, (int) res);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool UploadFile::commit(size_t size) {
+  if (this->file_ == nullptr || this->done_)
+    return false;
+
+  bool ok = fflush(this->file_) == 0;
+  // Corps plus court qu'annoncé : la fin de l'extension est rendue
+  if (ok && this->preallocated_ && size < this->expected_size_) {
+    ok = ftruncate(fileno(this->file_), size) == 0;
+  }
+  ok = fclose(this->file_) == 0 && ok;
+  this->file_ = nullptr;
+  if (!ok) {
+    ESP_LOGE(TAG, "Finalisation de %s impossible (errno: %d)", this->temp_path_.c_str(), errno);
+    this->abort();
+    return false;
+  }
+
+  struct stat st;
+  const bool replace = stat(this->target_.c_str(), &st) == 0;
+  if (replace && rename(this->target_.c_str(), this->backup_path_.c_str()) != 0) {
+    ESP_LOGE(TAG, "Impossible d'écarter %s (errno: %d)", this->target_.c_str(), errno);
+    this->abort();
+    return false;
+  }
+  if (rename(this->temp_path_.c_str(), this->target_.c_str()) != 0) {
+    ESP_LOGE(TAG, "Renommage %s -> %s impossible (errno: %d)", this->temp_path_.c_str(), this->target_.c_str(),
+             errno);
+    if (replace)
+      rename(this->backup_path_.c_str(), this->target_.c_str());
+    this->abort();
+    return false;
+  }
+  if (replace)
+    unlink(this->backup_path_.c_str());
+  this->done_ = true;
+  return true;
+}
+
+void UploadFile::abort() {
+  if (this->done_)
+    return;
+  if (this->file_ != nullptr) {
+    fclose(this->file_);
+    this->file_ = nullptr;
+  }
+  if (!this->temp_path_.empty())
+    unlink(this->temp_path_.c_str());
+  this->done_ = true;
+}
+
+void UploadFile::purge(const std::string &tmp_dir) {
+  DIR *dir = opendir(tmp_dir.c_str());
+  if (dir == nullptr)
+    return;
+  struct dirent *entry;
+  uint32_t removed = 0;
+  while ((entry = readdir(dir)) != nullptr) {
+    const char *name = entry->d_name;
+    size_t len = strlen(name);
+    const bool backup = ends_with(name, len, BACKUP_SUFFIX, sizeof(BACKUP_SUFFIX) - 1);
+    const bool temp = ends_with(name, len, TEMP_SUFFIX, sizeof(TEMP_SUFFIX) - 1);
+    if (!backup && !temp)
+      continue;
+    if (backup) {
+      // Coupure entre les deux renommages : la nouvelle version est en place
+      ESP_LOGW(TAG, "Ancienne version abandonnée: %s", name);
+    }
+    if (unlink((tmp_dir + "/" + name).c_str()) == 0)
+      removed++;
+  }
+  closedir(dir);
+  if (removed > 0)
+    ESP_LOGI(TAG, "%u fichiers temporaires d'envois interrompus supprimés", (unsigned) removed);
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
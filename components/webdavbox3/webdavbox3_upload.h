@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace esphome {
+namespace webdavbox3 {
+
+/**
+ * @brief Fichier temporaire d'un PUT, substitué à la cible en fin d'envoi.
+ *
+ * Le corps est écrit dans un fichier caché du répertoire d'état, préalloué
+ * à Content-Length en une extension contiguë (f_expand) : pas d'allocation
+ * de cluster ni de fragmentation pendant l'écriture. La version existante
+ * reste servie jusqu'à commit() et n'est jamais touchée en cas d'échec.
+ *
+ * FAT ne sait pas renommer par-dessus un fichier : la cible est d'abord
+ * mise de côté, puis remise en place si le renommage échoue.
+ */
+class UploadFile {
+ public:
+  UploadFile() = default;
+  UploadFile(const UploadFile &) = delete;
+  UploadFile &operator=(const UploadFile &) = delete;
+  ~UploadFile() { this->abort(); }
+
+  // Crée le temporaire id dans tmp_dir ; expected_size = 0 : pas de préallocation
+  bool open(const std::string &tmp_dir, uint32_t id, const std::string &target, size_t expected_size);
+  FILE *file() const { return this->file_; }
+  bool is_preallocated() const { return this->preallocated_; }
+  const std::string &temp_path() const { return this->temp_path_; }
+
+  // Ramène le temporaire à size octets, le ferme et remplace la cible
+  bool commit(size_t size);
+  // Ferme et supprime le temporaire ; la cible est intacte
+  void abort();
+
+  // Supprime les temporaires laissés par des envois interrompus
+  static void purge(const std::string &tmp_dir);
+
+ protected:
+  bool preallocate_(size_t size);
+
+  std::string target_;
+  std::string temp_path_;
+  std::string backup_path_;
+  FILE *file_{nullptr};
+  size_t expected_size_{0};
+  bool preallocated_{false};
+  bool done_{false};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome
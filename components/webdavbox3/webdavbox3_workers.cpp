@@ -0,0 +1,96 @@
+#include "webdavbox3_workers.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+static const char *const TAG = "webdavbox3.workers";
+
+// Même pile que la tâche httpd : les handlers y tournaient jusqu'ici
+static const uint32_t WORKER_TASK_STACK = 8192;
+
+bool RequestWorkerPool::start() {
+  if (this->is_running())
+    return true;
+
+  static const char *const NAMES[2] = {"webdav_meta", "webdav_bulk"};
+  static const UBaseType_t PRIORITIES[2] = {METADATA_TASK_PRIORITY, BULK_TASK_PRIORITY};
+
+  // Une classe à 0 worker est une configuration valide (traitement dans la
+  // tâche httpd) : seul l'échec d'une tâche demandée est une erreur
+  bool complete = true;
+  for (uint8_t cls = 0; cls < 2; cls++) {
+    this->queues_[cls] = xQueueCreate(this->queue_length_, sizeof(Job));
+    if (this->queues_[cls] == nullptr) {
+      ESP_LOGE(TAG, "Impossible de créer la file %s", NAMES[cls]);
+      return false;
+    }
+    this->args_[cls] = WorkerArgs{this, (WorkClass) cls};
+    for (uint8_t i = 0; i < this->workers_[cls]; i++) {
+      if (xTaskCreate(worker_task_, NAMES[cls], WORKER_TASK_STACK, &this->args_[cls], PRIORITIES[cls], nullptr) !=
+          pdPASS) {
+        ESP_LOGE(TAG, "Impossible de créer le worker %s #%u", NAMES[cls], i);
+        this->workers_[cls] = i;
+        complete = false;
+        break;
+      }
+    }
+  }
+
+  ESP_LOGI(TAG, "Workers démarrés: %u transferts, %u métadonnées", this->workers_[WORK_BULK],
+           this->workers_[WORK_METADATA]);
+  return complete;
+}
+
+bool RequestWorkerPool::submit(httpd_req_t *req, Handler handler, WorkClass cls) {
+  if (!this->is_running() || this->workers_[cls] == 0)
+    return false;
+
+  // La copie asynchrone garde la socket hors de la boucle httpd jusqu'à complete()
+  httpd_req_t *copy = nullptr;
+  if (httpd_req_async_handler_begin(req, &copy) != ESP_OK) {
+    ESP_LOGW(TAG, "Copie asynchrone impossible pour %s", req->uri);
+    return false;
+  }
+
+  Job job{copy, handler};
+  if (xQueueSend(this->queues_[cls], &job, 0) != pdTRUE) {
+    httpd_req_async_handler_complete(copy);
+    this->rejected_[cls]++;
+    return false;
+  }
+  this->dispatched_[cls]++;
+  return true;
+}
+
+WorkerPoolStats RequestWorkerPool::get_stats() const {
+  WorkerPoolStats stats;
+  for (uint8_t cls = 0; cls < 2; cls++) {
+    stats.dispatched[cls] = this->dispatched_[cls].load();
+    stats.rejected[cls] = this->rejected_[cls].load();
+    stats.busy[cls] = this->busy_[cls].load();
+  }
+  return stats;
+}
+
+void RequestWorkerPool::worker_task_(void *arg) {
+  auto *args = static_cast<WorkerArgs *>(arg);
+  RequestWorkerPool *pool = args->pool;
+  Job job;
+  while (true) {
+    if (xQueueReceive(pool->queues_[args->cls], &job, portMAX_DELAY) != pdTRUE)
+      continue;
+    pool->busy_[args->cls]++;
+    esp_err_t err = job.handler(job.req);
+    if (err != ESP_OK) {
+      // Comme en mode synchrone : une erreur du handler ferme la connexion
+      ESP_LOGD(TAG, "Handler %s terminé avec l'erreur %d", job.req->uri, err);
+      httpd_sess_trigger_close(job.req->handle, httpd_req_to_sockfd(job.req));
+    }
+    httpd_req_async_handler_complete(job.req);
+    pool->busy_[args->cls]--;
+  }
+}
+
+}  // namespace webdavbox3
+}  // namespace esphome
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_http_server.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+namespace esphome {
+namespace webdavbox3 {
+
+enum WorkClass : uint8_t {
+  WORK_METADATA,  // PROPFIND, OPTIONS, HEAD, MKCOL... : courts, sensibles à la latence
+  WORK_BULK,      // GET, PUT, COPY : peuvent durer plusieurs minutes
+};
+
+// Workers de transfert sous les workers de métadonnées, tous sous la tâche
+// httpd ; les tâches SD qui les alimentent (webdavbox3_transfer) s'alignent dessus
+static const UBaseType_t BULK_TASK_PRIORITY = tskIDLE_PRIORITY + 8;
+static const UBaseType_t METADATA_TASK_PRIORITY = tskIDLE_PRIORITY + 9;
+
+struct WorkerPoolStats {
+  uint32_t dispatched[2]{0, 0};
+  uint32_t rejected[2]{0, 0};  // File pleine
+  uint16_t busy[2]{0, 0};      // Workers occupés en ce moment
+};
+
+/**
+ * @brief Workers qui exécutent les handlers hors de la tâche httpd grâce à
+ * l'API de requêtes asynchrones d'esp_http_server.
+ *
+ * Deux files séparées : un téléchargement de plusieurs Go occupe un worker
+ * "bulk" mais ne retarde jamais un PROPFIND, traité par les workers "metadata".
+ */
+class RequestWorkerPool {
+ public:
+  using Handler = esp_err_t (*)(httpd_req_t *req);
+
+  void configure(uint8_t bulk_workers, uint8_t metadata_workers, uint8_t queue_length) {
+    this->workers_[WORK_BULK] = bulk_workers;
+    this->workers_[WORK_METADATA] = metadata_workers;
+    this->queue_length_ = queue_length;
+  }
+  // false si une file ou un worker demandé n'a pas pu être créé
+  bool start();
+  bool is_running() const { return this->queues_[WORK_BULK] != nullptr; }
+  uint8_t get_worker_count(WorkClass cls) const { return this->workers_[cls]; }
+
+  // Confie la requête à un worker ; false si la file est pleine (la requête
+  // reste alors à traiter par l'appelant)
+  bool submit(httpd_req_t *req, Handler handler, WorkClass cls);
+
+  WorkerPoolStats get_stats() const;
+
+ protected:
+  struct Job {
+    httpd_req_t *req;
+    Handler handler;
+  };
+  struct WorkerArgs {
+    RequestWorkerPool *pool;
+    WorkClass cls;
+  };
+
+  static void worker_task_(void *arg);
+
+  uint8_t workers_[2]{1, 2};
+  uint8_t queue_length_{8};
+  QueueHandle_t queues_[2]{nullptr, nullptr};
+  WorkerArgs args_[2];
+  // Mis à jour par la tâche httpd et par chaque worker
+  std::atomic<uint32_t> dispatched_[2]{};
+  std::atomic<uint32_t> rejected_[2]{};
+  std::atomic<uint16_t> busy_[2]{};
+};
+
+}  // namespace webdavbox3
+}  // namespace esphome